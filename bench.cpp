@@ -0,0 +1,298 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include "controller.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Bumped whenever a field of the report changes meaning, so old results are not compared with new ones
+const int REPORT_VERSION = 3;
+
+// Search algorithms timed one query at a time, in the order they are reported
+const searchAlgorithms TIMED_ALGORITHMS[] = {
+    DIJKSTRA_LAZY_HEAP, DIJKSTRA_INDEXED_HEAP, ASTAR, BIDIRECTIONAL, CONTRACTION_HIERARCHY
+};
+
+// Numbers of itineraries asked of the k shortest path search
+const size_t K_VALUES[] = {5, 10, 50};
+
+// Largest relative difference allowed between the distance kernel and the scalar haversine formula
+const double DISTANCE_TOLERANCE = 1e-9;
+
+// Latency distribution of one kind of query, in microseconds
+struct latencySummary {
+    size_t queries;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+// Resident memory of the process, in kilobytes
+struct memoryUsage {
+    long residentKb;
+    long peakResidentKb;
+};
+
+/// Prototypes - - - - - - - - -
+///
+vector<pair<string, string>> sampleReachablePairs(Controller &c, size_t pairCount, unsigned seed);
+latencySummary summarize(vector<double> &latencies);
+memoryUsage readMemoryUsage();
+vector<size_t> parseThreadCounts(const string &list);
+const char *algorithmName(searchAlgorithms algorithm);
+void writeLatency(ostream &out, const latencySummary &summary);
+void writeLoadPhase(ostream &out, const char *name, const loadPhase &phase);
+
+/// Functions - - - - - - - - - -
+///
+// Usage: flightpath_bench [--data DIR] [--pairs N] [--seed S] [--threads LIST] [--k-pairs N]
+//                         [--distance-pairs N] [--output FILE]
+//   Loads the .dat files in DIR (the current directory by default), then times single queries with
+//   every search algorithm, batches of queries on each thread count of LIST (1,2,4 and one per core by default)
+//   and k shortest path queries on the first N pairs (25 by default), over N random pairs of airports
+//   that have a route between them (1000 by default), drawn with the seed S
+//   Then checks the distance kernel against the scalar formula on --distance-pairs random airport pairs
+//   (1000000 by default), and fails if they differ by more than DISTANCE_TOLERANCE
+//   Writes one JSON object to FILE (stdout by default), so runs can be compared across releases
+int main(int argc, char *argv[]) {
+    string dataDirectory = ".", outputFile, threadList;
+    size_t pairCount = 1000, kPairCount = 25, distancePairCount = 1000000;
+    unsigned seed = 1;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if(option == "--data")
+            dataDirectory = argv[i + 1];
+        else if(option == "--pairs")
+            pairCount = max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        else if(option == "--seed")
+            seed = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--threads")
+            threadList = argv[i + 1];
+        else if(option == "--k-pairs")
+            kPairCount = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--distance-pairs")
+            distancePairCount = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--output")
+            outputFile = argv[i + 1];
+    }
+    vector<size_t> threadCounts = parseThreadCounts(threadList);
+
+    memoryUsage beforeLoad = readMemoryUsage();
+    steady_clock::time_point begin = steady_clock::now();
+    Controller c(dataDirectory + "/airports.dat", dataDirectory + "/airlines.dat", dataDirectory + "/routes.dat");
+    double loadMs = duration<double, milli>(steady_clock::now() - begin).count();
+    memoryUsage afterLoad = readMemoryUsage();
+    loadStats load = c.getLoadStats();
+    if(c.getAirportCount() == 0) {
+        cerr << "No airports loaded from " << dataDirectory << endl;
+        return 1;
+    }
+
+    // Caches would answer repeated pairs without searching, so every timed query searches
+    vector<pair<string, string>> pairs = sampleReachablePairs(c, pairCount, seed);
+    c.setCacheCapacity(0, 0);
+
+    ostringstream report;
+    report << "{\"version\":" << REPORT_VERSION << ",\"seed\":" << seed << ",\"airports\":" << c.getAirportCount()
+           << ",\"pairs\":" << pairs.size() << ",\"hardwareThreads\":" << thread::hardware_concurrency();
+    report << ",\"load\":{\"totalMs\":" << loadMs;
+    writeLoadPhase(report, "airlines", load.airlines);
+    writeLoadPhase(report, "airports", load.airports);
+    writeLoadPhase(report, "routes", load.routes);
+    report << ",\"derivedMs\":" << load.derivedMs << "}";
+    report << ",\"memory\":{\"residentKb\":" << afterLoad.residentKb << ",\"peakResidentKb\":" << afterLoad.peakResidentKb
+           << ",\"loadedKb\":" << afterLoad.residentKb - beforeLoad.residentKb << "}";
+
+    // The hierarchy is built before timing its queries, and its build time reported on its own
+    double hierarchyBuildMs = 0;
+    ostringstream work;
+    report << ",\"queryLatencyUs\":{";
+    for(size_t a = 0; a < sizeof(TIMED_ALGORITHMS) / sizeof(TIMED_ALGORITHMS[0]); ++a) {
+        searchAlgorithms algorithm = TIMED_ALGORITHMS[a];
+        if(algorithm == CONTRACTION_HIERARCHY) {
+            begin = steady_clock::now();
+            c.buildHierarchy();
+            hierarchyBuildMs = duration<double, milli>(steady_clock::now() - begin).count();
+        }
+        c.setSearchAlgorithm(algorithm);
+
+        // Statistics are turned on for a second, untimed pass that counts the work of each search
+        vector<double> latencies;
+        for(size_t i = 0; i < pairs.size(); ++i) {
+            begin = steady_clock::now();
+            c.getShortestPath(pairs[i].first, pairs[i].second);
+            latencies.push_back(duration<double, micro>(steady_clock::now() - begin).count());
+        }
+        c.setStatsEnabled(true);
+        for(size_t i = 0; i < pairs.size(); ++i)
+            c.getShortestPath(pairs[i].first, pairs[i].second);
+        queryStatsTotals sums = c.getQueryStats();
+        c.setStatsEnabled(false);
+
+        report << (a == 0 ? "" : ",") << "\"" << algorithmName(algorithm) << "\":";
+        writeLatency(report, summarize(latencies));
+        work << (a == 0 ? "" : ",") << "\"" << algorithmName(algorithm) << "\":{\"settled\":"
+             << double(sums.search.settled) / pairs.size() << ",\"relaxed\":" << double(sums.search.relaxed) / pairs.size()
+             << ",\"heapPushes\":" << double(sums.search.heapPushes) / pairs.size()
+             << ",\"stalePops\":" << double(sums.search.stalePops) / pairs.size() << "}";
+    }
+    report << "},\"workPerQuery\":{" << work.str() << "},\"hierarchyBuildMs\":" << hierarchyBuildMs;
+
+    // Batches use the default algorithm, and the pool of each thread count is started before timing it
+    c.setSearchAlgorithm(DIJKSTRA_INDEXED_HEAP);
+    report << ",\"batch\":[";
+    for(size_t t = 0; t < threadCounts.size(); ++t) {
+        c.setWorkerThreads(threadCounts[t]);
+        c.getShortestPaths(vector<pair<string, string>>(pairs.begin(), pairs.begin() + min<size_t>(pairs.size(), 16)));
+        begin = steady_clock::now();
+        c.getShortestPaths(pairs);
+        double seconds = duration<double>(steady_clock::now() - begin).count();
+        report << (t == 0 ? "" : ",") << "{\"threads\":" << threadCounts[t] << ",\"queriesPerSecond\":" << pairs.size() / seconds << "}";
+    }
+    report << "]";
+
+    report << ",\"kShortest\":[";
+    size_t kPairs = min(kPairCount, pairs.size());
+    for(size_t k = 0; k < sizeof(K_VALUES) / sizeof(K_VALUES[0]); ++k) {
+        vector<double> latencies;
+        for(size_t i = 0; i < kPairs; ++i) {
+            begin = steady_clock::now();
+            c.getKShortestPaths(pairs[i].first, pairs[i].second, K_VALUES[k]);
+            latencies.push_back(duration<double, micro>(steady_clock::now() - begin).count());
+        }
+        report << (k == 0 ? "" : ",") << "{\"k\":" << K_VALUES[k] << ",\"latencyUs\":";
+        writeLatency(report, summarize(latencies));
+        report << "}";
+    }
+    report << "]";
+
+    distanceKernelCheck distances = c.checkDistanceKernel(distancePairCount, seed);
+    report << ",\"distanceKernel\":{\"pairs\":" << distances.pairs << ",\"maxAbsoluteErrorMiles\":" << distances.maxAbsoluteError
+           << ",\"maxRelativeError\":" << distances.maxRelativeError << ",\"kernelNsPerPair\":" << distances.kernelNs
+           << ",\"scalarNsPerPair\":" << distances.scalarNs << "}}";
+    bool isAccurate = distances.maxRelativeError <= DISTANCE_TOLERANCE;
+    if(!isAccurate)
+        cerr << "Distance kernel differs from the scalar formula by up to " << distances.maxRelativeError << endl;
+
+    if(outputFile.empty()) {
+        cout << report.str() << endl;
+        return isAccurate ? 0 : 1;
+    }
+    ofstream fout(outputFile.c_str());
+    fout << report.str() << endl;
+    if(!fout) {
+        cerr << "Could not write " << outputFile << endl;
+        return 1;
+    }
+    return isAccurate ? 0 : 1;
+}
+
+// Draws random pairs of distinct airports with an IATA code until "pairCount" of them have a route,
+// or until so many draws failed that the graph is unlikely to have enough
+vector<pair<string, string>> sampleReachablePairs(Controller &c, size_t pairCount, unsigned seed) {
+    mt19937 random(seed);
+    uniform_int_distribution<uint32_t> pickAirport(0, c.getAirportCount() - 1);
+    vector<pair<string, string>> pairs;
+    for(size_t attempts = 0; pairs.size() < pairCount && attempts < pairCount * 1000; ++attempts) {
+        string start = c.getAirportCode(pickAirport(random));
+        string end = c.getAirportCode(pickAirport(random));
+        if(start.empty() || end.empty() || start == end)
+            continue;
+        try {
+            c.getItinerary(start, end);
+            pairs.push_back(make_pair(start, end));
+        }
+        catch (CONTROLLER_ERRORS e) {
+        }
+    }
+    return pairs;
+}
+
+// Sorts "latencies" and reads its percentiles
+latencySummary summarize(vector<double> &latencies) {
+    latencySummary summary = latencySummary();
+    summary.queries = latencies.size();
+    if(latencies.empty())
+        return summary;
+    sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for(size_t i = 0; i < latencies.size(); ++i)
+        total += latencies[i];
+    summary.mean = total / latencies.size();
+    summary.p50 = latencies[min(latencies.size() - 1, latencies.size() / 2)];
+    summary.p99 = latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    summary.p999 = latencies[min(latencies.size() - 1, latencies.size() * 999 / 1000)];
+    summary.max = latencies.back();
+    return summary;
+}
+
+// Reads the current and peak resident set size from /proc, or -1 where it is not available
+memoryUsage readMemoryUsage() {
+    memoryUsage usage = {-1, -1};
+    ifstream fin("/proc/self/status");
+    string line;
+    while(getline(fin, line)) {
+        if(line.compare(0, 6, "VmRSS:") == 0)
+            usage.residentKb = strtol(line.c_str() + 6, nullptr, 10);
+        else if(line.compare(0, 6, "VmHWM:") == 0)
+            usage.peakResidentKb = strtol(line.c_str() + 6, nullptr, 10);
+    }
+    return usage;
+}
+
+// Reads a comma separated list of thread counts, defaulting to 1, 2, 4 and one per core
+vector<size_t> parseThreadCounts(const string &list) {
+    vector<size_t> counts;
+    stringstream ss(list);
+    string count;
+    while(getline(ss, count, ',')) {
+        size_t value = strtoul(count.c_str(), nullptr, 10);
+        if(value != 0)
+            counts.push_back(value);
+    }
+    if(!counts.empty())
+        return counts;
+
+    counts = {1, 2, 4};
+    size_t cores = thread::hardware_concurrency();
+    if(find(counts.begin(), counts.end(), cores) == counts.end() && cores != 0)
+        counts.push_back(cores);
+    return counts;
+}
+
+const char *algorithmName(searchAlgorithms algorithm) {
+    switch(algorithm) {
+    case DIJKSTRA_LAZY_HEAP:
+        return "DIJKSTRA_LAZY_HEAP";
+    case DIJKSTRA_INDEXED_HEAP:
+        return "DIJKSTRA_INDEXED_HEAP";
+    case ASTAR:
+        return "ASTAR";
+    case BIDIRECTIONAL:
+        return "BIDIRECTIONAL";
+    case CONTRACTION_HIERARCHY:
+        return "CONTRACTION_HIERARCHY";
+    }
+    return "UNKNOWN";
+}
+
+void writeLatency(ostream &out, const latencySummary &summary) {
+    out << "{\"queries\":" << summary.queries << ",\"mean\":" << summary.mean << ",\"p50\":" << summary.p50
+        << ",\"p99\":" << summary.p99 << ",\"p999\":" << summary.p999 << ",\"max\":" << summary.max << "}";
+}
+
+void writeLoadPhase(ostream &out, const char *name, const loadPhase &phase) {
+    out << ",\"" << name << "\":{\"ms\":" << phase.ms << ",\"lines\":" << phase.lines.lines
+        << ",\"malformed\":" << phase.lines.malformed << ",\"skipped\":" << phase.lines.skipped
+        << ",\"records\":" << phase.records << "}";
+}
@@ -0,0 +1,222 @@
+#include "carriergraph.h"
+#include <algorithm>
+
+using namespace std;
+
+CarrierGraph::CarrierGraph() : setWords(0) {
+}
+
+// Merges the parallel routes of "graph" into one edge per (source, target) pair
+// Edges keep the order in which their targets first appear among the airport's routes
+void CarrierGraph::build(const RouteGraph &graph) {
+    vector<int32_t> builtCarrierIds;
+    for(uint32_t e = 0; e < graph.edgeCount(); ++e)
+        builtCarrierIds.push_back(graph.carrier(e));
+    sort(builtCarrierIds.begin(), builtCarrierIds.end());
+    builtCarrierIds.erase(unique(builtCarrierIds.begin(), builtCarrierIds.end()), builtCarrierIds.end());
+    carrierIds.assign(move(builtCarrierIds));
+    setWords = (carrierIds.size() + 63) / 64;
+
+    mergedEdges built;
+    built.offsets.push_back(0);
+    built.listOffsets.push_back(0);
+    vector<uint32_t> targetSlots(graph.nodeCount(), 0);
+    for(uint32_t source = 0; source < graph.nodeCount(); ++source)
+        appendMergedEdges(graph, source, targetSlots, built);
+    assign(built);
+}
+
+// Merges "graph", a changed copy of the graph this was built from, where only the routes
+// leaving "changedSources" (and any airports added at the end) differ
+// Unchanged airports copy their merged edges, each run of them between two changed airports as one block
+// with its offsets moved, so only the changed airports are merged again, unless a route uses an airline
+// the old graph never had, which renumbers every airline set
+CarrierGraph CarrierGraph::withChanges(const RouteGraph &graph, const vector<uint32_t> &changedSources) const {
+    CarrierGraph updated;
+    vector<uint32_t> changed(changedSources);
+    for(uint32_t source = nodeCount(); source < graph.nodeCount(); ++source)
+        changed.push_back(source);
+    sort(changed.begin(), changed.end());
+    changed.erase(unique(changed.begin(), changed.end()), changed.end());
+    for(size_t i = 0; i < changed.size(); ++i) {
+        for(uint32_t e = graph.edgeBegin(changed[i]); e < graph.edgeEnd(changed[i]); ++e) {
+            if(carrierIndex(graph.carrier(e)) == NOT_FOUND) {
+                updated.build(graph);
+                return updated;
+            }
+        }
+    }
+
+    updated.carrierIds = carrierIds;
+    updated.setWords = setWords;
+    mergedEdges built;
+    built.offsets.reserve(graph.nodeCount() + 1);
+    built.targets.reserve(edgeCount());
+    built.weights.reserve(edgeCount());
+    built.carrierSets.reserve(carrierSets.size());
+    built.listOffsets.reserve(listOffsets.size());
+    built.carrierLists.reserve(carrierLists.size());
+    built.offsets.push_back(0);
+    built.listOffsets.push_back(0);
+    vector<uint32_t> targetSlots(graph.nodeCount(), 0);
+
+    // Copies the merged edges of airports [begin, end), which all come before any added airport
+    auto copyUnchanged = [&](uint32_t begin, uint32_t end) {
+        if(begin >= end)
+            return;
+        uint32_t first = edgeBegin(begin), last = edgeBegin(end);
+        uint32_t base = built.targets.size();
+        for(uint32_t node = begin + 1; node <= end; ++node)
+            built.offsets.push_back(offsets[node] - first + base);
+        uint32_t listBase = built.carrierLists.size();
+        for(uint32_t edge = first + 1; edge <= last; ++edge)
+            built.listOffsets.push_back(listOffsets[edge] - listOffsets[first] + listBase);
+        built.targets.insert(built.targets.end(), targets.begin() + first, targets.begin() + last);
+        built.weights.insert(built.weights.end(), weights.begin() + first, weights.begin() + last);
+        built.carrierSets.insert(built.carrierSets.end(), carrierSets.begin() + size_t(first) * setWords,
+                                 carrierSets.begin() + size_t(last) * setWords);
+        built.carrierLists.insert(built.carrierLists.end(), carrierLists.begin() + listOffsets[first],
+                                  carrierLists.begin() + listOffsets[last]);
+    };
+
+    uint32_t copiedUpTo = 0;
+    for(size_t i = 0; i < changed.size(); ++i) {
+        copyUnchanged(copiedUpTo, changed[i]);
+        updated.appendMergedEdges(graph, changed[i], targetSlots, built);
+        copiedUpTo = changed[i] + 1;
+    }
+    copyUnchanged(copiedUpTo, graph.nodeCount());
+    updated.assign(built);
+    return updated;
+}
+
+void CarrierGraph::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_CARRIER_GRAPH_IDS, carrierIds);
+    writer.addSection(SECTION_CARRIER_GRAPH_OFFSETS, offsets);
+    writer.addSection(SECTION_CARRIER_GRAPH_TARGETS, targets);
+    writer.addSection(SECTION_CARRIER_GRAPH_WEIGHTS, weights);
+    writer.addSection(SECTION_CARRIER_GRAPH_SETS, carrierSets);
+    writer.addSection(SECTION_CARRIER_GRAPH_LIST_OFFSETS, listOffsets);
+    writer.addSection(SECTION_CARRIER_GRAPH_LISTS, carrierLists);
+}
+
+// Attaches the merged graph stored in a snapshot, if there is one that fits a graph of "expectedNodeCount"
+bool CarrierGraph::read(const SnapshotReader &reader, size_t expectedNodeCount) {
+    if(!reader.attachSection(SECTION_CARRIER_GRAPH_IDS, carrierIds)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_OFFSETS, offsets)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_TARGETS, targets)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_WEIGHTS, weights)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_SETS, carrierSets)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_LIST_OFFSETS, listOffsets)
+            || !reader.attachSection(SECTION_CARRIER_GRAPH_LISTS, carrierLists)) {
+        clear();
+        return false;
+    }
+    setWords = (carrierIds.size() + 63) / 64;
+
+    bool valid = offsets.size() == expectedNodeCount + 1 && offsets[0] == 0
+              && offsets[expectedNodeCount] == targets.size() && weights.size() == targets.size()
+              && carrierSets.size() == targets.size() * setWords
+              && listOffsets.size() == targets.size() + 1 && listOffsets[0] == 0
+              && listOffsets[targets.size()] == carrierLists.size();
+    for(size_t i = 0; valid && i < expectedNodeCount; ++i)
+        valid = offsets[i] <= offsets[i + 1];
+    for(size_t i = 0; valid && i < targets.size(); ++i)
+        valid = listOffsets[i] <= listOffsets[i + 1];
+    for(size_t i = 0; valid && i < targets.size(); ++i)
+        valid = targets[i] < expectedNodeCount;
+    if(!valid)
+        clear();
+    return valid;
+}
+
+void CarrierGraph::clear() {
+    setWords = 0;
+    carrierIds.clear();
+    offsets.clear();
+    targets.clear();
+    weights.clear();
+    carrierSets.clear();
+    listOffsets.clear();
+    carrierLists.clear();
+}
+
+// Appends the merged edges of "source" to "built", using "targetSlots" (one entry per airport)
+// as scratch: the slot of each target's edge, only valid if it is one of this source's slots
+// Each edge's airline list is gathered from its routes afterwards, dropping repeated rows
+void CarrierGraph::appendMergedEdges(const RouteGraph &graph, uint32_t source, vector<uint32_t> &targetSlots,
+                                     mergedEdges &built) const {
+    uint32_t firstSlot = built.targets.size();
+    for(uint32_t e = graph.edgeBegin(source); e < graph.edgeEnd(source); ++e) {
+        uint32_t target = graph.target(e);
+        uint32_t slot = targetSlots[target];
+        if(slot < firstSlot || slot >= built.targets.size() || built.targets[slot] != target) {
+            slot = built.targets.size();
+            targetSlots[target] = slot;
+            built.targets.push_back(target);
+            built.weights.push_back(graph.weight(e));
+            built.carrierSets.resize(built.carrierSets.size() + setWords, 0);
+        }
+        built.weights[slot] = min(built.weights[slot], graph.weight(e));
+        uint32_t carrier = carrierIndex(graph.carrier(e));
+        built.carrierSets[size_t(slot) * setWords + carrier / 64] |= uint64_t(1) << (carrier % 64);
+    }
+    for(uint32_t slot = firstSlot; slot < built.targets.size(); ++slot) {
+        size_t listBegin = built.carrierLists.size();
+        for(uint32_t e = graph.edgeBegin(source); e < graph.edgeEnd(source); ++e) {
+            if(graph.target(e) == built.targets[slot]
+                    && find(built.carrierLists.begin() + listBegin, built.carrierLists.end(), graph.carrier(e)) == built.carrierLists.end())
+                built.carrierLists.push_back(graph.carrier(e));
+        }
+        built.listOffsets.push_back(built.carrierLists.size());
+    }
+    built.offsets.push_back(built.targets.size());
+}
+
+void CarrierGraph::assign(mergedEdges &built) {
+    offsets.assign(move(built.offsets));
+    targets.assign(move(built.targets));
+    weights.assign(move(built.weights));
+    carrierSets.assign(move(built.carrierSets));
+    listOffsets.assign(move(built.listOffsets));
+    carrierLists.assign(move(built.carrierLists));
+}
+
+// Returns the edge from "source" to "target", or NOT_FOUND if no airline flies it
+uint32_t CarrierGraph::findEdge(uint32_t source, uint32_t target) const {
+    for(uint32_t edge = edgeBegin(source); edge < edgeEnd(source); ++edge) {
+        if(targets[edge] == target)
+            return edge;
+    }
+    return NOT_FOUND;
+}
+
+// Returns the dense index of an airline id, or NOT_FOUND if no route uses it
+uint32_t CarrierGraph::carrierIndex(int carrierId) const {
+    const int32_t *found = lower_bound(carrierIds.begin(), carrierIds.end(), carrierId);
+    if(found == carrierIds.end() || *found != carrierId)
+        return NOT_FOUND;
+    return found - carrierIds.begin();
+}
+
+// True if the airline "carrierId" is in "mask"
+bool CarrierGraph::maskAllows(const vector<uint64_t> &mask, int carrierId) const {
+    uint32_t carrier = carrierIndex(carrierId);
+    return carrier != NOT_FOUND && ((mask[carrier / 64] >> (carrier % 64)) & 1) != 0;
+}
+
+// Turns a filter into the bitset of airlines it allows
+// Airline ids that no route uses are ignored
+vector<uint64_t> CarrierGraph::makeMask(const carrierFilter &filter) const {
+    vector<uint64_t> mask(setWords, filter.mode == ALLOW_CARRIERS ? 0 : ~uint64_t(0));
+    for(size_t i = 0; i < filter.carrierIds.size(); ++i) {
+        uint32_t carrier = carrierIndex(filter.carrierIds[i]);
+        if(carrier == NOT_FOUND)
+            continue;
+        if(filter.mode == ALLOW_CARRIERS)
+            mask[carrier / 64] |= uint64_t(1) << (carrier % 64);
+        else
+            mask[carrier / 64] &= ~(uint64_t(1) << (carrier % 64));
+    }
+    return mask;
+}
@@ -0,0 +1,99 @@
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+#include "routegraph.h"
+#include "snapshot.h"
+
+#ifndef CARRIERGRAPH_H
+#define CARRIERGRAPH_H
+
+// Whether a carrierFilter lists the only airlines allowed, or the airlines to avoid
+enum carrierFilterModes {
+    ALLOW_CARRIERS,
+    DENY_CARRIERS
+};
+
+// Airlines a query may fly, by OpenFlights airline id
+struct carrierFilter {
+    carrierFilterModes mode;
+    std::vector<int> carrierIds;
+};
+
+// RouteGraph with parallel routes between the same two airports stored once, as a single edge
+// carrying the set of airlines that fly it
+// Airlines are numbered densely (0..C-1) in order of id, and each edge's set is a bitset of
+// wordsPerSet() 64-bit words, so a carrier filter is a bitset intersection per edge
+class CarrierGraph {
+
+public:
+
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    CarrierGraph();
+
+    void build(const RouteGraph &graph);
+    CarrierGraph withChanges(const RouteGraph &graph, const std::vector<uint32_t> &changedSources) const;
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader, size_t expectedNodeCount);
+    void clear();
+
+    size_t nodeCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t edgeCount() const { return targets.size(); }
+    size_t carrierCount() const { return carrierIds.size(); }
+    size_t wordsPerSet() const { return setWords; }
+
+    uint32_t edgeBegin(uint32_t node) const { return offsets[node]; }
+    uint32_t edgeEnd(uint32_t node) const { return offsets[node + 1]; }
+    uint32_t target(uint32_t edge) const { return targets[edge]; }
+    double weight(uint32_t edge) const { return weights[edge]; }
+
+    // True if any airline of "edge" is in "mask", a bitset of wordsPerSet() words
+    bool allows(uint32_t edge, const uint64_t *mask) const {
+        const uint64_t *set = carrierSets.data() + size_t(edge) * setWords;
+        for(size_t word = 0; word < setWords; ++word) {
+            if(set[word] & mask[word])
+                return true;
+        }
+        return false;
+    }
+
+    // Airline ids of "edge", listed once each in the order its routes appear in the route data
+    uint32_t carriersBegin(uint32_t edge) const { return listOffsets[edge]; }
+    uint32_t carriersEnd(uint32_t edge) const { return listOffsets[edge + 1]; }
+    int carrierAt(uint32_t listIndex) const { return carrierLists[listIndex]; }
+
+    uint32_t findEdge(uint32_t source, uint32_t target) const;
+    uint32_t carrierIndex(int carrierId) const;
+    bool maskAllows(const std::vector<uint64_t> &mask, int carrierId) const;
+    std::vector<uint64_t> makeMask(const carrierFilter &filter) const;
+
+
+private:
+
+    // Merged edges while they are being built
+    struct mergedEdges {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> targets;
+        std::vector<double> weights;
+        std::vector<uint64_t> carrierSets;
+        std::vector<uint32_t> listOffsets;
+        std::vector<int32_t> carrierLists;
+    };
+
+    size_t setWords;
+    FlatArray<int32_t> carrierIds; // Airline id of each dense airline index, sorted
+    FlatArray<uint32_t> offsets;
+    FlatArray<uint32_t> targets;
+    FlatArray<double> weights;
+    FlatArray<uint64_t> carrierSets; // wordsPerSet() words per edge
+    FlatArray<uint32_t> listOffsets; // Start of each edge's airline ids in carrierLists, one past the last edge
+    FlatArray<int32_t> carrierLists;
+
+
+    void appendMergedEdges(const RouteGraph &graph, uint32_t source, std::vector<uint32_t> &targetSlots,
+                           mergedEdges &built) const;
+    void assign(mergedEdges &built);
+};
+
+#endif // CARRIERGRAPH_H
@@ -0,0 +1,379 @@
+#include "contraction.h"
+#include <algorithm>
+#include <queue>
+#include <limits>
+#include <functional>
+
+using namespace std;
+
+// Witness searches give up after settling this many airports, adding a shortcut to be safe
+// Priorities only estimate the shortcuts needed, so those searches are kept much shorter
+const size_t WITNESS_SETTLE_LIMIT = 500;
+const size_t PRIORITY_SETTLE_LIMIT = 50;
+
+// Arc of the graph that is still being contracted
+struct contractionArc {
+    uint32_t node;
+    double weight;
+    uint32_t middle;
+};
+
+// Working state of the contraction: the remaining graph, plus scratch for witness searches
+class HierarchyBuilder {
+
+public:
+
+    HierarchyBuilder(const RouteGraph &graph);
+
+    void contractAll();
+
+    std::vector<uint32_t> ranks;
+    std::vector<std::vector<contractionArc>> upArcs;   // Final arcs to higher ranked airports
+    std::vector<std::vector<contractionArc>> downArcs; // Final arcs from higher ranked airports
+
+
+private:
+
+    typedef pair<double, uint32_t> queueEntry;
+
+    std::vector<std::vector<contractionArc>> outArcs;
+    std::vector<std::vector<contractionArc>> inArcs;
+    std::vector<bool> contracted;
+    std::vector<int> deletedNeighbors;
+
+    std::vector<uint32_t> witnessReachedIn;
+    std::vector<double> witnessDistances;
+    std::vector<queueEntry> witnessHeap;
+    uint32_t witnessGeneration;
+
+    int priority(uint32_t node);
+    size_t contract(uint32_t node, bool simulate);
+    void witnessSearch(uint32_t source, uint32_t skipped, double maximumDistance, size_t settleLimit);
+    double witnessDistance(uint32_t node) const;
+    void setArc(std::vector<contractionArc> &arcs, uint32_t node, double weight, uint32_t middle);
+    void removeArc(std::vector<contractionArc> &arcs, uint32_t node);
+};
+
+/// HIERARCHY BUILDER
+///
+
+// Copies the graph into per-airport arc lists, keeping only the shortest of any parallel routes
+HierarchyBuilder::HierarchyBuilder(const RouteGraph &graph)
+    : ranks(graph.nodeCount(), 0), upArcs(graph.nodeCount()), downArcs(graph.nodeCount()),
+      outArcs(graph.nodeCount()), inArcs(graph.nodeCount()), contracted(graph.nodeCount(), false),
+      deletedNeighbors(graph.nodeCount(), 0), witnessReachedIn(graph.nodeCount(), 0),
+      witnessDistances(graph.nodeCount(), 0), witnessGeneration(0) {
+
+    for(uint32_t source = 0; source < graph.nodeCount(); ++source) {
+        for(uint32_t e = graph.edgeBegin(source); e < graph.edgeEnd(source); ++e) {
+            if(graph.target(e) == source)
+                continue;
+            setArc(outArcs[source], graph.target(e), graph.weight(e), ContractionHierarchy::NO_MIDDLE);
+            setArc(inArcs[graph.target(e)], source, graph.weight(e), ContractionHierarchy::NO_MIDDLE);
+        }
+    }
+}
+
+// Contracts airports in order of lowest priority, re-checking priorities lazily:
+// a popped airport whose priority went up since it was queued is queued again instead
+void HierarchyBuilder::contractAll() {
+    priority_queue<pair<int, uint32_t>, vector<pair<int, uint32_t>>, greater<pair<int, uint32_t>>> order;
+    for(uint32_t node = 0; node < ranks.size(); ++node)
+        order.push(make_pair(priority(node), node));
+
+    uint32_t nextRank = 0;
+    while(!order.empty()) {
+        uint32_t node = order.top().second;
+        order.pop();
+        if(contracted[node])
+            continue;
+
+        int current = priority(node);
+        if(!order.empty() && current > order.top().first) {
+            order.push(make_pair(current, node));
+            continue;
+        }
+
+        contract(node, false);
+        ranks[node] = nextRank++;
+    }
+}
+
+// Edge difference (shortcuts added minus arcs removed) plus the number of contracted neighbours,
+// which favours airports that keep the remaining graph small and spreads contraction evenly
+int HierarchyBuilder::priority(uint32_t node) {
+    int shortcuts = contract(node, true);
+    int removedArcs = outArcs[node].size() + inArcs[node].size();
+    return shortcuts - removedArcs + deletedNeighbors[node];
+}
+
+// Adds a shortcut u -> w for every path u -> node -> w that has no shorter witness path around "node"
+// When simulating, only counts the shortcuts; otherwise adds them and removes "node" from the graph
+size_t HierarchyBuilder::contract(uint32_t node, bool simulate) {
+    size_t shortcuts = 0;
+    const vector<contractionArc> &incoming = inArcs[node];
+    const vector<contractionArc> &outgoing = outArcs[node];
+
+    double longestOutgoing = 0;
+    for(size_t j = 0; j < outgoing.size(); ++j)
+        longestOutgoing = max(longestOutgoing, outgoing[j].weight);
+
+    vector<contractionArc> added;
+    vector<uint32_t> addedSources;
+    for(size_t i = 0; i < incoming.size(); ++i) {
+        uint32_t source = incoming[i].node;
+        witnessSearch(source, node, incoming[i].weight + longestOutgoing,
+                      simulate ? PRIORITY_SETTLE_LIMIT : WITNESS_SETTLE_LIMIT);
+        for(size_t j = 0; j < outgoing.size(); ++j) {
+            uint32_t target = outgoing[j].node;
+            if(target == source)
+                continue;
+            double viaNode = incoming[i].weight + outgoing[j].weight;
+            if(witnessDistance(target) <= viaNode)
+                continue;
+            ++shortcuts;
+            if(!simulate) {
+                added.push_back(contractionArc{target, viaNode, node});
+                addedSources.push_back(source);
+            }
+        }
+    }
+    if(simulate)
+        return shortcuts;
+
+    // Arcs that are still attached to the contracted airport become its final hierarchy arcs
+    upArcs[node] = outgoing;
+    downArcs[node] = incoming;
+    for(size_t j = 0; j < outgoing.size(); ++j) {
+        removeArc(inArcs[outgoing[j].node], node);
+        ++deletedNeighbors[outgoing[j].node];
+    }
+    for(size_t i = 0; i < incoming.size(); ++i) {
+        removeArc(outArcs[incoming[i].node], node);
+        ++deletedNeighbors[incoming[i].node];
+    }
+    for(size_t i = 0; i < added.size(); ++i) {
+        setArc(outArcs[addedSources[i]], added[i].node, added[i].weight, added[i].middle);
+        setArc(inArcs[added[i].node], addedSources[i], added[i].weight, added[i].middle);
+    }
+    outArcs[node].clear();
+    inArcs[node].clear();
+    contracted[node] = true;
+    return shortcuts;
+}
+
+// Bounded Dijkstra from "source" that avoids "skipped", over airports not yet contracted
+// Stops at "maximumDistance" or after "settleLimit" airports
+void HierarchyBuilder::witnessSearch(uint32_t source, uint32_t skipped, double maximumDistance, size_t settleLimit) {
+    ++witnessGeneration;
+    witnessHeap.clear();
+    witnessReachedIn[source] = witnessGeneration;
+    witnessDistances[source] = 0;
+    witnessHeap.push_back(queueEntry(0, source));
+
+    size_t settled = 0;
+    while(!witnessHeap.empty() && settled < settleLimit) {
+        pop_heap(witnessHeap.begin(), witnessHeap.end(), greater<queueEntry>());
+        queueEntry next = witnessHeap.back();
+        witnessHeap.pop_back();
+        if(next.first > witnessDistances[next.second])
+            continue;
+        if(next.first > maximumDistance)
+            break;
+        ++settled;
+
+        const vector<contractionArc> &arcs = outArcs[next.second];
+        for(size_t i = 0; i < arcs.size(); ++i) {
+            uint32_t target = arcs[i].node;
+            if(target == skipped)
+                continue;
+            double candidate = next.first + arcs[i].weight;
+            if(witnessReachedIn[target] != witnessGeneration || candidate < witnessDistances[target]) {
+                witnessReachedIn[target] = witnessGeneration;
+                witnessDistances[target] = candidate;
+                witnessHeap.push_back(queueEntry(candidate, target));
+                push_heap(witnessHeap.begin(), witnessHeap.end(), greater<queueEntry>());
+            }
+        }
+    }
+}
+
+// Distance found by the last witness search, which may be longer than the true distance
+double HierarchyBuilder::witnessDistance(uint32_t node) const {
+    if(witnessReachedIn[node] != witnessGeneration)
+        return numeric_limits<double>::infinity();
+    return witnessDistances[node];
+}
+
+// Adds an arc to "node", or shortens the existing one if the new arc is shorter
+void HierarchyBuilder::setArc(vector<contractionArc> &arcs, uint32_t node, double weight, uint32_t middle) {
+    for(size_t i = 0; i < arcs.size(); ++i) {
+        if(arcs[i].node == node) {
+            if(weight < arcs[i].weight) {
+                arcs[i].weight = weight;
+                arcs[i].middle = middle;
+            }
+            return;
+        }
+    }
+    arcs.push_back(contractionArc{node, weight, middle});
+}
+
+void HierarchyBuilder::removeArc(vector<contractionArc> &arcs, uint32_t node) {
+    for(size_t i = 0; i < arcs.size(); ++i) {
+        if(arcs[i].node == node) {
+            arcs[i] = arcs.back();
+            arcs.pop_back();
+            return;
+        }
+    }
+}
+
+/// CONTRACTION HIERARCHY
+///
+
+// Packs per-airport arc lists into CSR offset, target, weight and middle arrays
+static void packArcs(const vector<vector<contractionArc>> &arcs, FlatArray<uint32_t> &offsets,
+                     FlatArray<uint32_t> &targets, FlatArray<double> &weights, FlatArray<uint32_t> &middles) {
+    vector<uint32_t> builtOffsets(1, 0);
+    vector<uint32_t> builtTargets;
+    vector<double> builtWeights;
+    vector<uint32_t> builtMiddles;
+    for(size_t node = 0; node < arcs.size(); ++node) {
+        for(size_t i = 0; i < arcs[node].size(); ++i) {
+            builtTargets.push_back(arcs[node][i].node);
+            builtWeights.push_back(arcs[node][i].weight);
+            builtMiddles.push_back(arcs[node][i].middle);
+        }
+        builtOffsets.push_back(builtTargets.size());
+    }
+    offsets.assign(move(builtOffsets));
+    targets.assign(move(builtTargets));
+    weights.assign(move(builtWeights));
+    middles.assign(move(builtMiddles));
+}
+
+ContractionHierarchy::ContractionHierarchy() {
+}
+
+// Contracts every airport of "graph" and stores the resulting ranks and arcs
+void ContractionHierarchy::build(const RouteGraph &graph) {
+    HierarchyBuilder builder(graph);
+    builder.contractAll();
+
+    ranks.assign(move(builder.ranks));
+    packArcs(builder.upArcs, upOffsets, upTargets, upWeights, upMiddles);
+    packArcs(builder.downArcs, downOffsets, downTargets, downWeights, downMiddles);
+}
+
+void ContractionHierarchy::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_HIERARCHY_RANKS, ranks);
+    writer.addSection(SECTION_HIERARCHY_UP_OFFSETS, upOffsets);
+    writer.addSection(SECTION_HIERARCHY_UP_TARGETS, upTargets);
+    writer.addSection(SECTION_HIERARCHY_UP_WEIGHTS, upWeights);
+    writer.addSection(SECTION_HIERARCHY_UP_MIDDLES, upMiddles);
+    writer.addSection(SECTION_HIERARCHY_DOWN_OFFSETS, downOffsets);
+    writer.addSection(SECTION_HIERARCHY_DOWN_TARGETS, downTargets);
+    writer.addSection(SECTION_HIERARCHY_DOWN_WEIGHTS, downWeights);
+    writer.addSection(SECTION_HIERARCHY_DOWN_MIDDLES, downMiddles);
+}
+
+// Attaches the hierarchy stored in a snapshot, if there is one that fits a graph of "expectedNodeCount"
+// Arcs must lead to higher ranked airports and middles to lower ranked ones, or nothing is attached
+bool ContractionHierarchy::read(const SnapshotReader &reader, size_t expectedNodeCount) {
+    if(!reader.attachSection(SECTION_HIERARCHY_RANKS, ranks)
+            || !reader.attachSection(SECTION_HIERARCHY_UP_OFFSETS, upOffsets)
+            || !reader.attachSection(SECTION_HIERARCHY_UP_TARGETS, upTargets)
+            || !reader.attachSection(SECTION_HIERARCHY_UP_WEIGHTS, upWeights)
+            || !reader.attachSection(SECTION_HIERARCHY_UP_MIDDLES, upMiddles)
+            || !reader.attachSection(SECTION_HIERARCHY_DOWN_OFFSETS, downOffsets)
+            || !reader.attachSection(SECTION_HIERARCHY_DOWN_TARGETS, downTargets)
+            || !reader.attachSection(SECTION_HIERARCHY_DOWN_WEIGHTS, downWeights)
+            || !reader.attachSection(SECTION_HIERARCHY_DOWN_MIDDLES, downMiddles)) {
+        clear();
+        return false;
+    }
+
+    bool valid = ranks.size() == expectedNodeCount
+              && upOffsets.size() == expectedNodeCount + 1 && downOffsets.size() == expectedNodeCount + 1
+              && upWeights.size() == upTargets.size() && upMiddles.size() == upTargets.size()
+              && downWeights.size() == downTargets.size() && downMiddles.size() == downTargets.size()
+              && upOffsets[0] == 0 && upOffsets[expectedNodeCount] == upTargets.size()
+              && downOffsets[0] == 0 && downOffsets[expectedNodeCount] == downTargets.size();
+    for(uint32_t node = 0; valid && node < expectedNodeCount; ++node) {
+        valid = ranks[node] < expectedNodeCount && upOffsets[node] <= upOffsets[node + 1]
+             && downOffsets[node] <= downOffsets[node + 1];
+    }
+    for(uint32_t node = 0; valid && node < expectedNodeCount; ++node) {
+        for(uint32_t arc = upOffsets[node]; valid && arc < upOffsets[node + 1]; ++arc) {
+            valid = upTargets[arc] < expectedNodeCount && ranks[upTargets[arc]] > ranks[node]
+                 && (upMiddles[arc] == NO_MIDDLE || (upMiddles[arc] < expectedNodeCount && ranks[upMiddles[arc]] < ranks[node]));
+        }
+        for(uint32_t arc = downOffsets[node]; valid && arc < downOffsets[node + 1]; ++arc) {
+            valid = downTargets[arc] < expectedNodeCount && ranks[downTargets[arc]] > ranks[node]
+                 && (downMiddles[arc] == NO_MIDDLE || (downMiddles[arc] < expectedNodeCount && ranks[downMiddles[arc]] < ranks[node]));
+        }
+    }
+    if(!valid)
+        clear();
+    return valid;
+}
+
+void ContractionHierarchy::clear() {
+    ranks.clear();
+    upOffsets.clear();
+    upTargets.clear();
+    upWeights.clear();
+    upMiddles.clear();
+    downOffsets.clear();
+    downTargets.clear();
+    downWeights.clear();
+    downMiddles.clear();
+}
+
+size_t ContractionHierarchy::shortcutCount() const {
+    size_t count = 0;
+    for(size_t arc = 0; arc < upMiddles.size(); ++arc)
+        count += upMiddles[arc] != NO_MIDDLE;
+    for(size_t arc = 0; arc < downMiddles.size(); ++arc)
+        count += downMiddles[arc] != NO_MIDDLE;
+    return count;
+}
+
+// Looks up the hierarchy arc "from" -> "to", which is stored with whichever end has the lower rank
+bool ContractionHierarchy::findArc(uint32_t from, uint32_t to, double &weight, uint32_t &middle) const {
+    if(ranks[from] < ranks[to]) {
+        for(uint32_t arc = upOffsets[from]; arc < upOffsets[from + 1]; ++arc) {
+            if(upTargets[arc] == to) {
+                weight = upWeights[arc];
+                middle = upMiddles[arc];
+                return true;
+            }
+        }
+    }
+    else {
+        for(uint32_t arc = downOffsets[to]; arc < downOffsets[to + 1]; ++arc) {
+            if(downTargets[arc] == from) {
+                weight = downWeights[arc];
+                middle = downMiddles[arc];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// A shortcut "from" -> "to" skipping "middle" is the arcs "from" -> "middle" and "middle" -> "to",
+// and both of those are stored with "middle", since it was contracted before either end
+void ContractionHierarchy::unpack(uint32_t from, uint32_t to, vector<pair<uint32_t, double>> &path) const {
+    double weight;
+    uint32_t middle;
+    if(!findArc(from, to, weight, middle))
+        return;
+    if(middle == NO_MIDDLE) {
+        path.push_back(make_pair(to, weight));
+        return;
+    }
+    unpack(from, middle, path);
+    unpack(middle, to, path);
+}
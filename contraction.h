@@ -0,0 +1,67 @@
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <cstddef>
+#include "flatarray.h"
+#include "snapshot.h"
+#include "routegraph.h"
+
+#ifndef CONTRACTION_H
+#define CONTRACTION_H
+
+// Contraction Hierarchy over a RouteGraph for fast point-to-point queries
+// Airports are contracted one at a time in order of importance (their rank), adding shortcut
+// routes wherever a shortest path passed through the contracted airport
+// Queries then only ever move to higher ranked airports, from both ends of the trip
+// Arcs are stored in two CSR arrays:
+//  - "up" arcs of airport "u" lead to higher ranked airports (u -> v)
+//  - "down" arcs of airport "v" come from higher ranked airports (u -> v), stored with target u
+// A shortcut remembers the airport it skipped ("middle"), so it can be unpacked into real routes
+class ContractionHierarchy {
+
+public:
+
+    static constexpr uint32_t NO_MIDDLE = UINT32_MAX;
+
+    ContractionHierarchy();
+
+    void build(const RouteGraph &graph);
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader, size_t expectedNodeCount);
+    void clear();
+
+    bool isBuilt() const { return !ranks.empty(); }
+    size_t nodeCount() const { return ranks.size(); }
+    size_t shortcutCount() const;
+    uint32_t rank(uint32_t node) const { return ranks[node]; }
+
+    uint32_t upBegin(uint32_t node) const { return upOffsets[node]; }
+    uint32_t upEnd(uint32_t node) const { return upOffsets[node + 1]; }
+    uint32_t downBegin(uint32_t node) const { return downOffsets[node]; }
+    uint32_t downEnd(uint32_t node) const { return downOffsets[node + 1]; }
+    uint32_t upTarget(uint32_t arc) const { return upTargets[arc]; }
+    double upWeight(uint32_t arc) const { return upWeights[arc]; }
+    uint32_t downTarget(uint32_t arc) const { return downTargets[arc]; }
+    double downWeight(uint32_t arc) const { return downWeights[arc]; }
+
+    // Appends the real routes of the hierarchy arc "from" -> "to" to "path" as (airport, route length)
+    // The "from" airport itself is not appended
+    void unpack(uint32_t from, uint32_t to, std::vector<std::pair<uint32_t, double>> &path) const;
+
+
+private:
+
+    FlatArray<uint32_t> ranks;
+    FlatArray<uint32_t> upOffsets;
+    FlatArray<uint32_t> upTargets;
+    FlatArray<double> upWeights;
+    FlatArray<uint32_t> upMiddles;
+    FlatArray<uint32_t> downOffsets;
+    FlatArray<uint32_t> downTargets;
+    FlatArray<double> downWeights;
+    FlatArray<uint32_t> downMiddles;
+
+    bool findArc(uint32_t from, uint32_t to, double &weight, uint32_t &middle) const;
+};
+
+#endif // CONTRACTION_H
@@ -1,369 +1,1683 @@
-#include "controller.h"
-
-using namespace std;
-
-/// CONSTRUCTOR & INITIALIZATION FUNCTIONS
-///
-
-Controller::Controller(const string &airportFile, const string &airlineFile, const string &routeFile) {
-    this->airportFile = airportFile;
-    this->airlineFile = airlineFile;
-    this->routeFile = routeFile;
-    constructMaps();
-}
-
-Controller::~Controller() {
-    deleteAll();
-}
-
-Controller::Controller(const Controller &other) {
-    copy(other);
-}
-
-Controller &Controller::operator=(const Controller &other) {
-    if(this != &other) {
-        deleteAll();
-        copy(other);
-    }
-    return *this;
-}
-
-// Processes CSV data files and generates four maps used for lookup for the information
-void Controller::constructMaps() {
-    makeIdToNameMap(); // Map for airline id to airline name
-    makeAirportMap();  // Maps for airport id to airport node, and airport IATA to airport id
-    makeRouteMap();    // Maps for airport id to vector of all connecting edges
-}
-
-/// PUBLIC FUNCTIONS
-///
-
-// Traverses the graph (adjacency list provided by "routeMap") and uses the Dijkstra's algorithm
-// to find the shortest path using avaliable flights between airports.
-// Returns a deque containing airport id's in the path, which should be traversed
-// from front to back to be in order
-std::vector<std::string> Controller::getShortestPath(const std::string &start, const std::string &end) {
-
-    if(!nameToIdMap.count(start))
-        throw START_NOT_FOUND;
-
-    if(!nameToIdMap.count(end))
-        throw END_NOT_FOUND;
-
-    if(start == end)
-        throw START_END_SAME;
-
-    int startId = nameToIdMap[start];
-    int endId = nameToIdMap[end];
-
-    priority_queue<pair<double, edge>> pq;
-    unordered_set<int> processed;
-    unordered_map<int, int> parentOfId;
-
-    // Gets vector with all connecting routes with an airport
-    vector<edge> connectingEdges = routeMap[startId];
-    processed.insert(startId);
-
-    // Starts initial case of shortest path algorithm
-    for(size_t i = 0; i < connectingEdges.size(); ++i) {
-        pq.push(pair<double, edge>(-1 * connectingEdges[i].distance, connectingEdges[i]));
-    }
-
-    int nextId = -1;
-    double nextDistance;
-
-    // Loops through until shortest path found or no possible route
-    while(!pq.empty() && nextId != endId) {
-
-        nextDistance = pq.top().first;
-        nextId = pq.top().second.destId;
-        edge temp = pq.top().second;
-        pq.pop();
-
-        if(processed.find(nextId) == processed.end()) {
-            parentOfId.insert(pair<int, int>(temp.destId, temp.sourceId));
-            connectingEdges = routeMap[nextId];
-            for(size_t i = 0; i < connectingEdges.size(); ++i) {
-                pq.push(pair<double, edge>(-1*connectingEdges[i].distance + nextDistance, connectingEdges[i]));
-            }
-            processed.insert(nextId);
-        }
-    }
-
-    // Throws error if no possible routes between airports
-    // due to closed airports or private/non-commercial airports
-    if(pq.empty() && nextId != endId)
-        throw NO_ROUTE_FOUND;
-
-    // Puts resulting path by traversing parents in deque to ease reversing results
-    deque<int> path;
-    int parent = endId;
-    while(parent != startId) {
-        path.push_front(parent);
-        parent = parentOfId[parent];
-    }
-    path.push_front(parent);
-
-    // Creates the string itinerary to be returned
-    vector<string> itinerary;
-    makeItinerary(path, itinerary);
-    return itinerary;
-}
-
-// Takes an output file name and generates an XML file
-// containing all verticies (airports) and edges (routes)
-void Controller::writeCSVToXML(const string &outputFile) {
-
-    if(outputFile.length() < 5 || outputFile.substr(outputFile.length() - 4) != ".xml")
-        throw INVALID_FILENAME;
-
-    ofstream fout;
-    fout.open(outputFile.c_str());
-    fout << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
-    for(auto elem : airportMap) {
-        fout << "<vertex>" << endl;
-        fout << "\t<id>" << elem.second.id << "</id>" << endl;
-        fout << "\t<name>" << elem.second.name << "</name>" << endl;
-        fout << "\t<city>" << elem.second.city << "</city>" << endl;
-        fout << "\t<latitude>" << elem.second.latitude << "</latitude>" << endl;
-        fout << "\t<longitude>" << elem.second.longitude << "</longitude>" << endl;
-        fout << "\t<edges>" << endl;
-        if (routeMap.count(elem.first) != 0) {
-            for(size_t i = 0 ; i < routeMap.at(elem.first).size(); ++i) {
-                fout << "\t\t<edge>" << endl;
-                fout << "\t\t\t<airportID>" << routeMap[elem.first][i].destId << "</airportID>" << endl;
-                fout << "\t\t\t<airportCode>" << routeMap[elem.first][i].airportCode << "</airportCode>" << endl;
-                fout << "\t\t\t<carrierID>" << routeMap[elem.first][i].carrierId << "</carrierID>" << endl;
-                fout << "\t\t\t<carrierName>" << routeMap[elem.first][i].carrierName << "</carrierName>" << endl;
-                fout << "\t\t\t<distance>" << routeMap[elem.first][i].distance << "</distance>" << endl;
-                fout << "\t\t</edge>" << endl;
-            }
-        }
-        fout << "\t</edges>" << endl;
-        fout << "</vertex>" << endl;
-    }
-}
-
-// Finds all edges (airlines) between two certain nodes (airports)
-// Warning: Does not check for existance in map so must already be validated
-std::vector<edge> Controller::findEdgesBetweenNodes(const int &aId, const int &bId) {
-    std::vector<edge> allConnectingEdges = routeMap[aId];
-    std::vector<edge> correspondingEdges;
-    for(size_t i = 0; i < allConnectingEdges.size(); ++i) {
-        if(allConnectingEdges[i].destId == bId) {
-            correspondingEdges.push_back(allConnectingEdges[i]);
-        }
-    }
-    return correspondingEdges;
-}
-
-// Generates a hash table where key: (airline id) and value: (airline name)
-// Can be used to convert an airline id to its name (string)
-void Controller::makeIdToNameMap() {
-    ifstream infile(airlineFile.c_str());
-    string line;
-
-    // Seperates each line into vectors, and puts needed values in map
-    while(getline(infile, line)) {
-        vector<string> lines = parseCSVLine(line);
-        airlineNames.insert(pair<int, string>(atoi(lines[0].c_str()), lines[1]));
-    }
-    infile.close();
-}
-
-// Generates hash table with where key: (airport id) and value: (connecting edges)
-// Can be used to get a vector of all routes (edges) avaliable at an airport
-void Controller::makeRouteMap() {
-    ifstream infile(routeFile.c_str());
-    string line;
-
-    // Seperates each line into vectors, and puts needed values in map
-    while(getline(infile, line)) {
-        vector<string> lines = parseCSVLine(line);
-
-        int sourceId = atoi(lines[SOURCE_AIRPORT_ID].c_str());
-        int destinationId = atoi(lines[DESTINATION_AIRPORT_ID].c_str());
-
-        // Adds entry to routeMap if both source and destination exists
-        if(airportMap.count(sourceId) && airportMap.count(destinationId)) {
-            edge route;
-
-            // Adds new hash entry if previous does not exist
-            if(!routeMap.count(sourceId)) {
-                routeMap.insert(pair<int, vector<edge>>(sourceId, vector<edge>()));
-            }
-
-            route.destId = destinationId;
-            route.sourceId = sourceId;
-            route.airportCode = lines[DESTINATION_AIRPORT_IATA];
-            route.carrierId = atoi(lines[CARRIER_ID].c_str());
-
-            // Checks if airport exists (if id != /n)
-            if(airlineNames.count(route.carrierId))
-                route.carrierName = airlineNames.at(route.carrierId);
-            else
-                route.carrierName = "Unknown Carrier";
-
-            // Calculates distance using lat and longitudes of source and destination
-            double sourceLat = airportMap.at(sourceId).latitude;
-            double sourceLon = airportMap.at(sourceId).longitude;
-            double destLat = airportMap.at(destinationId).latitude;
-            double destLon = airportMap.at(destinationId).longitude;
-            route.distance = getDistance(sourceLat, sourceLon, destLat, destLon);
-
-            // Pushes new route into route vector
-            routeMap[sourceId].push_back(route);
-        }
-    }
-    infile.close();
-}
-
-// Creates a map where key: (id) and value: (node)
-// As such, it can be used to retrieve info about an airport using the id as a lookup
-// Also makes second hashtable key: (IATA) and value: (id) to translate user input
-void Controller::makeAirportMap() {
-    ifstream infile(airportFile.c_str());
-    string line;
-
-    // Seperates each line into vectors, and puts needed values in map
-    while(getline(infile, line)) {
-        vector<string> lines = parseCSVLine(line);
-        node airport;
-        airport.id = atoi(lines[AIRPORT_ID].c_str());
-        airport.latitude = atof(lines[AIRPORT_LATITUDE].c_str());
-        airport.longitude = atof(lines[AIRPORT_LONGITUDE].c_str());
-        airport.code = lines[AIRPORT_IATA];
-        airport.name = lines[AIRPORT_NAME];
-        airport.city = lines[AIRPORT_CITY];
-        airportMap.insert(pair<int, node>(airport.id, airport));
-        nameToIdMap.insert(pair<string, int>(airport.code, airport.id));
-    }
-    infile.close();
-}
-
-// Creates a vector of string, with the directions/itinerary in order
-// For example: [0] : "Start from Starting Airport"
-// [1] : "Fly to Other Airport for x miles using\n
-//           - Airline 1
-//           - Airline 2...
-// [2] : Arrive at Ending Airport
-void Controller::makeItinerary(std::deque<int> &path, std::vector<std::string> &itinerary) {
-    string buildStr;
-    int previousCode = path.front();
-    buildStr = "Start from " + airportMap[previousCode].code + " (" + airportMap[previousCode].name + ")";
-    itinerary.push_back(buildStr);
-    path.pop_front();
-
-    // Creates text for all flights in between the start and end
-    // Input varies on whether there are multiple airlines or just one
-    while(path.size() != 0) {
-        vector<edge> connectingRoutes = findEdgesBetweenNodes(previousCode, path.front());
-        buildStr = "Fly to " + airportMap[path.front()].code + " (" + airportMap[path.front()].name
-                 + ") over " + to_string((int)connectingRoutes[0].distance) + " miles using";
-
-        // Either lists airlines or uses one
-        if(connectingRoutes.size() == 1) {
-            buildStr += " " + connectingRoutes[0].carrierName;
-        }
-        else {
-            buildStr += " one of the following:";
-            for(size_t i = 0; i < connectingRoutes.size(); ++i) {
-                buildStr += "\n  - " + connectingRoutes[i].carrierName;
-            }
-        }
-        itinerary.push_back(buildStr);
-        previousCode = path.front();
-
-        // Final arrival message when on the last entry
-        if(path.size() == 1) {
-            buildStr = "Arrive at " + airportMap[path.front()].code + " (" + airportMap[path.front()].name + ")";
-            itinerary.push_back(buildStr);
-        }
-        path.pop_front();
-    }
-}
-
-/// HELPER FUNCTIONS
-///
-
-// Takes single CSV line and seperates values in vector
-// Also sanitizes quotation marks from output vector
-// Input example: " item1, "item2", ... "
-// Output example: vector([0]: item1, [1]: item2, [2]: ...)
-vector<string> Controller::parseCSVLine(const string &line) {
-    char current;
-    bool isQuote = false;
-    string builtStr = "";
-    vector<string> outputStrings;
-
-    // Cycle through all characters
-    for(size_t i = 0; i < line.size(); ++i) {
-        current = line[i];
-
-        // Pushes string into vector when comma found
-        if(!isQuote) {
-            if(current == ',') {
-                outputStrings.push_back(builtStr);
-                builtStr = string();
-            }
-            else if(current == '"')
-                isQuote = true;
-            else
-                builtStr += current;
-        }
-
-        // Checks for matching quotation marks and removes from output
-        else {
-            if(current == '"' && i+1 < line.size()) {
-                if(line[i+1] == '"') {
-                    builtStr += '"';
-                    ++i;
-                }
-                else
-                    isQuote = false;
-            }
-            else
-                builtStr += current;
-        }
-    }
-    return outputStrings;
-}
-
-// Helper function : Converts degress to radians
-double Controller::toRadian(const double &degree) {
-    return degree * M_PI / 180.0;
-}
-
-// Helper function : Calculates distance (miles) between two points on Earth
-double Controller::getDistance(double latitude1, double longitude1, double latitude2, double longitude2) {
-    double lat1 = toRadian(latitude1);
-    double lon1 = toRadian(longitude1);
-    double lat2 = toRadian(latitude2);
-    double lon2 = toRadian(longitude2);
-    double deltaLat = abs(lat1 - lat2);
-    double deltaLon = abs(lon1 - lon2);
-    double a = pow(sin(deltaLat/2), 2) + (cos(lat1)*cos(lat2)*pow(sin(deltaLon/2), 2));
-    double c = 2 * asin(sqrt(a));
-    const int EARTH_RADIUS = 3959;
-    return EARTH_RADIUS * c;
-}
-
-void Controller::copy(const Controller &other) {
-    airportFile = other.airportFile;
-    airlineFile = other.airlineFile;
-    routeFile = other.routeFile;
-    airlineNames = other.airlineNames;
-    routeMap = other.routeMap;
-    nameToIdMap = other.nameToIdMap;
-    airportMap = other.airportMap;
-}
-
-void Controller::deleteAll() {
-    airportFile = string();
-    airlineFile = string();
-    routeFile = string();
-    airlineNames.clear();
-    routeMap.clear();
-    nameToIdMap.clear();
-    airportMap.clear();
-}
+#include "controller.h"
+
+using namespace std;
+
+// Smallest piece of a data file handed to one parsing thread
+const size_t CSV_CHUNK_SIZE = 256 * 1024;
+
+// Default number of itineraries and of shortest path trees kept by the query caches
+const size_t DEFAULT_ITINERARY_CACHE_CAPACITY = 4096;
+const size_t DEFAULT_TREE_CACHE_CAPACITY = 64;
+
+// Distance matrix rows computed before they are written out, which bounds the memory used
+const size_t MATRIX_ROWS_PER_THREAD = 16;
+const char MATRIX_MAGIC[8] = {'F', 'P', 'M', 'A', 'T', 'R', 'I', 'X'};
+const uint32_t MATRIX_VERSION = 1;
+
+// Milliseconds since "lapStart", which then moves on to now
+static double lapMilliseconds(chrono::steady_clock::time_point &lapStart) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double milliseconds = chrono::duration<double, milli>(now - lapStart).count();
+    lapStart = now;
+    return milliseconds;
+}
+
+// One airport of each component (see ReachabilityIndex) the airports of "endpoints" fall in
+static vector<uint32_t> componentRepresentatives(const ReachabilityIndex &reachability, const vector<searchEndpoint> &endpoints) {
+    vector<pair<uint32_t, uint32_t>> components;
+    for(size_t i = 0; i < endpoints.size(); ++i)
+        components.push_back(make_pair(reachability.component(endpoints[i].airport), endpoints[i].airport));
+    sort(components.begin(), components.end());
+    vector<uint32_t> representatives;
+    for(size_t i = 0; i < components.size(); ++i) {
+        if(i == 0 || components[i].first != components[i - 1].first)
+            representatives.push_back(components[i].second);
+    }
+    return representatives;
+}
+
+// True if any airport of "sources" reaches any airport of "targets", testing each pair of components once
+static bool isAnyReachable(const ReachabilityIndex &reachability, const vector<searchEndpoint> &sources,
+                           const vector<searchEndpoint> &targets) {
+    vector<uint32_t> from = componentRepresentatives(reachability, sources);
+    vector<uint32_t> to = componentRepresentatives(reachability, targets);
+    for(size_t i = 0; i < from.size(); ++i) {
+        for(size_t j = 0; j < to.size(); ++j) {
+            if(reachability.reaches(from[i], to[j]))
+                return true;
+        }
+    }
+    return false;
+}
+
+/// CONSTRUCTOR & INITIALIZATION FUNCTIONS
+///
+
+Controller::Controller(const string &airportFile, const string &airlineFile, const string &routeFile)
+    : store(make_shared<graphStore>()), searchAlgorithm(DIJKSTRA_INDEXED_HEAP) {
+    store->airportFile = airportFile;
+    store->airlineFile = airlineFile;
+    store->routeFile = routeFile;
+    store->itineraryCacheCapacity = DEFAULT_ITINERARY_CACHE_CAPACITY;
+    store->treeCacheCapacity = DEFAULT_TREE_CACHE_CAPACITY;
+    shared_ptr<graphVersion> loaded = loadGraph();
+    loaded->number = 0;
+    publishGraph(loaded);
+}
+
+// Loads the tables straight from a compiled snapshot when it is valid and up to date
+// Falls back to parsing the CSV files if the snapshot is missing, stale or corrupt
+Controller::Controller(const string &snapshotFile, const string &airportFile, const string &airlineFile, const string &routeFile)
+    : store(make_shared<graphStore>()), searchAlgorithm(DIJKSTRA_INDEXED_HEAP) {
+    store->snapshotFile = snapshotFile;
+    store->airportFile = airportFile;
+    store->airlineFile = airlineFile;
+    store->routeFile = routeFile;
+    store->itineraryCacheCapacity = DEFAULT_ITINERARY_CACHE_CAPACITY;
+    store->treeCacheCapacity = DEFAULT_TREE_CACHE_CAPACITY;
+    shared_ptr<graphVersion> loaded = loadGraph();
+    loaded->number = 0;
+    publishGraph(loaded);
+}
+
+Controller::~Controller() {
+    deleteAll();
+}
+
+Controller::Controller(const Controller &other) {
+    copy(other);
+}
+
+// Takes over the other handle, which is left without a graph and may only be destroyed or assigned to
+Controller::Controller(Controller &&other) noexcept
+    : store(move(other.store)), searchAlgorithm(other.searchAlgorithm), totals(move(other.totals)) {
+}
+
+Controller &Controller::operator=(const Controller &other) {
+    if(this != &other) {
+        deleteAll();
+        copy(other);
+    }
+    return *this;
+}
+
+Controller &Controller::operator=(Controller &&other) noexcept {
+    if(this != &other) {
+        store = move(other.store);
+        searchAlgorithm = other.searchAlgorithm;
+        totals = move(other.totals);
+    }
+    return *this;
+}
+
+// Returns the version queries should use, which stays valid for as long as the caller holds it
+shared_ptr<const Controller::graphVersion> Controller::currentGraph() const {
+    return atomic_load(&store->graph);
+}
+
+// Makes "version" the one new queries see, through every copy of this Controller;
+// queries already running keep the version they hold
+void Controller::publishGraph(const shared_ptr<const graphVersion> &version) {
+    atomic_store(&store->graph, version);
+}
+
+// Returns the pool batch queries, the distance matrix and exports run on, creating it on first use
+// Callers hold on to it while they run, so setWorkerThreads can replace it meanwhile
+shared_ptr<ThreadPool> Controller::getWorkerPool() const {
+    lock_guard<mutex> lock(store->poolMutex);
+    if(store->workerPool == nullptr)
+        store->workerPool = make_shared<ThreadPool>(thread::hardware_concurrency());
+    return store->workerPool;
+}
+
+// Reads the graph from the snapshot the Controller was created with, or from the data files
+// if there is no snapshot or it can not be used, into a new version with empty caches
+shared_ptr<Controller::graphVersion> Controller::loadGraph() {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    shared_ptr<graphVersion> version = make_shared<graphVersion>();
+    version->load = loadStats();
+    if(store->snapshotFile.empty() || !loadSnapshot(store->snapshotFile, *version))
+        constructMaps(*version);
+    else {
+        chrono::steady_clock::time_point lap = begin;
+        version->load.snapshotMs = lapMilliseconds(lap);
+    }
+    version->load.airlines.records = version->carriers->size();
+    version->load.airports.records = version->airports->size();
+    version->load.routes.records = version->routeGraph->edgeCount();
+    version->load.totalMs = lapMilliseconds(begin);
+    version->caches = make_shared<queryCaches>(store->itineraryCacheCapacity, store->treeCacheCapacity);
+    return version;
+}
+
+// Processes CSV data files and generates the lookup tables and route graph used for the queries
+// Each step is timed, and its line counts kept, in the version's load statistics
+void Controller::constructMaps(graphVersion &version) {
+    shared_ptr<CarrierTable> carriers = make_shared<CarrierTable>();
+    shared_ptr<AirportTable> airports = make_shared<AirportTable>();
+    shared_ptr<RouteGraph> routeGraph = make_shared<RouteGraph>();
+    shared_ptr<CarrierGraph> carrierGraph = make_shared<CarrierGraph>();
+    shared_ptr<ReachabilityIndex> reachability = make_shared<ReachabilityIndex>();
+    loadStats &load = version.load;
+    chrono::steady_clock::time_point lap = chrono::steady_clock::now();
+    load.airlines.lines = makeIdToNameMap(*carriers);           // Table for airline id to airline name
+    load.airlines.ms = lapMilliseconds(lap);
+    load.airports.lines = makeAirportMap(*airports);            // Table of airports by dense index, searchable by IATA or ICAO code and id
+    load.airports.ms = lapMilliseconds(lap);
+    load.routes.lines = makeRouteMap(*airports, *routeGraph);   // CSR graph of all connecting edges by dense airport index
+    load.routes.ms = lapMilliseconds(lap);
+    carrierGraph->build(*routeGraph);
+    reachability->build(*routeGraph);
+
+    version.snapshot.reset();
+    version.carriers = carriers;
+    version.airports = airports;
+    version.routeGraph = routeGraph;
+    version.reverseGraph = make_shared<RouteGraph>(routeGraph->reversed());
+    version.carrierGraph = carrierGraph;
+    version.reachability = reachability;
+    version.hierarchy.reset();
+    load.derivedMs = lapMilliseconds(lap);
+}
+
+// Maps the snapshot file and points every table at its sections, without copying them
+// Returns false (leaving "version" untouched) if the file can not be used
+bool Controller::loadSnapshot(const string &snapshotFile, graphVersion &version) {
+    shared_ptr<MappedFile> mapped = make_shared<MappedFile>(snapshotFile);
+    if(!mapped->isOpen())
+        return false;
+
+    SnapshotReader reader(mapped->data(), mapped->size());
+    vector<string> sourceFiles = {store->airportFile, store->airlineFile, store->routeFile};
+    if(!reader.isValid() || reader.isStale(sourceFiles))
+        return false;
+
+    shared_ptr<CarrierTable> carriers = make_shared<CarrierTable>();
+    shared_ptr<AirportTable> airports = make_shared<AirportTable>();
+    shared_ptr<RouteGraph> routeGraph = make_shared<RouteGraph>();
+    if(!carriers->read(reader) || !airports->read(reader) || !routeGraph->read(reader)
+            || routeGraph->nodeCount() != airports->size())
+        return false;
+
+    // The hierarchy is optional, snapshots compiled without one just leave it to be built on demand
+    shared_ptr<ContractionHierarchy> hierarchy = make_shared<ContractionHierarchy>();
+    shared_ptr<RouteGraph> reverseGraph = make_shared<RouteGraph>();
+    shared_ptr<CarrierGraph> carrierGraph = make_shared<CarrierGraph>();
+    shared_ptr<ReachabilityIndex> reachability = make_shared<ReachabilityIndex>();
+    if(!reverseGraph->read(reader, SECTION_REVERSE_OFFSETS) || reverseGraph->nodeCount() != routeGraph->nodeCount())
+        *reverseGraph = routeGraph->reversed();
+    if(!carrierGraph->read(reader, routeGraph->nodeCount()))
+        carrierGraph->build(*routeGraph);
+    if(!reachability->read(reader, routeGraph->nodeCount()))
+        reachability->build(*routeGraph);
+
+    version.snapshot = mapped;
+    version.carriers = carriers;
+    version.airports = airports;
+    version.routeGraph = routeGraph;
+    version.reverseGraph = reverseGraph;
+    version.carrierGraph = carrierGraph;
+    version.reachability = reachability;
+    if(hierarchy->read(reader, routeGraph->nodeCount()))
+        version.hierarchy = hierarchy;
+    else
+        version.hierarchy.reset();
+    return true;
+}
+
+/// PUBLIC FUNCTIONS
+///
+
+// Serializes the loaded tables and route graph into a binary snapshot file
+// that a later Controller can map instead of re-parsing the CSV files
+// The derived graphs are stored too, and so is the contraction hierarchy if it has been built
+// Applied deltas are part of the graph written, even though the snapshot is stamped with the data files
+void Controller::compile(const string &snapshotFile) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    SnapshotWriter writer;
+    version->carriers->write(writer);
+    version->airports->write(writer);
+    version->routeGraph->write(writer);
+    version->reverseGraph->write(writer, SECTION_REVERSE_OFFSETS);
+    version->carrierGraph->write(writer);
+    version->reachability->write(writer);
+    if(version->hierarchy != nullptr)
+        version->hierarchy->write(writer);
+    if(!writer.save(snapshotFile, {store->airportFile, store->airlineFile, store->routeFile}))
+        throw SNAPSHOT_NOT_WRITTEN;
+}
+
+// Reads the graph again from the data files, or from the snapshot the Controller was created with
+// Applied deltas are dropped, and the new version starts with empty caches
+void Controller::reload() {
+    lock_guard<mutex> lock(store->updateMutex);
+    shared_ptr<graphVersion> loaded = loadGraph();
+    loaded->number = currentGraph()->number + 1;
+    if(searchAlgorithm == CONTRACTION_HIERARCHY && loaded->hierarchy == nullptr) {
+        shared_ptr<ContractionHierarchy> hierarchy = make_shared<ContractionHierarchy>();
+        hierarchy->build(*loaded->routeGraph);
+        loaded->hierarchy = hierarchy;
+    }
+    publishGraph(loaded);
+}
+
+// Applies a delta file of airport and route changes (see readDelta) as a new version of the graph,
+// which every query started from then on sees; queries already running finish on their version
+// Only the changed airports and routes are parsed, measured and indexed. The graph arrays are copied
+// with the changes spliced in, tables the delta leaves alone are shared, and cached results the delta
+// can not have changed are carried over. If any route changed, the contraction hierarchy is dropped,
+// and the reachability index is rebuilt unless the changes can not alter it (see isKeptBy)
+// Throws DELTA_NOT_READ if the file can not be read
+deltaCounts Controller::applyDelta(const string &deltaFile) {
+    lock_guard<mutex> lock(store->updateMutex);
+    shared_ptr<const graphVersion> previous = currentGraph();
+    deltaCounts counts = deltaCounts();
+    graphDelta delta;
+    readDelta(*previous, deltaFile, delta, counts);
+
+    shared_ptr<graphVersion> updated = make_shared<graphVersion>(*previous);
+    updated->number = previous->number + 1;
+    if(!delta.changedAirports.empty() || !delta.addedAirports.empty())
+        updated->airports = make_shared<AirportTable>(previous->airports->withChanges(delta.changedAirports, delta.addedAirports));
+    resolveRoutes(*previous, *updated->airports, delta, counts);
+
+    if(!delta.addedAirports.empty() || !delta.removedRoutes.empty() || !delta.addedRoutes.empty()) {
+        vector<routeEntry> reverseRemoved(delta.removedRoutes);
+        vector<routeEntry> reverseAdded(delta.addedRoutes);
+        vector<uint32_t> changedSources;
+        for(size_t i = 0; i < reverseRemoved.size(); ++i) {
+            changedSources.push_back(reverseRemoved[i].source);
+            swap(reverseRemoved[i].source, reverseRemoved[i].target);
+        }
+        for(size_t i = 0; i < reverseAdded.size(); ++i) {
+            changedSources.push_back(reverseAdded[i].source);
+            swap(reverseAdded[i].source, reverseAdded[i].target);
+        }
+
+        size_t airportCount = updated->airports->size();
+        updated->routeGraph = make_shared<RouteGraph>(
+            previous->routeGraph->withChanges(airportCount, delta.removedRoutes, delta.addedRoutes));
+        updated->reverseGraph = make_shared<RouteGraph>(
+            previous->reverseGraph->withChanges(airportCount, reverseRemoved, reverseAdded));
+        updated->carrierGraph = make_shared<CarrierGraph>(
+            previous->carrierGraph->withChanges(*updated->routeGraph, changedSources));
+        if(!previous->reachability->isKeptBy(*updated->routeGraph, *updated->reverseGraph,
+                                             delta.removedRoutes, delta.addedRoutes)) {
+            shared_ptr<ReachabilityIndex> reachability = make_shared<ReachabilityIndex>();
+            reachability->build(*updated->routeGraph);
+            updated->reachability = reachability;
+        }
+        updated->hierarchy.reset();
+    }
+
+    carryOverCaches(*previous, *updated, delta);
+    publishGraph(updated);
+
+    logLoadCounts(deltaFile, counts.lines);
+    counts.version = updated->number;
+    counts.airportsAdded = delta.addedAirports.size();
+    counts.airportsChanged = delta.changedAirports.size();
+    return counts;
+}
+
+// Counts the versions the graph went through since the Controller was created
+uint64_t Controller::getGraphVersion() const {
+    return currentGraph()->number;
+}
+
+// Times and counts of the load the current graph descends from, deltas applied since then are not included
+loadStats Controller::getLoadStats() const {
+    return currentGraph()->load;
+}
+
+// Returns true if the tables were mapped from a snapshot rather than parsed from CSV
+bool Controller::isSnapshotLoaded() const {
+    return currentGraph()->snapshot != nullptr;
+}
+
+// Traverses the graph (CSR structure provided by "routeGraph") and uses the Dijkstra's algorithm
+// to find the shortest path using avaliable flights between airports.
+// Returns a vector of strings containing the itinerary of the path, in order
+// Finished results are cached by (start, end) until the graph changes
+// The work the query did is written to "stats" if it is not null
+std::vector<std::string> Controller::getShortestPath(const std::string &start, const std::string &end, queryStats *stats) const {
+    return getItinerary(start, end, stats).format();
+}
+
+// Same search as getShortestPath, returning the flights without formatting them as text
+Itinerary Controller::getItinerary(const std::string &start, const std::string &end, queryStats *stats) const {
+    pathResult result;
+    findCachedPath(start, end, result, stats);
+    return result.itinerary;
+}
+
+// Finds the shortest path between two IATA codes that makes at most "maxLayovers" layovers
+// Throws NO_ROUTE_FOUND when every route between them needs more layovers
+std::vector<std::string> Controller::getShortestPathWithLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const {
+    return getItineraryWithLayovers(start, end, maxLayovers).format();
+}
+
+// Same search as getShortestPathWithLayovers, returning the flights without formatting them as text
+// Only the path for "maxLayovers" is built, unlike getShortestPathsByLayovers
+Itinerary Controller::getItineraryWithLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+    if(!version->reachability->reaches(startIndex, endIndex))
+        throw NO_ROUTE_FOUND;
+
+    thread_local LayoverSearch search;
+    search.run(*version->routeGraph, startIndex, endIndex, maxLayovers);
+    if(!search.isFound(maxLayovers))
+        throw NO_ROUTE_FOUND;
+    return makeItinerary(*version, search.pathTo(maxLayovers));
+}
+
+// Finds the shortest path between two IATA codes using only the airlines "filter" allows
+// Legs of the itinerary only list the allowed airlines
+std::vector<std::string> Controller::getShortestPath(const std::string &start, const std::string &end, const carrierFilter &filter,
+                                                     queryStats *stats) const {
+    return getItinerary(start, end, filter, stats).format();
+}
+
+// Same search as the filtered getShortestPath, returning the flights without formatting them as text
+Itinerary Controller::getItinerary(const std::string &start, const std::string &end, const carrierFilter &filter,
+                                   queryStats *stats) const {
+    pathResult result;
+    findRestrictedPath(start, end, filter, result, stats);
+    return result.itinerary;
+}
+
+// Finds the shortest way from any airport of "origins" to any airport of "destinations", counting the
+// ground distance to the first airport and from the last one, with one search from every origin at once
+// Throws START_NOT_FOUND or END_NOT_FOUND when a group names an unknown airport or holds no airport at all,
+// and NO_ROUTE_FOUND when no origin reaches any destination
+groupItinerary Controller::getItinerary(const airportGroup &origins, const airportGroup &destinations, queryStats *stats) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    vector<searchEndpoint> sources, targets;
+    findGroupEndpoints(*version, origins, START_NOT_FOUND, sources);
+    findGroupEndpoints(*version, destinations, END_NOT_FOUND, targets);
+
+    groupItinerary result;
+    findGroupPath(*version, sources, targets, result, stats);
+    return result;
+}
+
+// Finds the shortest way between two points given in degrees, flying from any airport within "radiusMiles"
+// of the start and to any airport within "radiusMiles" of the end
+// Throws START_NOT_FOUND or END_NOT_FOUND when no airport is that close to a point
+groupItinerary Controller::getItineraryNear(double startLatitude, double startLongitude, double endLatitude, double endLongitude,
+                                            double radiusMiles, queryStats *stats) const {
+    airportGroup origins = {vector<groundLink>(), true, startLatitude, startLongitude, radiusMiles};
+    airportGroup destinations = {vector<groundLink>(), true, endLatitude, endLongitude, radiusMiles};
+    return getItinerary(origins, destinations, stats);
+}
+
+// Lists the "count" airports closest to a latitude/longitude (degrees), closest first
+// Airport indices never change, so getAirportCode reads them even after later deltas
+std::vector<nearbyAirport> Controller::findNearestAirports(double latitude, double longitude, size_t count) const {
+    vector<nearbyAirport> nearby;
+    currentGraph()->airports->locations().nearest(latitude, longitude, count, nearby);
+    return nearby;
+}
+
+// Lists every airport at most "radiusMiles" from a latitude/longitude (degrees), closest first
+std::vector<nearbyAirport> Controller::findAirportsWithin(double latitude, double longitude, double radiusMiles) const {
+    vector<nearbyAirport> nearby;
+    currentGraph()->airports->locations().within(latitude, longitude, radiusMiles, nearby);
+    return nearby;
+}
+
+// Finds up to "k" different itineraries between two IATA codes, shortest first, none visiting an airport twice
+// Itineraries differ in the airports they pass through, each leg lists every airline flying it
+// Throws NO_ROUTE_FOUND if there is no itinerary at all
+std::vector<Itinerary> Controller::getKShortestPaths(const std::string &start, const std::string &end, size_t k) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+    if(k != 0 && !version->reachability->reaches(startIndex, endIndex))
+        throw NO_ROUTE_FOUND;
+
+    thread_local KShortestPathSearch search;
+    search.run(*version->carrierGraph, *version->reverseGraph, startIndex, endIndex, k);
+    if(k != 0 && search.pathCount() == 0)
+        throw NO_ROUTE_FOUND;
+
+    vector<Itinerary> options;
+    for(size_t i = 0; i < search.pathCount(); ++i)
+        options.push_back(makeItinerary(*version, search.path(i)));
+    return options;
+}
+
+// Finds the shortest path for every layover limit from 0 up to "maxLayovers" in one search
+// Entry "i" of the result holds the shortest path with at most "i" layovers, or NO_ROUTE_FOUND
+// Limits past the most layovers a path can take (see LayoverSearch::clampLayovers) get no entry of their own,
+// the last entry answers them all, so the result has at most one entry per airport
+// Invalid airports throw the same errors as getShortestPath
+std::vector<pathResult> Controller::getShortestPathsByLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+
+    thread_local LayoverSearch search;
+    bool isReachable = version->reachability->reaches(startIndex, endIndex);
+    if(isReachable)
+        search.run(*version->routeGraph, startIndex, endIndex, maxLayovers);
+
+    vector<pathResult> results(size_t(LayoverSearch::clampLayovers(version->routeGraph->nodeCount(), maxLayovers)) + 1);
+    for(size_t layovers = 0; layovers < results.size(); ++layovers) {
+        results[layovers].found = isReachable && search.isFound(layovers);
+        results[layovers].error = NO_ROUTE_FOUND;
+        if(results[layovers].found)
+            results[layovers].itinerary = makeItinerary(*version, search.pathTo(layovers));
+    }
+    return results;
+}
+
+// Answers many origin/destination pairs of IATA codes at once, spread over a pool of worker threads
+// Pairs are grouped by origin, so a single search from each origin settles all of its destinations
+// Results come back in the order of "pairs", each with its own error code instead of a thrown error
+std::vector<pathResult> Controller::getShortestPaths(const std::vector<std::pair<std::string, std::string>> &pairs) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    const AirportTable &airports = *version->airports;
+    vector<pathResult> results(pairs.size());
+    vector<uint32_t> startIndices(pairs.size());
+    vector<uint32_t> endIndices(pairs.size());
+    vector<size_t> validPairs;
+
+    // Validates every pair the same way getShortestPath does, pairs without a route never reach a search
+    for(size_t i = 0; i < pairs.size(); ++i) {
+        results[i].found = false;
+        startIndices[i] = airports.findAirport(pairs[i].first);
+        endIndices[i] = airports.findAirport(pairs[i].second);
+        if(startIndices[i] == AirportTable::NOT_FOUND)
+            results[i].error = START_NOT_FOUND;
+        else if(endIndices[i] == AirportTable::NOT_FOUND)
+            results[i].error = END_NOT_FOUND;
+        else if(startIndices[i] == endIndices[i])
+            results[i].error = START_END_SAME;
+        else if(!version->reachability->reaches(startIndices[i], endIndices[i]))
+            results[i].error = NO_ROUTE_FOUND;
+        else
+            validPairs.push_back(i);
+    }
+
+    // Sorts the valid pairs by origin, and marks where each origin's group begins
+    stable_sort(validPairs.begin(), validPairs.end(), [&](size_t a, size_t b) {
+        return startIndices[a] < startIndices[b];
+    });
+    vector<size_t> groupStarts;
+    for(size_t i = 0; i < validPairs.size(); ++i) {
+        if(i == 0 || startIndices[validPairs[i]] != startIndices[validPairs[i - 1]])
+            groupStarts.push_back(i);
+    }
+    groupStarts.push_back(validPairs.size());
+
+    // Each worker reuses its own search scratch arrays for every group it takes, across batches
+    getWorkerPool()->run(groupStarts.size() - 1, [&](size_t group, size_t) {
+        thread_local ShortestPathSearch search;
+        search.setAlgorithm(searchAlgorithm);
+        uint32_t startIndex = startIndices[validPairs[groupStarts[group]]];
+
+        vector<uint32_t> targets;
+        for(size_t i = groupStarts[group]; i < groupStarts[group + 1]; ++i)
+            targets.push_back(endIndices[validPairs[i]]);
+        search.run(getSearchGraphs(*version), startIndex, targets.data(), targets.size());
+
+        for(size_t i = groupStarts[group]; i < groupStarts[group + 1]; ++i) {
+            pathResult &result = results[validPairs[i]];
+            uint32_t endIndex = endIndices[validPairs[i]];
+            if(!search.isSettled(endIndex)) {
+                result.error = NO_ROUTE_FOUND;
+                continue;
+            }
+            result.found = true;
+            result.itinerary = makeItinerary(*version, search.pathTo(endIndex));
+        }
+    });
+
+    return results;
+}
+
+// Settles every airport reachable from the IATA code "origin", instead of stopping at one destination
+// Returns the whole shortest path tree, which getAirportCode can translate back into airports
+pathTree Controller::shortestPathTree(const string &origin) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t originIndex = version->airports->findAirport(origin);
+    if(originIndex == AirportTable::NOT_FOUND)
+        throw START_NOT_FOUND;
+
+    pathTree tree;
+    buildPathTree(*version, originIndex, tree);
+    return tree;
+}
+
+// Fills "tree" with the distances and parents of a search from "originIndex" that settles everything
+// The work of the search goes into "counters" if it is not null
+void Controller::buildPathTree(const graphVersion &version, uint32_t originIndex, pathTree &tree, searchCounters *counters) const {
+    thread_local ShortestPathSearch search;
+    search.setAlgorithm(searchAlgorithm);
+    search.run(getSearchGraphs(version), originIndex, nullptr, 0);
+    if(counters != nullptr)
+        *counters = search.getCounters();
+
+    size_t airportCount = version.airports->size();
+    tree.origin = originIndex;
+    tree.distances.resize(airportCount);
+    tree.parents.resize(airportCount);
+    for(uint32_t index = 0; index < airportCount; ++index) {
+        bool settled = search.isSettled(index);
+        tree.distances[index] = settled ? search.distance(index) : numeric_limits<double>::infinity();
+        tree.parents[index] = settled ? search.parent(index) : ShortestPathSearch::NO_PARENT;
+    }
+}
+
+// Writes the shortest distance from every airport to every other airport, one row per origin
+// Rows are searched and formatted in parallel a batch at a time, and each batch is written
+// in order before the next one starts, so only a few rows per thread are ever held in memory
+void Controller::writeDistanceMatrix(const string &outputFile, matrixFormats format) const {
+    ofstream fout(outputFile.c_str(), ios::binary);
+    if(!fout)
+        throw INVALID_FILENAME;
+
+    shared_ptr<const graphVersion> version = currentGraph();
+    const AirportTable &airports = *version->airports;
+    uint32_t airportCount = airports.size();
+    if(format == MATRIX_BINARY) {
+        fout.write(MATRIX_MAGIC, sizeof(MATRIX_MAGIC));
+        fout.write(reinterpret_cast<const char *>(&MATRIX_VERSION), sizeof(MATRIX_VERSION));
+        fout.write(reinterpret_cast<const char *>(&airportCount), sizeof(airportCount));
+        for(uint32_t index = 0; index < airportCount; ++index) {
+            int32_t id = airports.id(index);
+            fout.write(reinterpret_cast<const char *>(&id), sizeof(id));
+        }
+    }
+    else {
+        fout << "origin";
+        for(uint32_t index = 0; index < airportCount; ++index)
+            fout << ',' << airports.code(index);
+        fout << '\n';
+    }
+
+    shared_ptr<ThreadPool> workerPool = getWorkerPool();
+    vector<string> rows(workerPool->size() * MATRIX_ROWS_PER_THREAD);
+
+    for(uint32_t firstOrigin = 0; firstOrigin < airportCount; firstOrigin += rows.size()) {
+        size_t rowCount = min<size_t>(rows.size(), airportCount - firstOrigin);
+        workerPool->run(rowCount, [&](size_t row, size_t) {
+            thread_local ShortestPathSearch search;
+            search.setAlgorithm(searchAlgorithm);
+            search.run(getSearchGraphs(*version), firstOrigin + row, nullptr, 0);
+            formatMatrixRow(*version, search, firstOrigin + row, format, rows[row]);
+        });
+        for(size_t row = 0; row < rowCount; ++row)
+            fout.write(rows[row].data(), rows[row].size());
+    }
+
+    if(!fout)
+        throw INVALID_FILENAME;
+}
+
+size_t Controller::getAirportCount() const {
+    return currentGraph()->airports->size();
+}
+
+// Returns the IATA code of a dense airport index, as used by pathTree
+string Controller::getAirportCode(uint32_t index) const {
+    return string(currentGraph()->airports->code(index));
+}
+
+// ICAO code of the airport with dense index "index", empty for airports without one
+string Controller::getAirportICAO(uint32_t index) const {
+    return string(currentGraph()->airports->icao(index));
+}
+
+// Tells in constant time whether any sequence of routes leads from one airport code to the other,
+// without searching; throws the same errors as getShortestPath for unusable codes
+bool Controller::canReach(const string &start, const string &end) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+    return version->reachability->reaches(startIndex, endIndex);
+}
+
+// Describes the part of the route network an airport code belongs to
+// Throws START_NOT_FOUND if the code is unknown
+airportReachability Controller::getAirportReachability(const string &code) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t index = version->airports->findAirport(code);
+    if(index == AirportTable::NOT_FOUND)
+        throw START_NOT_FOUND;
+
+    const ReachabilityIndex &reachability = *version->reachability;
+    airportReachability info;
+    info.isRoutable = reachability.hasRoutes(index);
+    info.componentSize = reachability.componentSize(reachability.component(index));
+    info.reachable = reachability.reachableCount(index);
+    return info;
+}
+
+// Sizes of the strongly connected components of the current route graph, and of the index built on them
+reachabilityStats Controller::getReachabilityStats() const {
+    return currentGraph()->reachability->getStats();
+}
+
+// Chooses the strategy used by the searches, to compare their speed
+// Every strategy finds paths of the same length, only the work done to find them differs
+void Controller::setSearchAlgorithm(searchAlgorithms algorithm) {
+    if(algorithm == CONTRACTION_HIERARCHY && currentGraph()->hierarchy == nullptr)
+        buildHierarchy();
+    searchAlgorithm = algorithm;
+}
+
+searchAlgorithms Controller::getSearchAlgorithm() const {
+    return searchAlgorithm;
+}
+
+// Preprocesses the route graph into a contraction hierarchy for the CONTRACTION_HIERARCHY search
+// Takes a few seconds, so it is only done on demand, or once before compiling a snapshot
+// The hierarchy belongs to the current version; updating the graph drops it, and until it is
+// built again, CONTRACTION_HIERARCHY searches run as plain Dijkstra
+void Controller::buildHierarchy() {
+    lock_guard<mutex> lock(store->updateMutex);
+    shared_ptr<const graphVersion> version = currentGraph();
+    shared_ptr<ContractionHierarchy> hierarchy = make_shared<ContractionHierarchy>();
+    hierarchy->build(*version->routeGraph);
+
+    shared_ptr<graphVersion> updated = make_shared<graphVersion>(*version);
+    updated->hierarchy = hierarchy;
+    publishGraph(updated);
+}
+
+// Checks the contraction hierarchy against plain Dijkstra on "pairCount" random pairs of airports
+// A pair fails if the searches disagree on whether it is routable or on its exact distance,
+// or if the unpacked path does not follow real routes adding up to that distance
+// Prints every failing pair and a summary to "out", and returns the number of failures
+size_t Controller::verifyHierarchy(size_t pairCount, unsigned seed, ostream &out) {
+    if(currentGraph()->hierarchy == nullptr)
+        buildHierarchy();
+    shared_ptr<const graphVersion> version = currentGraph();
+    const RouteGraph &routeGraph = *version->routeGraph;
+    if(routeGraph.nodeCount() < 2)
+        return 0;
+
+    ShortestPathSearch dijkstra;
+    ShortestPathSearch contracted;
+    dijkstra.setAlgorithm(DIJKSTRA_INDEXED_HEAP);
+    contracted.setAlgorithm(CONTRACTION_HIERARCHY);
+    searchGraphs graphs = getSearchGraphs(*version);
+
+    mt19937 random(seed);
+    uniform_int_distribution<uint32_t> pickAirport(0, routeGraph.nodeCount() - 1);
+    size_t failures = 0, routable = 0, dijkstraSettled = 0, hierarchySettled = 0;
+    for(size_t i = 0; i < pairCount; ++i) {
+        uint32_t start = pickAirport(random);
+        uint32_t end = pickAirport(random);
+        if(start == end)
+            continue;
+        dijkstra.run(graphs, start, end);
+        contracted.run(graphs, start, end);
+        dijkstraSettled += dijkstra.settledCount();
+        hierarchySettled += contracted.settledCount();
+
+        bool valid = dijkstra.isSettled(end) == contracted.isSettled(end);
+        if(valid && dijkstra.isSettled(end)) {
+            ++routable;
+            valid = dijkstra.distance(end) == contracted.distance(end);
+
+            // Follows the path, checking every leg is a real route of the length the search used
+            deque<uint32_t> path = contracted.pathTo(end);
+            double length = 0;
+            valid = valid && path.front() == start;
+            for(size_t leg = 1; valid && leg < path.size(); ++leg) {
+                double shortest = numeric_limits<double>::infinity();
+                for(uint32_t e = routeGraph.edgeBegin(path[leg - 1]); e < routeGraph.edgeEnd(path[leg - 1]); ++e) {
+                    if(routeGraph.target(e) == path[leg])
+                        shortest = min(shortest, routeGraph.weight(e));
+                }
+                length += shortest;
+                valid = length == contracted.distance(path[leg]);
+            }
+        }
+
+        if(!valid) {
+            ++failures;
+            out << "MISMATCH: " << version->airports->code(start) << " (" << start << ") -> "
+                << version->airports->code(end) << " (" << end << "): dijkstra " << dijkstra.distance(end)
+                << ", hierarchy " << contracted.distance(end) << '\n';
+        }
+    }
+
+    out << "Checked " << pairCount << " pairs (" << routable << " routable) against "
+        << version->hierarchy->shortcutCount() << " shortcuts: " << failures << " mismatches\n";
+    if(pairCount != 0) {
+        out << "Average airports settled: dijkstra " << dijkstraSettled / pairCount
+            << ", hierarchy " << hierarchySettled / pairCount << '\n';
+    }
+    return failures;
+}
+
+// Measures "pairCount" random pairs of airports with the batched kernel every route length comes from,
+// and with the scalar haversine formula working from degrees, timing both and comparing their results
+distanceKernelCheck Controller::checkDistanceKernel(size_t pairCount, unsigned seed) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    const AirportTable &airports = *version->airports;
+    distanceKernelCheck check = distanceKernelCheck();
+    if(airports.size() == 0 || pairCount == 0)
+        return check;
+
+    mt19937 random(seed);
+    uniform_int_distribution<uint32_t> pickAirport(0, airports.size() - 1);
+    vector<uint32_t> sources(pairCount);
+    vector<uint32_t> targets(pairCount);
+    for(size_t i = 0; i < pairCount; ++i) {
+        sources[i] = pickAirport(random);
+        targets[i] = pickAirport(random);
+    }
+
+    vector<double> kernelDistances(pairCount);
+    vector<double> scalarDistances(pairCount);
+    chrono::steady_clock::time_point lap = chrono::steady_clock::now();
+    airports.geometry().distances(sources.data(), targets.data(), pairCount, kernelDistances.data());
+    check.kernelNs = lapMilliseconds(lap) * 1e6 / pairCount;
+    for(size_t i = 0; i < pairCount; ++i) {
+        scalarDistances[i] = greatCircleDistance(airports.latitude(sources[i]), airports.longitude(sources[i]),
+                                                 airports.latitude(targets[i]), airports.longitude(targets[i]));
+    }
+    check.scalarNs = lapMilliseconds(lap) * 1e6 / pairCount;
+
+    check.pairs = pairCount;
+    for(size_t i = 0; i < pairCount; ++i) {
+        double error = abs(kernelDistances[i] - scalarDistances[i]);
+        check.maxAbsoluteError = max(check.maxAbsoluteError, error);
+        if(scalarDistances[i] >= 1)
+            check.maxRelativeError = max(check.maxRelativeError, error / scalarDistances[i]);
+    }
+    return check;
+}
+
+// Takes an output file name and generates an XML file
+// containing all verticies (airports) and edges (routes)
+void Controller::writeCSVToXML(const string &outputFile) const {
+
+    if(outputFile.length() < 5 || outputFile.substr(outputFile.length() - 4) != ".xml")
+        throw INVALID_FILENAME;
+
+    exportGraph(outputFile, EXPORT_XML);
+}
+
+// Writes every airport and route to "outputFile" in one of the built-in formats
+void Controller::exportGraph(const string &outputFile, exportFormats format) const {
+    if(format == EXPORT_XML)
+        exportGraph(outputFile, XMLExporter());
+    else if(format == EXPORT_JSON_LINES)
+        exportGraph(outputFile, JSONLinesExporter());
+    else
+        exportGraph(outputFile, BinaryEdgeExporter());
+}
+
+// Writes every airport and route to "outputFile" through "exporter", serializing on the worker pool
+// Throws INVALID_FILENAME if the file can not be written
+void Controller::exportGraph(const string &outputFile, const GraphExporter &exporter) const {
+    ofstream fout(outputFile.c_str(), ios::binary);
+    if(!fout)
+        throw INVALID_FILENAME;
+
+    shared_ptr<const graphVersion> version = currentGraph();
+    exportTables tables = {version->airports.get(), version->carriers.get(), version->routeGraph.get()};
+    ::exportGraph(tables, exporter, *getWorkerPool(), fout);
+
+    fout.close();
+    if(!fout)
+        throw INVALID_FILENAME;
+}
+
+// Sets how many itineraries and shortest path trees the query caches keep, evicting any excess
+// A capacity of 0 turns that cache off
+void Controller::setCacheCapacity(size_t itineraryCapacity, size_t treeCapacity) {
+    lock_guard<mutex> lock(store->updateMutex);
+    store->itineraryCacheCapacity = itineraryCapacity;
+    store->treeCacheCapacity = treeCapacity;
+    shared_ptr<const graphVersion> version = currentGraph();
+    version->caches->itineraries.setCapacity(itineraryCapacity);
+    version->caches->trees.setCapacity(treeCapacity);
+    version->caches->treeCandidates.setCapacity(treeCapacity * 4);
+}
+
+queryCacheCounters Controller::getCacheCounters() const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    queryCacheCounters counters;
+    counters.itineraries = version->caches->itineraries.getCounters();
+    counters.trees = version->caches->trees.getCounters();
+    return counters;
+}
+
+// Drops every cached result
+void Controller::clearCaches() const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    version->caches->itineraries.clear();
+    version->caches->trees.clear();
+    version->caches->treeCandidates.clear();
+}
+
+// Sets how many worker threads batch queries, the distance matrix and exports run on
+// A count of 0 means one per core. Must not be called while one of those is running
+void Controller::setWorkerThreads(size_t threadCount) {
+    shared_ptr<ThreadPool> pool = make_shared<ThreadPool>(threadCount == 0 ? thread::hardware_concurrency() : threadCount);
+    lock_guard<mutex> lock(store->poolMutex);
+    store->workerPool = pool;
+}
+
+// Starts counting the work and time of every shortest path query from zero, or stops counting
+// While disabled, queries do not even read the clock unless their caller asks for their statistics
+// Must not be called while queries are running
+void Controller::setStatsEnabled(bool isEnabled) {
+    totals = isEnabled ? make_shared<statsTotals>() : nullptr;
+}
+
+// Sums over the shortest path queries since statistics were enabled, all zero while disabled
+queryStatsTotals Controller::getQueryStats() const {
+    queryStatsTotals sums = queryStatsTotals();
+    shared_ptr<statsTotals> counted = totals;
+    if(counted == nullptr)
+        return sums;
+    sums.queries = counted->queries;
+    sums.cached = counted->cached;
+    sums.notFound = counted->notFound;
+    sums.search.settled = counted->settled;
+    sums.search.relaxed = counted->relaxed;
+    sums.search.heapPushes = counted->heapPushes;
+    sums.search.stalePops = counted->stalePops;
+    sums.pathHops = counted->pathHops;
+    sums.wallMs = counted->wallNanoseconds / 1e6;
+    return sums;
+}
+
+// Writes the load statistics, and the query totals when statistics are enabled, as readable lines
+void Controller::writeStats(ostream &out) const {
+    loadStats load = getLoadStats();
+    const char *names[] = {"airlines", "airports", "routes"};
+    const loadPhase *phases[] = {&load.airlines, &load.airports, &load.routes};
+    out << "load: " << load.totalMs << " ms";
+    if(isSnapshotLoaded())
+        out << " (snapshot mapped in " << load.snapshotMs << " ms)";
+    out << endl;
+    for(size_t i = 0; i < 3; ++i) {
+        out << "  " << names[i] << ": " << phases[i]->records << " records, " << phases[i]->lines.lines << " lines ("
+            << phases[i]->lines.malformed << " malformed, " << phases[i]->lines.skipped << " skipped), "
+            << phases[i]->ms << " ms" << endl;
+    }
+    out << "  derived graphs: " << load.derivedMs << " ms" << endl;
+    reachabilityStats reach = getReachabilityStats();
+    out << "  reachability: " << reach.components << " components (largest " << reach.largestComponent << " airports), "
+        << reach.isolatedAirports << " airports without routes, " << reach.indexBytes / 1024 << " KB index" << endl;
+
+    if(totals == nullptr)
+        return;
+    queryStatsTotals sums = getQueryStats();
+    uint64_t searched = max<uint64_t>(sums.queries - sums.cached, 1);
+    out << "queries: " << sums.queries << " (" << sums.cached << " cached, " << sums.notFound << " without a route), "
+        << sums.wallMs << " ms in total" << endl;
+    out << "  per search: " << double(sums.search.settled) / searched << " settled, "
+        << double(sums.search.relaxed) / searched << " relaxed, " << double(sums.search.heapPushes) / searched
+        << " heap pushes, " << double(sums.search.stalePops) / searched << " stale pops" << endl;
+    out << "  per query: " << double(sums.pathHops) / max<uint64_t>(sums.queries, 1) << " flights, "
+        << sums.wallMs / max<uint64_t>(sums.queries, 1) << " ms" << endl;
+}
+
+// Finds all edges (airlines) between two certain nodes (airports), given their airport ids
+std::vector<edge> Controller::findEdgesBetweenNodes(const int &aId, const int &bId) const {
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t aIndex = version->airports->findId(aId);
+    uint32_t bIndex = version->airports->findId(bId);
+    if(aIndex == AirportTable::NOT_FOUND || bIndex == AirportTable::NOT_FOUND)
+        return vector<edge>();
+    return findEdgesBetweenIndices(*version, aIndex, bIndex);
+}
+
+// Generates the carrier table, sorted by key: (airline id) with value: (airline name)
+// Can be used to convert an airline id to its name (string)
+csvLoadCounts Controller::makeIdToNameMap(CarrierTable &carriers) {
+    CSVFile infile(store->airlineFile);
+    vector<string_view> chunks = infile.splitChunks(CSV_CHUNK_SIZE);
+    vector<vector<pair<int, string>>> chunkAirlines(chunks.size());
+    vector<csvLoadCounts> chunkCounts(chunks.size());
+
+    // Seperates each line into fields, and puts needed values in the chunk's airline list
+    parseChunksInParallel(chunks, [&](size_t chunkIndex, string_view chunk) {
+        vector<string_view> fields;
+        string scratch;
+        string_view line;
+        while(CSVFile::nextLine(chunk, line)) {
+            ++chunkCounts[chunkIndex].lines;
+            int airlineId;
+            if(!splitCSVLine(line, fields, scratch) || fields.size() <= 1 || !parseIntField(fields[0], airlineId)) {
+                ++chunkCounts[chunkIndex].malformed;
+                continue;
+            }
+            chunkAirlines[chunkIndex].push_back(pair<int, string>(airlineId, string(fields[1])));
+        }
+    });
+
+    vector<pair<int, string>> airlines;
+    csvLoadCounts counts;
+    for(size_t i = 0; i < chunks.size(); ++i) {
+        airlines.insert(airlines.end(), chunkAirlines[i].begin(), chunkAirlines[i].end());
+        counts += chunkCounts[i];
+    }
+    logLoadCounts(store->airlineFile, counts);
+
+    carriers.build(airlines);
+    return counts;
+}
+
+// Generates the CSR route graph where the edges of airport index i are stored contiguously
+// Routes are first collected with their OpenFlights ids remapped to dense airport indices
+// Each chunk of the file is parsed on its own thread, then the chunks are joined in file order
+csvLoadCounts Controller::makeRouteMap(const AirportTable &airports, RouteGraph &routeGraph) {
+    CSVFile infile(store->routeFile);
+    vector<string_view> chunks = infile.splitChunks(CSV_CHUNK_SIZE);
+    vector<vector<routeEntry>> chunkRoutes(chunks.size());
+    vector<csvLoadCounts> chunkCounts(chunks.size());
+
+    // Seperates each line into fields, and puts needed values in the chunk's route list
+    parseChunksInParallel(chunks, [&](size_t chunkIndex, string_view chunk) {
+        vector<string_view> fields;
+        string scratch;
+        string_view line;
+        while(CSVFile::nextLine(chunk, line)) {
+            ++chunkCounts[chunkIndex].lines;
+            if(!splitCSVLine(line, fields, scratch) || fields.size() <= DESTINATION_AIRPORT_ID) {
+                ++chunkCounts[chunkIndex].malformed;
+                continue;
+            }
+
+            // Routes without an airport id (\N) can not be placed in the graph
+            int sourceId, destinationId;
+            if(isNullField(fields[SOURCE_AIRPORT_ID]) || isNullField(fields[DESTINATION_AIRPORT_ID])) {
+                ++chunkCounts[chunkIndex].skipped;
+                continue;
+            }
+            if(!parseIntField(fields[SOURCE_AIRPORT_ID], sourceId) || !parseIntField(fields[DESTINATION_AIRPORT_ID], destinationId)) {
+                ++chunkCounts[chunkIndex].malformed;
+                continue;
+            }
+
+            // Adds route if both source and destination exists
+            uint32_t sourceIndex = airports.findId(sourceId);
+            uint32_t destinationIndex = airports.findId(destinationId);
+            if(sourceIndex == AirportTable::NOT_FOUND || destinationIndex == AirportTable::NOT_FOUND) {
+                ++chunkCounts[chunkIndex].skipped;
+                continue;
+            }
+
+            // Unknown carriers (\N) are kept under an id that has no airline name
+            routeEntry route;
+            route.source = sourceIndex;
+            route.target = destinationIndex;
+            if(!parseIntField(fields[CARRIER_ID], route.carrierId))
+                route.carrierId = 0;
+            chunkRoutes[chunkIndex].push_back(route);
+        }
+
+        // Measures the chunk's routes in one batch, from the trig the airport table worked out per airport
+        vector<routeEntry> &parsed = chunkRoutes[chunkIndex];
+        vector<uint32_t> sources(parsed.size());
+        vector<uint32_t> targets(parsed.size());
+        vector<double> distances(parsed.size());
+        for(size_t i = 0; i < parsed.size(); ++i) {
+            sources[i] = parsed[i].source;
+            targets[i] = parsed[i].target;
+        }
+        airports.geometry().distances(sources.data(), targets.data(), parsed.size(), distances.data());
+        for(size_t i = 0; i < parsed.size(); ++i)
+            parsed[i].distance = distances[i];
+    });
+
+    vector<routeEntry> routes;
+    csvLoadCounts counts;
+    for(size_t i = 0; i < chunks.size(); ++i) {
+        routes.insert(routes.end(), chunkRoutes[i].begin(), chunkRoutes[i].end());
+        counts += chunkCounts[i];
+    }
+    logLoadCounts(store->routeFile, counts);
+
+    routeGraph.build(airports.size(), routes);
+    return counts;
+}
+
+// Creates the airport table indexed by the dense airport index (0..N-1)
+// As such, it can be used to retrieve info about an airport using the index as a lookup
+// The table can also find the index of an IATA or ICAO code or id to translate user input and routes
+csvLoadCounts Controller::makeAirportMap(AirportTable &airports) {
+    CSVFile infile(store->airportFile);
+    vector<string_view> chunks = infile.splitChunks(CSV_CHUNK_SIZE);
+    vector<vector<node>> chunkAirports(chunks.size());
+    vector<csvLoadCounts> chunkCounts(chunks.size());
+
+    // Seperates each line into fields, and puts needed values in the chunk's airport list
+    parseChunksInParallel(chunks, [&](size_t chunkIndex, string_view chunk) {
+        vector<string_view> fields;
+        string scratch;
+        string_view line;
+        while(CSVFile::nextLine(chunk, line)) {
+            ++chunkCounts[chunkIndex].lines;
+            node airport;
+            if(!splitCSVLine(line, fields, scratch) || fields.size() <= AIRPORT_LONGITUDE
+                    || !parseIntField(fields[AIRPORT_ID], airport.id)
+                    || !parseDoubleField(fields[AIRPORT_LATITUDE], airport.latitude)
+                    || !parseDoubleField(fields[AIRPORT_LONGITUDE], airport.longitude)) {
+                ++chunkCounts[chunkIndex].malformed;
+                continue;
+            }
+
+            // Airports without an IATA or ICAO code (\N) are kept, but can not be looked up by that code
+            if(!isNullField(fields[AIRPORT_IATA]))
+                airport.code = fields[AIRPORT_IATA];
+            if(!isNullField(fields[AIRPORT_ICAO]))
+                airport.icao = fields[AIRPORT_ICAO];
+            airport.name = fields[AIRPORT_NAME];
+            airport.city = fields[AIRPORT_CITY];
+            chunkAirports[chunkIndex].push_back(airport);
+        }
+    });
+
+    // Ignores repeated ids, keeping the first airport listed
+    vector<node> airportList;
+    unordered_set<int> seenIds;
+    csvLoadCounts counts;
+    for(size_t i = 0; i < chunks.size(); ++i) {
+        for(size_t j = 0; j < chunkAirports[i].size(); ++j) {
+            if(seenIds.insert(chunkAirports[i][j].id).second)
+                airportList.push_back(chunkAirports[i][j]);
+            else
+                ++counts.skipped;
+        }
+        counts += chunkCounts[i];
+    }
+    logLoadCounts(store->airportFile, counts);
+
+    airports.build(airportList);
+    return counts;
+}
+
+// Turns a path of airport indices (any container of them, from the origin to the destination)
+// into an Itinerary, reading each leg's airlines from the merged edge between its two airports
+// With a "carrierMask", legs only list the airlines it allows
+template<typename Path>
+Itinerary Controller::makeItinerary(const graphVersion &version, const Path &path, const vector<uint64_t> *carrierMask) const {
+    const CarrierGraph &carrierGraph = *version.carrierGraph;
+    Itinerary itinerary(version.airports, version.carriers);
+    for(size_t i = 1; i < path.size(); ++i) {
+        itineraryLeg leg;
+        leg.from = path[i - 1];
+        leg.to = path[i];
+        uint32_t edge = carrierGraph.findEdge(leg.from, leg.to);
+        leg.distance = carrierGraph.weight(edge);
+        for(uint32_t slot = carrierGraph.carriersBegin(edge); slot < carrierGraph.carriersEnd(edge); ++slot) {
+            int carrierId = carrierGraph.carrierAt(slot);
+            if(carrierMask == nullptr || carrierGraph.maskAllows(*carrierMask, carrierId))
+                leg.carrierIds.push_back(carrierId);
+        }
+        itinerary.addLeg(move(leg));
+    }
+    return itinerary;
+}
+
+// Finds all edges (airlines) between two airports, given their dense indices
+// The edges are built from the CSR slots of "aIndex" that lead to "bIndex"
+std::vector<edge> Controller::findEdgesBetweenIndices(const graphVersion &version, uint32_t aIndex, uint32_t bIndex) const {
+    const AirportTable &airports = *version.airports;
+    const RouteGraph &routeGraph = *version.routeGraph;
+    std::vector<edge> correspondingEdges;
+    for(uint32_t e = routeGraph.edgeBegin(aIndex); e < routeGraph.edgeEnd(aIndex); ++e) {
+        if(routeGraph.target(e) == bIndex) {
+            edge route;
+            route.destId = airports.id(bIndex);
+            route.sourceId = airports.id(aIndex);
+            route.carrierId = routeGraph.carrier(e);
+            route.distance = routeGraph.weight(e);
+            route.airportCode = airports.code(bIndex);
+            route.carrierName = version.carriers->name(route.carrierId);
+            correspondingEdges.push_back(route);
+        }
+    }
+    return correspondingEdges;
+}
+
+/// DELTA FUNCTIONS
+///
+
+// Reads a delta file: one change per line, made of the kind of change followed by the fields
+// of a line of the matching data file
+//   airport,<airports.dat fields>     adds the airport, or replaces the airport with the same id
+//   add-route,<routes.dat fields>     adds the route
+//   remove-route,<routes.dat fields>  removes every route with the same airline id and airport ids
+// Blank lines and lines starting with # are ignored. Airports change before routes do, and
+// removals only take out routes that existed before the delta, so a route can be removed and added again
+// Airports are resolved here, routes are resolved by resolveRoutes once the airport table is updated
+void Controller::readDelta(const graphVersion &version, const string &deltaFile, graphDelta &delta, deltaCounts &counts) {
+    CSVFile infile(deltaFile);
+    if(!infile.isOpen())
+        throw DELTA_NOT_READ;
+
+    // Position of each airport id in "changedAirports" or "addedAirports", so a repeated id keeps its last line
+    unordered_map<int, size_t> changedPositions;
+    unordered_map<int, size_t> addedPositions;
+    vector<string_view> fields;
+    string scratch;
+    string_view remaining = infile.contents();
+    string_view line;
+    while(CSVFile::nextLine(remaining, line)) {
+        if(line.empty() || line[0] == '#')
+            continue;
+        ++counts.lines.lines;
+        if(!splitCSVLine(line, fields, scratch) || fields.empty()) {
+            ++counts.lines.malformed;
+            continue;
+        }
+
+        // Fields after the kind line up with the data file's, one place further along
+        if(fields[0] == "airport") {
+            node airport;
+            if(fields.size() <= AIRPORT_LONGITUDE + 1
+                    || !parseIntField(fields[AIRPORT_ID + 1], airport.id)
+                    || !parseDoubleField(fields[AIRPORT_LATITUDE + 1], airport.latitude)
+                    || !parseDoubleField(fields[AIRPORT_LONGITUDE + 1], airport.longitude)) {
+                ++counts.lines.malformed;
+                continue;
+            }
+            if(!isNullField(fields[AIRPORT_IATA + 1]))
+                airport.code = fields[AIRPORT_IATA + 1];
+            if(!isNullField(fields[AIRPORT_ICAO + 1]))
+                airport.icao = fields[AIRPORT_ICAO + 1];
+            airport.name = fields[AIRPORT_NAME + 1];
+            airport.city = fields[AIRPORT_CITY + 1];
+
+            uint32_t index = version.airports->findId(airport.id);
+            if(index != AirportTable::NOT_FOUND) {
+                unordered_map<int, size_t>::iterator found = changedPositions.find(airport.id);
+                if(found != changedPositions.end())
+                    delta.changedAirports[found->second].second = airport;
+                else {
+                    changedPositions[airport.id] = delta.changedAirports.size();
+                    delta.changedAirports.push_back(make_pair(index, airport));
+                }
+            }
+            else {
+                unordered_map<int, size_t>::iterator found = addedPositions.find(airport.id);
+                if(found != addedPositions.end())
+                    delta.addedAirports[found->second] = airport;
+                else {
+                    addedPositions[airport.id] = delta.addedAirports.size();
+                    delta.addedAirports.push_back(airport);
+                }
+            }
+        }
+        else if(fields[0] == "add-route" || fields[0] == "remove-route") {
+            routeChange change;
+            change.isRemoval = fields[0] == "remove-route";
+            if(fields.size() <= DESTINATION_AIRPORT_ID + 1) {
+                ++counts.lines.malformed;
+                continue;
+            }
+            if(isNullField(fields[SOURCE_AIRPORT_ID + 1]) || isNullField(fields[DESTINATION_AIRPORT_ID + 1])) {
+                ++counts.lines.skipped;
+                continue;
+            }
+            if(!parseIntField(fields[SOURCE_AIRPORT_ID + 1], change.sourceId)
+                    || !parseIntField(fields[DESTINATION_AIRPORT_ID + 1], change.destinationId)) {
+                ++counts.lines.malformed;
+                continue;
+            }
+            if(!parseIntField(fields[CARRIER_ID + 1], change.carrierId))
+                change.carrierId = 0;
+            delta.routeChanges.push_back(change);
+        }
+        else
+            ++counts.lines.malformed;
+    }
+
+    // Sorts out which changed airports moved, since their routes change length,
+    // and which were renamed, since itineraries through them read differently
+    const AirportTable &airports = *version.airports;
+    for(size_t i = 0; i < delta.changedAirports.size(); ++i) {
+        uint32_t index = delta.changedAirports[i].first;
+        const node &airport = delta.changedAirports[i].second;
+        if(airport.latitude != airports.latitude(index) || airport.longitude != airports.longitude(index))
+            delta.movedAirports.push_back(index);
+        if(airport.name != airports.name(index) || airport.city != airports.city(index) || airport.code != airports.code(index)
+                || airport.icao != airports.icao(index))
+            delta.renamedAirports.push_back(index);
+    }
+}
+
+// Turns the route lines of "delta" into removed and added routes over the updated "airports"
+// Routes of a moved airport are removed and added again with their new length,
+// unless the delta removes them anyway
+void Controller::resolveRoutes(const graphVersion &previous, const AirportTable &airports, graphDelta &delta, deltaCounts &counts) {
+    const RouteGraph &routeGraph = *previous.routeGraph;
+    set<tuple<uint32_t, uint32_t, int>> removedKeys;
+    for(size_t i = 0; i < delta.routeChanges.size(); ++i) {
+        const routeChange &change = delta.routeChanges[i];
+        routeEntry route;
+        route.source = airports.findId(change.sourceId);
+        route.target = airports.findId(change.destinationId);
+        route.carrierId = change.carrierId;
+        if(route.source == AirportTable::NOT_FOUND || route.target == AirportTable::NOT_FOUND) {
+            ++counts.lines.skipped;
+            continue;
+        }
+        route.distance = airports.distance(route.source, route.target);
+        if(!change.isRemoval) {
+            delta.addedRoutes.push_back(route);
+            ++counts.routesAdded;
+            continue;
+        }
+
+        size_t matches = 0;
+        if(route.source < routeGraph.nodeCount()) {
+            for(uint32_t e = routeGraph.edgeBegin(route.source); e < routeGraph.edgeEnd(route.source); ++e)
+                matches += routeGraph.target(e) == route.target && routeGraph.carrier(e) == route.carrierId;
+        }
+        if(matches == 0 || !removedKeys.insert(make_tuple(route.source, route.target, route.carrierId)).second) {
+            ++counts.lines.skipped;
+            continue;
+        }
+        delta.removedRoutes.push_back(route);
+        counts.routesRemoved += matches;
+    }
+
+    // Routes between two moved airports are handled with the routes leaving their source
+    vector<bool> isMoved(airports.size(), false);
+    for(size_t i = 0; i < delta.movedAirports.size(); ++i)
+        isMoved[delta.movedAirports[i]] = true;
+    for(size_t i = 0; i < delta.movedAirports.size(); ++i) {
+        uint32_t moved = delta.movedAirports[i];
+        vector<routeEntry> touching;
+        for(uint32_t e = routeGraph.edgeBegin(moved); e < routeGraph.edgeEnd(moved); ++e)
+            touching.push_back({moved, routeGraph.target(e), routeGraph.carrier(e), 0});
+        const RouteGraph &reverseGraph = *previous.reverseGraph;
+        for(uint32_t e = reverseGraph.edgeBegin(moved); e < reverseGraph.edgeEnd(moved); ++e) {
+            if(!isMoved[reverseGraph.target(e)])
+                touching.push_back({reverseGraph.target(e), moved, reverseGraph.carrier(e), 0});
+        }
+
+        for(size_t j = 0; j < touching.size(); ++j) {
+            routeEntry &route = touching[j];
+            if(removedKeys.count(make_tuple(route.source, route.target, route.carrierId)) != 0)
+                continue;
+            route.distance = airports.distance(route.source, route.target);
+            delta.removedRoutes.push_back(route);
+            delta.addedRoutes.push_back(route);
+        }
+    }
+}
+
+// Gives the updated version fresh caches, holding the results of "previous" the delta can not have changed
+// Removing routes only lengthens the paths that used them, so every other result stays exact.
+// Adding routes can shorten any path, so results are then only kept for origins whose cached shortest
+// path tree is still exact: every tree route still exists, no reachable airport moved, and no added
+// route reaches an airport more cheaply than the tree does
+// Results through renamed airports are dropped, since their itineraries name the old airport
+void Controller::carryOverCaches(const graphVersion &previous, graphVersion &updated, const graphDelta &delta) {
+    updated.caches = make_shared<queryCaches>(store->itineraryCacheCapacity, store->treeCacheCapacity);
+    const RouteGraph &routeGraph = *updated.routeGraph;
+    size_t airportCount = updated.airports->size();
+
+    unordered_set<uint64_t> touchedPairs;
+    for(size_t i = 0; i < delta.removedRoutes.size(); ++i)
+        touchedPairs.insert((uint64_t(delta.removedRoutes[i].source) << 32) | delta.removedRoutes[i].target);
+    for(size_t i = 0; i < delta.addedRoutes.size(); ++i)
+        touchedPairs.insert((uint64_t(delta.addedRoutes[i].source) << 32) | delta.addedRoutes[i].target);
+    unordered_set<uint32_t> renamed(delta.renamedAirports.begin(), delta.renamedAirports.end());
+
+    unordered_set<uint32_t> exactOrigins;
+    previous.caches->trees.forEach([&](uint32_t origin, const shared_ptr<const pathTree> &tree) {
+        const vector<double> &distances = tree->distances;
+        for(size_t i = 0; i < delta.movedAirports.size(); ++i) {
+            if(distances[delta.movedAirports[i]] != numeric_limits<double>::infinity())
+                return;
+        }
+        for(size_t i = 0; i < delta.removedRoutes.size(); ++i) {
+            const routeEntry &route = delta.removedRoutes[i];
+            if(tree->parents[route.target] != route.source)
+                continue;
+            bool isStillFlown = false;
+            for(uint32_t e = routeGraph.edgeBegin(route.source); e < routeGraph.edgeEnd(route.source) && !isStillFlown; ++e)
+                isStillFlown = routeGraph.target(e) == route.target;
+            if(!isStillFlown)
+                return;
+        }
+        for(size_t i = 0; i < delta.addedRoutes.size(); ++i) {
+            const routeEntry &route = delta.addedRoutes[i];
+            double sourceDistance = route.source < distances.size() ? distances[route.source] : numeric_limits<double>::infinity();
+            double targetDistance = route.target < distances.size() ? distances[route.target] : numeric_limits<double>::infinity();
+            if(sourceDistance + route.distance < targetDistance)
+                return;
+        }
+
+        // Airports added by the delta are unreachable in a tree that is still exact
+        exactOrigins.insert(origin);
+        if(distances.size() == airportCount) {
+            updated.caches->trees.insert(origin, tree);
+            return;
+        }
+        shared_ptr<pathTree> extended = make_shared<pathTree>(*tree);
+        extended->distances.resize(airportCount, numeric_limits<double>::infinity());
+        extended->parents.resize(airportCount, ShortestPathSearch::NO_PARENT);
+        updated.caches->trees.insert(origin, extended);
+    });
+
+    bool hasAddedRoutes = !delta.addedRoutes.empty();
+    previous.caches->itineraries.forEach([&](uint64_t key, const shared_ptr<const pathResult> &cached) {
+        if(hasAddedRoutes && exactOrigins.count(uint32_t(key >> 32)) == 0)
+            return;
+        vector<uint32_t> nodes = cached->itinerary.airportPath();
+        for(size_t i = 0; i < nodes.size(); ++i) {
+            if(renamed.count(nodes[i]) != 0)
+                return;
+            if(i != 0 && touchedPairs.count((uint64_t(nodes[i - 1]) << 32) | nodes[i]) != 0)
+                return;
+        }
+        updated.caches->itineraries.insert(key, cached);
+    });
+}
+
+/// HELPER FUNCTIONS
+///
+
+// Formats the distances of a finished one-to-all search as one row of the distance matrix
+// Binary rows are raw float32 miles, CSV rows start with the origin's IATA code
+void Controller::formatMatrixRow(const graphVersion &version, const ShortestPathSearch &search, uint32_t origin,
+                                 matrixFormats format, string &row) const {
+    const AirportTable &airports = *version.airports;
+    row.clear();
+    uint32_t airportCount = airports.size();
+    if(format == MATRIX_BINARY) {
+        row.resize(airportCount * sizeof(float));
+        for(uint32_t index = 0; index < airportCount; ++index) {
+            float distance = search.isSettled(index) ? search.distance(index) : numeric_limits<float>::infinity();
+            memcpy(&row[index * sizeof(float)], &distance, sizeof(float));
+        }
+        return;
+    }
+
+    row.append(airports.code(origin));
+    for(uint32_t index = 0; index < airportCount; ++index) {
+        row += ',';
+        if(search.isSettled(index)) {
+            char number[32];
+            row.append(number, to_chars(number, number + sizeof(number), search.distance(index)).ptr);
+        }
+    }
+    row += '\n';
+}
+
+// Finds the shortest path between two distinct airports for getShortestPath
+// Walks the parents of the origin's cached shortest path tree when there is one; an origin that
+// misses for the second time while still remembered in "treeCandidates" gets its tree built and cached
+// Otherwise runs an ordinary search that stops at the destination
+// The work done goes into "stats", which is left alone when the path is walked from a cached tree
+void Controller::findPath(const graphVersion &version, uint32_t startIndex, uint32_t endIndex, pathResult &result, queryStats &stats) const {
+    result.found = false;
+
+    queryCaches &caches = *version.caches;
+    shared_ptr<const pathTree> tree;
+    bool seenBefore;
+    if(!caches.trees.find(startIndex, tree)) {
+        if(caches.treeCandidates.find(startIndex, seenBefore)) {
+            shared_ptr<pathTree> built = make_shared<pathTree>();
+            buildPathTree(version, startIndex, *built, &stats.search);
+            caches.trees.insert(startIndex, built);
+            tree = built;
+        }
+        else
+            caches.treeCandidates.insert(startIndex, true);
+    }
+
+    deque<uint32_t> path;
+    if(tree != nullptr) {
+        stats.isCached = stats.search.settled == 0;
+        if(tree->distances[endIndex] == numeric_limits<double>::infinity()) {
+            result.error = NO_ROUTE_FOUND;
+            return;
+        }
+        for(uint32_t current = endIndex; current != ShortestPathSearch::NO_PARENT; current = tree->parents[current])
+            path.push_front(current);
+    }
+    else {
+        // Scratch arrays are kept per thread, so repeated queries allocate nothing for the search
+        thread_local ShortestPathSearch search;
+        search.setAlgorithm(searchAlgorithm);
+        search.run(getSearchGraphs(version), startIndex, endIndex);
+        stats.search = search.getCounters();
+        if(!search.isSettled(endIndex)) {
+            result.error = NO_ROUTE_FOUND;
+            return;
+        }
+        path = search.pathTo(endIndex);
+    }
+
+    result.found = true;
+    result.itinerary = makeItinerary(version, path);
+}
+
+// Answers getShortestPath and getItinerary, from the cache when the pair was asked before
+// Hot pairs are answered straight from the cache, including pairs with no route
+// The clock is only read when "stats" is given or statistics are enabled
+void Controller::findCachedPath(const string &start, const string &end, pathResult &result, queryStats *stats) const {
+    bool isMeasured = stats != nullptr || totals != nullptr;
+    chrono::steady_clock::time_point begin;
+    if(isMeasured)
+        begin = chrono::steady_clock::now();
+    queryStats measured = queryStats();
+
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+
+    // Pairs no sequence of routes connects are answered before the caches, without a search
+    if(!version->reachability->reaches(startIndex, endIndex)) {
+        if(isMeasured)
+            recordStats(measured, begin, false, stats);
+        throw NO_ROUTE_FOUND;
+    }
+
+    uint64_t key = (uint64_t(startIndex) << 32) | endIndex;
+    shared_ptr<const pathResult> cached;
+    if(!version->caches->itineraries.find(key, cached)) {
+        shared_ptr<pathResult> found = make_shared<pathResult>();
+        findPath(*version, startIndex, endIndex, *found, measured);
+        version->caches->itineraries.insert(key, found);
+        cached = found;
+    }
+    else
+        measured.isCached = true;
+
+    if(isMeasured) {
+        measured.pathHops = cached->itinerary.legCount();
+        recordStats(measured, begin, cached->found, stats);
+    }
+
+    // Throws error if no possible routes between airports
+    // due to closed airports or private/non-commercial airports
+    if(!cached->found)
+        throw cached->error;
+    result = *cached;
+}
+
+// Answers the airline-restricted getShortestPath and getItinerary
+void Controller::findRestrictedPath(const string &start, const string &end, const carrierFilter &filter,
+                                    pathResult &result, queryStats *stats) const {
+    bool isMeasured = stats != nullptr || totals != nullptr;
+    chrono::steady_clock::time_point begin;
+    if(isMeasured)
+        begin = chrono::steady_clock::now();
+
+    shared_ptr<const graphVersion> version = currentGraph();
+    uint32_t startIndex, endIndex;
+    findEndpoints(*version, start, end, startIndex, endIndex);
+    if(!version->reachability->reaches(startIndex, endIndex)) {
+        if(isMeasured) {
+            queryStats measured = queryStats();
+            recordStats(measured, begin, false, stats);
+        }
+        throw NO_ROUTE_FOUND;
+    }
+
+    vector<uint64_t> mask = version->carrierGraph->makeMask(filter);
+    searchGraphs graphs = getSearchGraphs(*version);
+    graphs.carrierMask = mask.data();
+
+    thread_local ShortestPathSearch search;
+    search.setAlgorithm(searchAlgorithm);
+    search.run(graphs, startIndex, endIndex);
+    bool isFound = search.isSettled(endIndex);
+    if(isMeasured) {
+        queryStats measured = queryStats();
+        measured.search = search.getCounters();
+        measured.pathHops = isFound ? search.pathTo(endIndex).size() - 1 : 0;
+        recordStats(measured, begin, isFound, stats);
+    }
+    if(!isFound)
+        throw NO_ROUTE_FOUND;
+
+    result.found = true;
+    result.itinerary = makeItinerary(*version, search.pathTo(endIndex), &mask);
+}
+
+// Lists the airports of "group" with their ground distances, throwing "missing" for an unknown code
+// or a group without any airport
+// Negative ground distances count as 0, searches can not go back in distance
+void Controller::findGroupEndpoints(const graphVersion &version, const airportGroup &group, CONTROLLER_ERRORS missing,
+                                    vector<searchEndpoint> &endpoints) const {
+    endpoints.clear();
+    for(size_t i = 0; i < group.airports.size(); ++i) {
+        uint32_t index = version.airports->findAirport(group.airports[i].code);
+        if(index == AirportTable::NOT_FOUND)
+            throw missing;
+        endpoints.push_back(searchEndpoint{index, max(group.airports[i].distance, 0.0)});
+    }
+    if(group.hasPoint) {
+        vector<nearbyAirport> nearby;
+        version.airports->locations().within(group.latitude, group.longitude, group.radius, nearby);
+        for(size_t i = 0; i < nearby.size(); ++i)
+            endpoints.push_back(searchEndpoint{nearby[i].airport, nearby[i].distance});
+    }
+    if(endpoints.empty())
+        throw missing;
+}
+
+// Answers the queries between groups of airports; never cached, since the groups rarely repeat
+void Controller::findGroupPath(const graphVersion &version, const vector<searchEndpoint> &sources,
+                               const vector<searchEndpoint> &targets, groupItinerary &result, queryStats *stats) const {
+    bool isMeasured = stats != nullptr || totals != nullptr;
+    chrono::steady_clock::time_point begin;
+    if(isMeasured)
+        begin = chrono::steady_clock::now();
+
+    // When no origin reaches any destination, no search is run at all
+    thread_local ShortestPathSearch search;
+    bool isReachable = isAnyReachable(*version.reachability, sources, targets);
+    uint32_t destination = ShortestPathSearch::NO_PARENT;
+    if(isReachable)
+        destination = search.runBetween(getSearchGraphs(version), sources.data(), sources.size(),
+                                        targets.data(), targets.size());
+    bool isFound = destination != ShortestPathSearch::NO_PARENT;
+    deque<uint32_t> path;
+    if(isFound)
+        path = search.pathTo(destination);
+    if(isMeasured) {
+        queryStats measured = queryStats();
+        if(isReachable)
+            measured.search = search.getCounters();
+        measured.pathHops = isFound ? path.size() - 1 : 0;
+        recordStats(measured, begin, isFound, stats);
+    }
+    if(!isFound)
+        throw NO_ROUTE_FOUND;
+
+    // The search keeps the smallest offset of an airport listed more than once, and so does this
+    result.origin = path.front();
+    result.destination = destination;
+    result.originGround = search.distance(path.front());
+    result.destinationGround = numeric_limits<double>::infinity();
+    for(size_t i = 0; i < targets.size(); ++i) {
+        if(targets[i].airport == destination)
+            result.destinationGround = min(result.destinationGround, targets[i].offset);
+    }
+    result.distance = search.distance(destination) + result.destinationGround;
+    result.itinerary = makeItinerary(version, path);
+}
+
+// Stamps the wall time since "begin" on a measured query, adds it to the totals
+// when statistics are enabled, and hands it to the caller if they asked for it
+void Controller::recordStats(queryStats &measured, chrono::steady_clock::time_point begin, bool isFound, queryStats *stats) const {
+    chrono::steady_clock::duration elapsed = chrono::steady_clock::now() - begin;
+    measured.wallMs = chrono::duration<double, milli>(elapsed).count();
+    if(stats != nullptr)
+        *stats = measured;
+
+    shared_ptr<statsTotals> sums = totals;
+    if(sums == nullptr)
+        return;
+    sums->queries.fetch_add(1, memory_order_relaxed);
+    sums->cached.fetch_add(measured.isCached, memory_order_relaxed);
+    sums->notFound.fetch_add(!isFound, memory_order_relaxed);
+    sums->settled.fetch_add(measured.search.settled, memory_order_relaxed);
+    sums->relaxed.fetch_add(measured.search.relaxed, memory_order_relaxed);
+    sums->heapPushes.fetch_add(measured.search.heapPushes, memory_order_relaxed);
+    sums->stalePops.fetch_add(measured.search.stalePops, memory_order_relaxed);
+    sums->pathHops.fetch_add(measured.pathHops, memory_order_relaxed);
+    sums->wallNanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(elapsed).count(), memory_order_relaxed);
+}
+
+// Looks up both airport codes of a query (IATA, or ICAO when four characters long),
+// throwing the matching error if either is unusable
+void Controller::findEndpoints(const graphVersion &version, const string &start, const string &end,
+                               uint32_t &startIndex, uint32_t &endIndex) const {
+    startIndex = version.airports->findAirport(start);
+    if(startIndex == AirportTable::NOT_FOUND)
+        throw START_NOT_FOUND;
+
+    endIndex = version.airports->findAirport(end);
+    if(endIndex == AirportTable::NOT_FOUND)
+        throw END_NOT_FOUND;
+
+    if(startIndex == endIndex)
+        throw START_END_SAME;
+}
+
+// Bundles the graphs and tables of "version" a search may need
+searchGraphs Controller::getSearchGraphs(const graphVersion &version) const {
+    searchGraphs graphs;
+    graphs.forward = version.routeGraph.get();
+    graphs.reverse = version.reverseGraph.get();
+    graphs.airports = version.airports.get();
+    graphs.hierarchy = version.hierarchy.get();
+    graphs.carriers = version.carrierGraph.get();
+    graphs.carrierMask = nullptr;
+    return graphs;
+}
+
+// Reports lines of a data file that were malformed or left out, if there were any
+void Controller::logLoadCounts(const string &filename, const csvLoadCounts &counts) {
+    if(counts.malformed == 0 && counts.skipped == 0)
+        return;
+    clog << filename << ": read " << counts.lines << " lines, " << counts.malformed
+         << " malformed, " << counts.skipped << " skipped" << endl;
+}
+
+// Copies share the store, so they see the same graph and every update made through either of them
+// Statistics are counted per handle, from zero for the copy
+void Controller::copy(const Controller &other) {
+    store = other.store;
+    searchAlgorithm = other.searchAlgorithm;
+    totals = other.totals != nullptr ? make_shared<statsTotals>() : nullptr;
+}
+
+void Controller::deleteAll() {
+    store.reset();
+    totals.reset();
+}
@@ -1,111 +1,407 @@
-#include <iostream>
-#include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <map>
-#include <queue>
-#include <cmath>
-#include <fstream>
-#include <sstream>
-#include <deque>
-
-#ifndef CONTROLLER_H
-#define CONTROLLER_H
-
-enum airportCSVMeanings {
-    AIRPORT_ID,
-    AIRPORT_NAME,
-    AIRPORT_CITY,
-    AIRPORT_COUNTRY,
-    AIRPORT_IATA,
-    AIRPORT_ICAO,
-    AIRPORT_LATITUDE,
-    AIRPORT_LONGITUDE
-};
-
-enum routeCSVMeanings {
-    CARRIER_CODE,
-    CARRIER_ID,
-    SOURCE_AIRPORT_IATA,
-    SOURCE_AIRPORT_ID,
-    DESTINATION_AIRPORT_IATA,
-    DESTINATION_AIRPORT_ID
-};
-
-enum CONTROLLER_ERRORS {
-    START_NOT_FOUND,
-    END_NOT_FOUND,
-    START_END_SAME,
-    NO_ROUTE_FOUND,
-    INVALID_FILENAME
-};
-
-struct edge {
-    int destId;
-    int sourceId;
-    int carrierId;
-    double distance;
-    std::string airportCode;
-    std::string carrierName;
-
-    friend
-    bool operator<(const edge &a, const edge &b) {
-        return a.distance < b.distance;
-    }
-    friend
-    bool operator>(const edge &a, const edge &b) {
-        return a.distance > b.distance;
-    }
-};
-
-struct node {
-    int id;
-    double latitude;
-    double longitude;
-    std::string name;
-    std::string code;
-    std::string city;
-};
-
-
-class Controller {
-
-public:
-
-    Controller(const std::string &airportFile, const std::string &airlineFile, const std::string &routeFile);
-    ~Controller();
-    Controller(const Controller &other);
-    Controller &operator=(const Controller &other);
-
-    void writeCSVToXML(const std::string &outputFile);
-    std::vector<std::string> getShortestPath(const std::string &start, const std::string &end);
-    std::vector<edge> findEdgesBetweenNodes(const int &aId, const int &bId);
-
-
-private:
-
-    std::string airportFile;
-    std::string airlineFile;
-    std::string routeFile;
-
-    std::unordered_map<int, std::string> airlineNames;
-    std::unordered_map<int, std::vector<edge>> routeMap;
-    std::unordered_map<std::string, int> nameToIdMap;
-    std::map<int, node> airportMap;
-
-
-    void constructMaps();
-    void makeIdToNameMap();
-    void makeRouteMap();
-    void makeAirportMap();
-    void makeItinerary(std::deque<int> &path, std::vector<std::string> &itinerary);
-    double toRadian(const double &degree);
-    double getDistance(double latitude1, double longitude1, double latitude2, double longitude2);
-
-    std::vector<std::string> parseCSVLine(const std::string &line);
-
-    void copy(const Controller &other);
-    void deleteAll();
-};
-
-#endif // CONTROLLER_H
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <tuple>
+#include <queue>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <cstring>
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include "routegraph.h"
+#include "metadata.h"
+#include "snapshot.h"
+#include "csvreader.h"
+#include "pathsearch.h"
+#include "layoversearch.h"
+#include "kshortest.h"
+#include "contraction.h"
+#include "carriergraph.h"
+#include "geo.h"
+#include "spatialindex.h"
+#include "reachability.h"
+#include "threadpool.h"
+#include "lrucache.h"
+#include "graphexport.h"
+#include "itinerary.h"
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+enum airportCSVMeanings {
+    AIRPORT_ID,
+    AIRPORT_NAME,
+    AIRPORT_CITY,
+    AIRPORT_COUNTRY,
+    AIRPORT_IATA,
+    AIRPORT_ICAO,
+    AIRPORT_LATITUDE,
+    AIRPORT_LONGITUDE
+};
+
+enum routeCSVMeanings {
+    CARRIER_CODE,
+    CARRIER_ID,
+    SOURCE_AIRPORT_IATA,
+    SOURCE_AIRPORT_ID,
+    DESTINATION_AIRPORT_IATA,
+    DESTINATION_AIRPORT_ID
+};
+
+enum CONTROLLER_ERRORS {
+    START_NOT_FOUND,
+    END_NOT_FOUND,
+    START_END_SAME,
+    NO_ROUTE_FOUND,
+    INVALID_FILENAME,
+    SNAPSHOT_NOT_WRITTEN,
+    SERVER_NOT_STARTED,
+    DELTA_NOT_READ
+};
+
+
+// Shortest distances and parents from one origin to every airport, indexed by dense airport index
+// Unreachable airports have an infinite distance and a parent of ShortestPathSearch::NO_PARENT,
+// and so does the origin's parent
+struct pathTree {
+    uint32_t origin;
+    std::vector<double> distances;
+    std::vector<uint32_t> parents;
+};
+
+// Layout of a distance matrix file
+enum matrixFormats {
+    MATRIX_BINARY, // Header, airport ids, then one row of float32 miles per origin (infinity if unreachable)
+    MATRIX_CSV     // Header row of IATA codes, then one row per origin (empty if unreachable)
+};
+
+// Counters of the two caches behind getShortestPath, since the graph last changed
+struct queryCacheCounters {
+    cacheCounters itineraries; // Finished results by (start, end)
+    cacheCounters trees;       // Complete shortest path trees by origin
+};
+
+// One step of loading a data file
+struct loadPhase {
+    double ms;
+    csvLoadCounts lines; // All zero when the table was mapped from a snapshot
+    size_t records;      // Airlines, airports or routes in the loaded table
+};
+
+// Wall time and record counts of each step of the last full load
+// The per-file times are 0 when the graph was mapped from a snapshot, which "snapshotMs" covers instead
+struct loadStats {
+    loadPhase airlines; // makeIdToNameMap, airlines.dat into the carrier table
+    loadPhase airports; // makeAirportMap, airports.dat into the airport table and its indexes
+    loadPhase routes;   // makeRouteMap, routes.dat into the route graph, distances included
+    double derivedMs;   // Reverse graph, merged carrier graph and reachability index
+    double snapshotMs;
+    double totalMs;
+};
+
+// Work and wall time of one shortest path query, filled in for callers that pass one
+struct queryStats {
+    searchCounters search; // All zero when the itinerary was cached
+    size_t pathHops;       // Flights taken, 0 when there is no route
+    double wallMs;
+    bool isCached;         // Answered from the itinerary cache or a cached shortest path tree
+};
+
+// Sums of queryStats over every shortest path query since statistics were enabled
+struct queryStatsTotals {
+    uint64_t queries;
+    uint64_t cached;
+    uint64_t notFound; // Queries between valid airports with no route
+    searchCounters search;
+    uint64_t pathHops;
+    double wallMs;
+};
+
+// Agreement and speed of the batched distance kernel (GeoTable) against greatCircleDistance
+struct distanceKernelCheck {
+    size_t pairs;
+    double maxAbsoluteError; // Miles
+    double maxRelativeError; // Over pairs at least a mile apart
+    double kernelNs;         // Per pair, all pairs measured in one GeoTable::distances call
+    double scalarNs;         // Per pair, greatCircleDistance from degrees one pair at a time
+};
+
+// What applying one delta file changed
+struct deltaCounts {
+    uint64_t version;       // Graph version the delta produced
+    size_t airportsAdded;
+    size_t airportsChanged;
+    size_t routesAdded;
+    size_t routesRemoved;   // Route slots taken out, one line removes every duplicate of its route
+    csvLoadCounts lines;    // Skipped lines name unknown airports, or routes that did not exist
+};
+
+// Outcome of one origin/destination pair of a batch query
+// "itinerary" is only filled when "found" is true, otherwise "error" tells why
+struct pathResult {
+    bool found;
+    CONTROLLER_ERRORS error;
+    Itinerary itinerary;
+};
+
+// Airport a query between groups of airports may fly from or to, by IATA or ICAO code,
+// with the ground distance (miles) between it and the true origin or destination
+struct groundLink {
+    std::string code;
+    double distance;
+};
+
+// One end of a query between groups of airports: the airports listed in "airports", and when "hasPoint"
+// is set every airport within "radius" miles of a latitude/longitude (degrees), at its great-circle
+// distance from that point
+struct airportGroup {
+    std::vector<groundLink> airports;
+    bool hasPoint;
+    double latitude;
+    double longitude;
+    double radius;
+};
+
+// Best way between two groups of airports: over the ground to "origin", the flights of "itinerary",
+// then over the ground from "destination"
+// When one airport is in both groups and no flight beats staying on the ground, the itinerary has no legs
+struct groupItinerary {
+    uint32_t origin;
+    uint32_t destination;
+    double originGround;
+    double destinationGround;
+    double distance; // Ground and flights together
+    Itinerary itinerary;
+};
+
+// Where one airport sits in the route network (see ReachabilityIndex)
+struct airportReachability {
+    bool isRoutable;      // Some route leaves or arrives at the airport
+    size_t componentSize; // Airports it reaches that reach it back, itself included
+    size_t reachable;     // Airports it reaches, itself included
+};
+
+struct edge {
+    int destId;
+    int sourceId;
+    int carrierId;
+    double distance;
+    std::string airportCode;
+    std::string carrierName;
+
+    friend
+    bool operator<(const edge &a, const edge &b) {
+        return a.distance < b.distance;
+    }
+    friend
+    bool operator>(const edge &a, const edge &b) {
+        return a.distance > b.distance;
+    }
+};
+
+// Handle onto a loaded flight graph
+// The data lives in immutable, reference counted graph versions (see graphVersion) held by a store
+// every copy of the handle shares, so copying or moving a Controller copies a few pointers, and an update
+// made through any copy is seen by all of them
+// Queries are const and may run on any number of threads at once, through one shared Controller
+// or through copies; settings (search algorithm, statistics, worker threads, cache capacities)
+// must not change while queries are running through the same handle
+class Controller {
+
+public:
+
+    Controller(const std::string &airportFile, const std::string &airlineFile, const std::string &routeFile);
+    Controller(const std::string &snapshotFile, const std::string &airportFile,
+               const std::string &airlineFile, const std::string &routeFile);
+    ~Controller();
+    Controller(const Controller &other);
+    Controller(Controller &&other) noexcept;
+    Controller &operator=(const Controller &other);
+    Controller &operator=(Controller &&other) noexcept;
+
+    void compile(const std::string &snapshotFile) const;
+    void reload();
+    deltaCounts applyDelta(const std::string &deltaFile);
+    uint64_t getGraphVersion() const;
+    loadStats getLoadStats() const;
+    bool isSnapshotLoaded() const;
+    void writeCSVToXML(const std::string &outputFile) const;
+    void exportGraph(const std::string &outputFile, exportFormats format) const;
+    void exportGraph(const std::string &outputFile, const GraphExporter &exporter) const;
+    std::vector<std::string> getShortestPath(const std::string &start, const std::string &end, queryStats *stats = nullptr) const;
+    // Layover limits go to getShortestPathWithLayovers, this keeps a literal 0 from binding to "stats"
+    std::vector<std::string> getShortestPath(const std::string &start, const std::string &end, int maxLayovers) const = delete;
+    std::vector<std::string> getShortestPathWithLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const;
+    std::vector<std::string> getShortestPath(const std::string &start, const std::string &end, const carrierFilter &filter,
+                                             queryStats *stats = nullptr) const;
+    Itinerary getItinerary(const std::string &start, const std::string &end, queryStats *stats = nullptr) const;
+    Itinerary getItineraryWithLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const;
+    Itinerary getItinerary(const std::string &start, const std::string &end, const carrierFilter &filter,
+                           queryStats *stats = nullptr) const;
+    groupItinerary getItinerary(const airportGroup &origins, const airportGroup &destinations, queryStats *stats = nullptr) const;
+    groupItinerary getItineraryNear(double startLatitude, double startLongitude, double endLatitude, double endLongitude,
+                                    double radiusMiles, queryStats *stats = nullptr) const;
+    std::vector<nearbyAirport> findNearestAirports(double latitude, double longitude, size_t count) const;
+    std::vector<nearbyAirport> findAirportsWithin(double latitude, double longitude, double radiusMiles) const;
+    std::vector<Itinerary> getKShortestPaths(const std::string &start, const std::string &end, size_t k) const;
+    std::vector<pathResult> getShortestPathsByLayovers(const std::string &start, const std::string &end, unsigned maxLayovers) const;
+    std::vector<pathResult> getShortestPaths(const std::vector<std::pair<std::string, std::string>> &pairs) const;
+    pathTree shortestPathTree(const std::string &origin) const;
+    void writeDistanceMatrix(const std::string &outputFile, matrixFormats format) const;
+    size_t getAirportCount() const;
+    std::string getAirportCode(uint32_t index) const;
+    std::string getAirportICAO(uint32_t index) const;
+    bool canReach(const std::string &start, const std::string &end) const;
+    airportReachability getAirportReachability(const std::string &code) const;
+    reachabilityStats getReachabilityStats() const;
+    void setSearchAlgorithm(searchAlgorithms algorithm);
+    searchAlgorithms getSearchAlgorithm() const;
+    void buildHierarchy();
+    size_t verifyHierarchy(size_t pairCount, unsigned seed, std::ostream &out);
+    distanceKernelCheck checkDistanceKernel(size_t pairCount, unsigned seed) const;
+    std::vector<edge> findEdgesBetweenNodes(const int &aId, const int &bId) const;
+    void setCacheCapacity(size_t itineraryCapacity, size_t treeCapacity);
+    queryCacheCounters getCacheCounters() const;
+    void clearCaches() const;
+    void setWorkerThreads(size_t threadCount);
+    void setStatsEnabled(bool isEnabled);
+    queryStatsTotals getQueryStats() const;
+    void writeStats(std::ostream &out) const;
+
+
+private:
+
+    // Caches of getShortestPath, kept behind a pointer since they hold locks
+    // Origins only get a tree cached on their second miss, tracked by "treeCandidates"
+    struct queryCaches {
+        LRUCache<uint64_t, std::shared_ptr<const pathResult>> itineraries;
+        LRUCache<uint32_t, std::shared_ptr<const pathTree>> trees;
+        LRUCache<uint32_t, bool> treeCandidates;
+
+        queryCaches(size_t itineraryCapacity, size_t treeCapacity)
+            : itineraries(itineraryCapacity), trees(treeCapacity), treeCandidates(treeCapacity * 4) {}
+    };
+
+    // One consistent state of the graph and everything derived from it
+    // A version never changes once published (apart from filling its caches): updates build the next
+    // version and swap it in, while queries keep the version they started with alive until they finish
+    // Tables an update leaves alone are shared with the previous version
+    struct graphVersion {
+        uint64_t number; // Deltas applied and reloads done since the Controller was created
+        loadStats load; // Of the load this version descends from
+        std::shared_ptr<MappedFile> snapshot; // Keeps the mapped tables alive
+        std::shared_ptr<const CarrierTable> carriers;
+        std::shared_ptr<const AirportTable> airports;
+        std::shared_ptr<const RouteGraph> routeGraph;
+        std::shared_ptr<const RouteGraph> reverseGraph; // For BIDIRECTIONAL and k shortest path searches
+        std::shared_ptr<const CarrierGraph> carrierGraph; // Parallel routes merged, searched instead of routeGraph
+        std::shared_ptr<const ReachabilityIndex> reachability; // Rejects pairs no route connects before any search
+        std::shared_ptr<const ContractionHierarchy> hierarchy; // Null until built for this version's graph
+        std::shared_ptr<queryCaches> caches;
+    };
+
+    // Running sums behind getQueryStats, updated by concurrent queries
+    struct statsTotals {
+        std::atomic<uint64_t> queries;
+        std::atomic<uint64_t> cached;
+        std::atomic<uint64_t> notFound;
+        std::atomic<uint64_t> settled;
+        std::atomic<uint64_t> relaxed;
+        std::atomic<uint64_t> heapPushes;
+        std::atomic<uint64_t> stalePops;
+        std::atomic<uint64_t> pathHops;
+        std::atomic<uint64_t> wallNanoseconds;
+
+        statsTotals() : queries(0), cached(0), notFound(0), settled(0), relaxed(0), heapPushes(0),
+                        stalePops(0), pathHops(0), wallNanoseconds(0) {}
+    };
+
+    // Route line of a delta file, by OpenFlights ids
+    struct routeChange {
+        bool isRemoval;
+        int carrierId;
+        int sourceId;
+        int destinationId;
+    };
+
+    // Parsed lines of a delta file, resolved against the version it applies to
+    struct graphDelta {
+        std::vector<std::pair<uint32_t, node>> changedAirports;
+        std::vector<node> addedAirports;
+        std::vector<uint32_t> movedAirports;   // Changed airports with new coordinates
+        std::vector<uint32_t> renamedAirports; // Changed airports with a new name, city, IATA or ICAO code
+        std::vector<routeChange> routeChanges;
+        std::vector<routeEntry> removedRoutes;
+        std::vector<routeEntry> addedRoutes;
+    };
+
+    // What every copy of a Controller shares: where the graph came from, the version queries see,
+    // and the worker pool; the lock serializes updates and settings that apply to every copy
+    struct graphStore {
+        std::string airportFile;
+        std::string airlineFile;
+        std::string routeFile;
+        std::string snapshotFile; // Empty unless created from a snapshot
+
+        std::shared_ptr<const graphVersion> graph; // Only read and replaced with the atomic shared_ptr functions
+        std::mutex updateMutex;
+        size_t itineraryCacheCapacity; // Of the caches of every version built from now on
+        size_t treeCacheCapacity;
+        std::shared_ptr<ThreadPool> workerPool; // Created by the first batch query, under "poolMutex"
+        std::mutex poolMutex;
+    };
+
+    std::shared_ptr<graphStore> store; // Null only in a Controller that was moved from
+    searchAlgorithms searchAlgorithm;
+    std::shared_ptr<statsTotals> totals; // Null while statistics are disabled, so queries skip all timing
+
+
+    std::shared_ptr<const graphVersion> currentGraph() const;
+    void publishGraph(const std::shared_ptr<const graphVersion> &version);
+    std::shared_ptr<ThreadPool> getWorkerPool() const;
+    std::shared_ptr<graphVersion> loadGraph();
+    void constructMaps(graphVersion &version);
+    bool loadSnapshot(const std::string &snapshotFile, graphVersion &version);
+    csvLoadCounts makeIdToNameMap(CarrierTable &carriers);
+    csvLoadCounts makeRouteMap(const AirportTable &airports, RouteGraph &routeGraph);
+    csvLoadCounts makeAirportMap(AirportTable &airports);
+    void readDelta(const graphVersion &version, const std::string &deltaFile, graphDelta &delta, deltaCounts &counts);
+    void resolveRoutes(const graphVersion &previous, const AirportTable &airports, graphDelta &delta, deltaCounts &counts);
+    void carryOverCaches(const graphVersion &previous, graphVersion &updated, const graphDelta &delta);
+    void findEndpoints(const graphVersion &version, const std::string &start, const std::string &end,
+                       uint32_t &startIndex, uint32_t &endIndex) const;
+    template<typename Path>
+    Itinerary makeItinerary(const graphVersion &version, const Path &path, const std::vector<uint64_t> *carrierMask = nullptr) const;
+    void findCachedPath(const std::string &start, const std::string &end, pathResult &result, queryStats *stats) const;
+    void findPath(const graphVersion &version, uint32_t startIndex, uint32_t endIndex, pathResult &result, queryStats &stats) const;
+    void findGroupEndpoints(const graphVersion &version, const airportGroup &group, CONTROLLER_ERRORS missing,
+                            std::vector<searchEndpoint> &endpoints) const;
+    void findGroupPath(const graphVersion &version, const std::vector<searchEndpoint> &sources,
+                       const std::vector<searchEndpoint> &targets, groupItinerary &result, queryStats *stats) const;
+    void findRestrictedPath(const std::string &start, const std::string &end, const carrierFilter &filter,
+                            pathResult &result, queryStats *stats) const;
+    void recordStats(queryStats &measured, std::chrono::steady_clock::time_point begin, bool isFound, queryStats *stats) const;
+    void buildPathTree(const graphVersion &version, uint32_t originIndex, pathTree &tree, searchCounters *counters = nullptr) const;
+    std::vector<edge> findEdgesBetweenIndices(const graphVersion &version, uint32_t aIndex, uint32_t bIndex) const;
+    searchGraphs getSearchGraphs(const graphVersion &version) const;
+    void formatMatrixRow(const graphVersion &version, const ShortestPathSearch &search, uint32_t origin,
+                         matrixFormats format, std::string &row) const;
+
+    void logLoadCounts(const std::string &filename, const csvLoadCounts &counts);
+
+    void copy(const Controller &other);
+    void deleteAll();
+};
+
+#endif // CONTROLLER_H
@@ -0,0 +1,167 @@
+#include "csvreader.h"
+#include <thread>
+#include <charconv>
+#include <algorithm>
+
+using namespace std;
+
+csvLoadCounts &csvLoadCounts::operator+=(const csvLoadCounts &other) {
+    lines += other.lines;
+    malformed += other.malformed;
+    skipped += other.skipped;
+    return *this;
+}
+
+/// CSV FILE
+///
+
+// Maps the file and skips the UTF-8 byte order mark that prefixes airports.dat
+CSVFile::CSVFile(const string &filename) : file(filename) {
+    if(!file.isOpen())
+        return;
+    text = string_view(reinterpret_cast<const char *>(file.data()), file.size());
+    if(text.substr(0, 3) == "\xEF\xBB\xBF")
+        text.remove_prefix(3);
+}
+
+// Cuts the file into about one chunk per hardware thread, never smaller than "minimumChunkSize"
+// Every chunk ends just after a newline, so no line is ever split between two chunks
+vector<string_view> CSVFile::splitChunks(size_t minimumChunkSize) const {
+    size_t threads = max(1u, thread::hardware_concurrency());
+    size_t chunkSize = max(minimumChunkSize, text.size() / threads + 1);
+
+    vector<string_view> chunks;
+    size_t start = 0;
+    while(start < text.size()) {
+        size_t end = start + chunkSize;
+        if(end >= text.size())
+            end = text.size();
+        else {
+            end = text.find('\n', end);
+            end = end == string_view::npos ? text.size() : end + 1;
+        }
+        chunks.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+// Moves the next line of "remaining" into "line" without its line ending
+// Returns false once "remaining" is empty
+bool CSVFile::nextLine(string_view &remaining, string_view &line) {
+    if(remaining.empty())
+        return false;
+    size_t end = remaining.find('\n');
+    if(end == string_view::npos) {
+        line = remaining;
+        remaining = string_view();
+    }
+    else {
+        line = remaining.substr(0, end);
+        remaining.remove_prefix(end + 1);
+    }
+    if(!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    return true;
+}
+
+/// HELPER FUNCTIONS
+///
+
+// Input example: " item1,"item2","say ""hi""" "
+// Output example: vector([0]: item1, [1]: item2, [2]: say "hi")
+bool splitCSVLine(string_view line, vector<string_view> &fields, string &scratch) {
+    fields.clear();
+
+    // Unescaped text is never longer than the line, so the scratch buffer never moves
+    if(scratch.size() < line.size())
+        scratch.resize(line.size());
+    size_t used = 0;
+
+    size_t i = 0;
+    while(true) {
+        size_t stop = line.find_first_of(",\"", i);
+
+        // Plain field: views the line directly
+        if(stop == string_view::npos || line[stop] == ',') {
+            size_t end = stop == string_view::npos ? line.size() : stop;
+            fields.push_back(line.substr(i, end - i));
+            if(stop == string_view::npos)
+                return true;
+            i = stop + 1;
+            continue;
+        }
+
+        // Fully quoted field without escapes: views the text between the quotation marks
+        if(stop == i) {
+            size_t closing = line.find('"', i + 1);
+            if(closing != string_view::npos && (closing + 1 == line.size() || line[closing + 1] == ',')) {
+                fields.push_back(line.substr(i + 1, closing - i - 1));
+                if(closing + 1 == line.size())
+                    return true;
+                i = closing + 2;
+                continue;
+            }
+        }
+
+        // Anything else is unescaped into the scratch buffer, one character at a time
+        size_t fieldStart = used;
+        bool isQuote = false;
+        size_t j = i;
+        for(; j < line.size(); ++j) {
+            char current = line[j];
+            if(!isQuote) {
+                if(current == ',')
+                    break;
+                else if(current == '"')
+                    isQuote = true;
+                else
+                    scratch[used++] = current;
+            }
+            else if(current == '"') {
+                if(j + 1 < line.size() && line[j + 1] == '"') {
+                    scratch[used++] = '"';
+                    ++j;
+                }
+                else
+                    isQuote = false;
+            }
+            else
+                scratch[used++] = current;
+        }
+        fields.push_back(string_view(scratch.data() + fieldStart, used - fieldStart));
+        if(j >= line.size())
+            return !isQuote;
+        i = j + 1;
+    }
+}
+
+void parseChunksInParallel(const vector<string_view> &chunks, const function<void(size_t, string_view)> &parseChunk) {
+    if(chunks.size() == 1) {
+        parseChunk(0, chunks[0]);
+        return;
+    }
+
+    vector<thread> workers;
+    for(size_t i = 0; i < chunks.size(); ++i)
+        workers.push_back(thread(parseChunk, i, chunks[i]));
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+// OpenFlights marks missing values with \N
+bool isNullField(string_view field) {
+    return field == "\\N";
+}
+
+bool parseIntField(string_view field, int &value) {
+    const char *end = field.data() + field.size();
+    from_chars_result result = from_chars(field.data(), end, value);
+    return !field.empty() && result.ec == errc() && result.ptr == end;
+}
+
+bool parseDoubleField(string_view field, double &value) {
+    const char *end = field.data() + field.size();
+    from_chars_result result = from_chars(field.data(), end, value);
+    return !field.empty() && result.ec == errc() && result.ptr == end;
+}
@@ -0,0 +1,56 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include "snapshot.h"
+
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+// Line counts gathered while reading one CSV file
+struct csvLoadCounts {
+    size_t lines;
+    size_t malformed; // Lines with too few fields, unbalanced quotes or unreadable numbers
+    size_t skipped;   // Well formed lines left out, such as routes to unknown airports
+
+    csvLoadCounts() : lines(0), malformed(0), skipped(0) {}
+    csvLoadCounts &operator+=(const csvLoadCounts &other);
+};
+
+// Whole CSV file mapped into memory, handed out as line-aligned chunks of text
+// Every string_view taken from the file is only valid while the CSVFile is alive
+class CSVFile {
+
+public:
+
+    CSVFile(const std::string &filename);
+
+    bool isOpen() const { return file.isOpen(); }
+    std::string_view contents() const { return text; }
+    std::vector<std::string_view> splitChunks(size_t minimumChunkSize) const;
+
+    static bool nextLine(std::string_view &remaining, std::string_view &line);
+
+
+private:
+
+    MappedFile file;
+    std::string_view text;
+};
+
+// Splits a CSV line into fields that view the line wherever possible
+// Quoted fields drop their quotation marks and turn "" into ", and only fields that
+// needed unescaping are copied, into "scratch" (so it must outlive the fields)
+// Returns false if the line ends inside quotation marks
+bool splitCSVLine(std::string_view line, std::vector<std::string_view> &fields, std::string &scratch);
+
+// Runs "parseChunk(chunkIndex, chunk)" for every chunk, each on its own thread
+void parseChunksInParallel(const std::vector<std::string_view> &chunks,
+                           const std::function<void(size_t, std::string_view)> &parseChunk);
+
+bool isNullField(std::string_view field);
+bool parseIntField(std::string_view field, int &value);
+bool parseDoubleField(std::string_view field, double &value);
+
+#endif // CSVREADER_H
@@ -0,0 +1,74 @@
+#include <vector>
+#include <cstddef>
+
+#ifndef FLATARRAY_H
+#define FLATARRAY_H
+
+// Read-only array that either owns its elements (built from the CSV files)
+// or views elements that live elsewhere, such as a memory-mapped snapshot
+// Viewed memory is not owned, so whoever attaches it must keep it alive
+template<typename T>
+class FlatArray {
+
+public:
+
+    FlatArray() : elements(nullptr), count(0) {}
+
+    FlatArray(const FlatArray &other) {
+        copy(other);
+    }
+
+    FlatArray &operator=(const FlatArray &other) {
+        if(this != &other)
+            copy(other);
+        return *this;
+    }
+
+    // Takes ownership of the values
+    void assign(std::vector<T> &&values) {
+        owned.swap(values);
+        elements = owned.data();
+        count = owned.size();
+    }
+
+    // Views "size" elements at "data" without copying them
+    void attach(const T *data, size_t size) {
+        owned.clear();
+        owned.shrink_to_fit();
+        elements = data;
+        count = size;
+    }
+
+    void clear() {
+        attach(nullptr, 0);
+    }
+
+    const T &operator[](size_t i) const { return elements[i]; }
+    const T *data() const { return elements; }
+    const T *begin() const { return elements; }
+    const T *end() const { return elements + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isOwned() const { return elements == owned.data() && count != 0; }
+
+
+private:
+
+    std::vector<T> owned;
+    const T *elements;
+    size_t count;
+
+    void copy(const FlatArray &other) {
+        if(other.isOwned()) {
+            owned = other.owned;
+            elements = owned.data();
+        }
+        else {
+            owned.clear();
+            elements = other.elements;
+        }
+        count = other.count;
+    }
+};
+
+#endif // FLATARRAY_H
@@ -0,0 +1,171 @@
+#include "geo.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Helper function : Converts degress to radians
+double toRadian(const double &degree) {
+    return degree * M_PI / 180.0;
+}
+
+// Helper function : Calculates distance (miles) between two points on Earth
+// Uses the haversine formula, so it is the length of the great-circle arc between them
+// Route lengths come from GeoTable, this is kept as the reference it is checked against
+double greatCircleDistance(double latitude1, double longitude1, double latitude2, double longitude2) {
+    double lat1 = toRadian(latitude1);
+    double lon1 = toRadian(longitude1);
+    double lat2 = toRadian(latitude2);
+    double lon2 = toRadian(longitude2);
+    double deltaLat = abs(lat1 - lat2);
+    double deltaLon = abs(lon1 - lon2);
+    double a = pow(sin(deltaLat/2), 2) + (cos(lat1)*cos(lat2)*pow(sin(deltaLon/2), 2));
+    double c = 2 * asin(sqrt(a));
+    return EARTH_RADIUS_MILES * c;
+}
+
+/// GEO TABLE
+///
+
+// Works out the trig of "count" airports given in degrees
+void GeoTable::build(const double *latitudes, const double *longitudes, size_t count) {
+    trigColumns built;
+    built.sinHalfLatitudes.resize(count);
+    built.cosHalfLatitudes.resize(count);
+    built.sinHalfLongitudes.resize(count);
+    built.cosHalfLongitudes.resize(count);
+    built.cosLatitudes.resize(count);
+    for(size_t i = 0; i < count; ++i)
+        fillTrig(built, i, latitudes[i], longitudes[i]);
+    assign(built);
+}
+
+// Trig of "count" airports, of which only "movedAirports" and the airports past the end of this table
+// have other coordinates than here; the rest is copied
+GeoTable GeoTable::withChanges(const double *latitudes, const double *longitudes, size_t count,
+                               const vector<uint32_t> &movedAirports) const {
+    trigColumns built;
+    built.sinHalfLatitudes.assign(sinHalfLatitudes.begin(), sinHalfLatitudes.end());
+    built.cosHalfLatitudes.assign(cosHalfLatitudes.begin(), cosHalfLatitudes.end());
+    built.sinHalfLongitudes.assign(sinHalfLongitudes.begin(), sinHalfLongitudes.end());
+    built.cosHalfLongitudes.assign(cosHalfLongitudes.begin(), cosHalfLongitudes.end());
+    built.cosLatitudes.assign(cosLatitudes.begin(), cosLatitudes.end());
+    built.sinHalfLatitudes.resize(count);
+    built.cosHalfLatitudes.resize(count);
+    built.sinHalfLongitudes.resize(count);
+    built.cosHalfLongitudes.resize(count);
+    built.cosLatitudes.resize(count);
+    for(size_t i = 0; i < movedAirports.size(); ++i)
+        fillTrig(built, movedAirports[i], latitudes[movedAirports[i]], longitudes[movedAirports[i]]);
+    for(size_t i = size(); i < count; ++i)
+        fillTrig(built, i, latitudes[i], longitudes[i]);
+
+    GeoTable updated;
+    updated.assign(built);
+    return updated;
+}
+
+void GeoTable::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_GEO_SIN_HALF_LATITUDES, sinHalfLatitudes);
+    writer.addSection(SECTION_GEO_COS_HALF_LATITUDES, cosHalfLatitudes);
+    writer.addSection(SECTION_GEO_SIN_HALF_LONGITUDES, sinHalfLongitudes);
+    writer.addSection(SECTION_GEO_COS_HALF_LONGITUDES, cosHalfLongitudes);
+    writer.addSection(SECTION_GEO_COS_LATITUDES, cosLatitudes);
+}
+
+// Attaches the trig stored in a snapshot, if it covers exactly "expectedCount" airports
+bool GeoTable::read(const SnapshotReader &reader, size_t expectedCount) {
+    bool valid = reader.attachSection(SECTION_GEO_SIN_HALF_LATITUDES, sinHalfLatitudes)
+              && reader.attachSection(SECTION_GEO_COS_HALF_LATITUDES, cosHalfLatitudes)
+              && reader.attachSection(SECTION_GEO_SIN_HALF_LONGITUDES, sinHalfLongitudes)
+              && reader.attachSection(SECTION_GEO_COS_HALF_LONGITUDES, cosHalfLongitudes)
+              && reader.attachSection(SECTION_GEO_COS_LATITUDES, cosLatitudes);
+    valid = valid && sinHalfLatitudes.size() == expectedCount && cosHalfLatitudes.size() == expectedCount
+         && sinHalfLongitudes.size() == expectedCount && cosHalfLongitudes.size() == expectedCount
+         && cosLatitudes.size() == expectedCount;
+    if(!valid)
+        clear();
+    return valid;
+}
+
+void GeoTable::clear() {
+    sinHalfLatitudes.clear();
+    cosHalfLatitudes.clear();
+    sinHalfLongitudes.clear();
+    cosHalfLongitudes.clear();
+    cosLatitudes.clear();
+}
+
+// Great-circle distance (miles) between two airports
+double GeoTable::distance(uint32_t source, uint32_t target) const {
+    return EARTH_RADIUS_MILES * (2 * asin(sqrt(haversine(source, target))));
+}
+
+// Fills "results" with the distances of "count" (source, target) pairs of airports
+// Gives exactly the same values as distance(): with SSE2, pairs are worked out two at a time
+// using the same operations in the same order, up to the arcsine, which is taken one at a time
+void GeoTable::distances(const uint32_t *sources, const uint32_t *targets, size_t count, double *results) const {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128d one = _mm_set1_pd(1.0);
+    for(; i + 2 <= count; i += 2) {
+        uint32_t s0 = sources[i], s1 = sources[i + 1];
+        uint32_t t0 = targets[i], t1 = targets[i + 1];
+        __m128d sinHalfLatSource = _mm_set_pd(sinHalfLatitudes[s1], sinHalfLatitudes[s0]);
+        __m128d cosHalfLatSource = _mm_set_pd(cosHalfLatitudes[s1], cosHalfLatitudes[s0]);
+        __m128d sinHalfLatTarget = _mm_set_pd(sinHalfLatitudes[t1], sinHalfLatitudes[t0]);
+        __m128d cosHalfLatTarget = _mm_set_pd(cosHalfLatitudes[t1], cosHalfLatitudes[t0]);
+        __m128d sinHalfLonSource = _mm_set_pd(sinHalfLongitudes[s1], sinHalfLongitudes[s0]);
+        __m128d cosHalfLonSource = _mm_set_pd(cosHalfLongitudes[s1], cosHalfLongitudes[s0]);
+        __m128d sinHalfLonTarget = _mm_set_pd(sinHalfLongitudes[t1], sinHalfLongitudes[t0]);
+        __m128d cosHalfLonTarget = _mm_set_pd(cosHalfLongitudes[t1], cosHalfLongitudes[t0]);
+        __m128d cosLatSource = _mm_set_pd(cosLatitudes[s1], cosLatitudes[s0]);
+        __m128d cosLatTarget = _mm_set_pd(cosLatitudes[t1], cosLatitudes[t0]);
+
+        __m128d sinHalfDeltaLat = _mm_sub_pd(_mm_mul_pd(sinHalfLatSource, cosHalfLatTarget),
+                                             _mm_mul_pd(cosHalfLatSource, sinHalfLatTarget));
+        __m128d sinHalfDeltaLon = _mm_sub_pd(_mm_mul_pd(sinHalfLonSource, cosHalfLonTarget),
+                                             _mm_mul_pd(cosHalfLonSource, sinHalfLonTarget));
+        __m128d a = _mm_add_pd(_mm_mul_pd(sinHalfDeltaLat, sinHalfDeltaLat),
+                               _mm_mul_pd(_mm_mul_pd(cosLatSource, cosLatTarget), _mm_mul_pd(sinHalfDeltaLon, sinHalfDeltaLon)));
+        double roots[2];
+        _mm_storeu_pd(roots, _mm_sqrt_pd(_mm_min_pd(a, one)));
+        results[i] = EARTH_RADIUS_MILES * (2 * asin(roots[0]));
+        results[i + 1] = EARTH_RADIUS_MILES * (2 * asin(roots[1]));
+    }
+#endif
+    for(; i < count; ++i)
+        results[i] = distance(sources[i], targets[i]);
+}
+
+// sin^2(dLat/2) + cos(lat1) cos(lat2) sin^2(dLon/2), the haversine of the central angle,
+// kept at most 1 so rounding between nearly antipodal airports can not push the arcsine out of range
+double GeoTable::haversine(uint32_t source, uint32_t target) const {
+    double sinHalfDeltaLat = sinHalfLatitudes[source] * cosHalfLatitudes[target] - cosHalfLatitudes[source] * sinHalfLatitudes[target];
+    double sinHalfDeltaLon = sinHalfLongitudes[source] * cosHalfLongitudes[target] - cosHalfLongitudes[source] * sinHalfLongitudes[target];
+    double a = sinHalfDeltaLat * sinHalfDeltaLat + (cosLatitudes[source] * cosLatitudes[target]) * (sinHalfDeltaLon * sinHalfDeltaLon);
+    return min(a, 1.0);
+}
+
+// Works out the trig of airport "index" from its coordinates in degrees
+void GeoTable::fillTrig(trigColumns &built, size_t index, double latitude, double longitude) {
+    double latitudeRadians = toRadian(latitude);
+    double longitudeRadians = toRadian(longitude);
+    built.sinHalfLatitudes[index] = sin(latitudeRadians / 2);
+    built.cosHalfLatitudes[index] = cos(latitudeRadians / 2);
+    built.sinHalfLongitudes[index] = sin(longitudeRadians / 2);
+    built.cosHalfLongitudes[index] = cos(longitudeRadians / 2);
+    built.cosLatitudes[index] = cos(latitudeRadians);
+}
+
+void GeoTable::assign(trigColumns &built) {
+    sinHalfLatitudes.assign(move(built.sinHalfLatitudes));
+    cosHalfLatitudes.assign(move(built.cosHalfLatitudes));
+    sinHalfLongitudes.assign(move(built.sinHalfLongitudes));
+    cosHalfLongitudes.assign(move(built.cosHalfLongitudes));
+    cosLatitudes.assign(move(built.cosLatitudes));
+}
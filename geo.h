@@ -0,0 +1,59 @@
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+#include "snapshot.h"
+
+#ifndef GEO_H
+#define GEO_H
+
+const double EARTH_RADIUS_MILES = 3959;
+
+double toRadian(const double &degree);
+double greatCircleDistance(double latitude1, double longitude1, double latitude2, double longitude2);
+
+// Sines and cosines of every airport's coordinates, worked out once when the airports are loaded
+// Keeps one array per value (structure of arrays), indexed by dense airport index
+// The haversine formula needs sin(dLat/2) and sin(dLon/2) between two airports, which the
+// half-angle sines and cosines give with two products, so a distance costs a few multiplications,
+// a square root and an arcsine, instead of converting both airports and taking six trig functions
+class GeoTable {
+
+public:
+
+    void build(const double *latitudes, const double *longitudes, size_t count);
+    GeoTable withChanges(const double *latitudes, const double *longitudes, size_t count,
+                         const std::vector<uint32_t> &movedAirports) const;
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader, size_t expectedCount);
+    void clear();
+
+    size_t size() const { return cosLatitudes.size(); }
+
+    double distance(uint32_t source, uint32_t target) const;
+    void distances(const uint32_t *sources, const uint32_t *targets, size_t count, double *results) const;
+
+
+private:
+
+    FlatArray<double> sinHalfLatitudes;
+    FlatArray<double> cosHalfLatitudes;
+    FlatArray<double> sinHalfLongitudes;
+    FlatArray<double> cosHalfLongitudes;
+    FlatArray<double> cosLatitudes;
+
+    // Trig columns while they are being built
+    struct trigColumns {
+        std::vector<double> sinHalfLatitudes;
+        std::vector<double> cosHalfLatitudes;
+        std::vector<double> sinHalfLongitudes;
+        std::vector<double> cosHalfLongitudes;
+        std::vector<double> cosLatitudes;
+    };
+
+    double haversine(uint32_t source, uint32_t target) const;
+    static void fillTrig(trigColumns &built, size_t index, double latitude, double longitude);
+    void assign(trigColumns &built);
+};
+
+#endif // GEO_H
@@ -0,0 +1,210 @@
+#include "graphexport.h"
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// Airports serialized together as one task, and blocks held in memory per worker thread
+const size_t EXPORT_BLOCK_AIRPORTS = 256;
+const size_t EXPORT_BLOCKS_PER_THREAD = 4;
+const char EDGE_LIST_MAGIC[8] = {'F', 'P', 'E', 'D', 'G', 'E', 'S', '1'};
+
+/// FORMATTING HELPERS
+///
+
+static void appendInt(long long value, string &out) {
+    char number[24];
+    out.append(number, to_chars(number, number + sizeof(number), value).ptr);
+}
+
+// Same digits an ostream prints with its default precision of 6
+static void appendShortDouble(double value, string &out) {
+    char number[32];
+    out.append(number, to_chars(number, number + sizeof(number), value, chars_format::general, 6).ptr);
+}
+
+// Shortest digits that read back as the same double
+static void appendExactDouble(double value, string &out) {
+    char number[32];
+    out.append(number, to_chars(number, number + sizeof(number), value).ptr);
+}
+
+template<typename T>
+static void appendRaw(const T &value, string &out) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Escapes text for use as element content, which only needs the markup characters replaced
+void appendXMLEscaped(string_view text, string &out) {
+    for(char c : text) {
+        if(c == '&')
+            out += "&amp;";
+        else if(c == '<')
+            out += "&lt;";
+        else if(c == '>')
+            out += "&gt;";
+        else
+            out += c;
+    }
+}
+
+void appendJSONEscaped(string_view text, string &out) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20) {
+            out += "\\u00";
+            out += HEX_DIGITS[(c >> 4) & 0xF];
+            out += HEX_DIGITS[c & 0xF];
+        }
+        else
+            out += c;
+    }
+}
+
+/// EXPORT DRIVER
+///
+
+// Writes the whole graph through "exporter" to "out"
+// Blocks of airports are serialized in parallel, a bounded batch at a time, and each batch is
+// written in airport order before the next one starts, so the output never depends on timing
+void exportGraph(const exportTables &tables, const GraphExporter &exporter, ThreadPool &pool, ostream &out) {
+    string header;
+    exporter.appendHeader(tables, header);
+    out.write(header.data(), header.size());
+
+    uint32_t airportCount = tables.airports->size();
+    size_t blockCount = (airportCount + EXPORT_BLOCK_AIRPORTS - 1) / EXPORT_BLOCK_AIRPORTS;
+    vector<string> blocks(max<size_t>(pool.size(), 1) * EXPORT_BLOCKS_PER_THREAD);
+
+    for(size_t firstBlock = 0; firstBlock < blockCount; firstBlock += blocks.size()) {
+        size_t batchSize = min(blocks.size(), blockCount - firstBlock);
+        pool.run(batchSize, [&](size_t block, size_t) {
+            string &text = blocks[block];
+            text.clear();
+            uint32_t begin = (firstBlock + block) * EXPORT_BLOCK_AIRPORTS;
+            uint32_t end = min<uint32_t>(begin + EXPORT_BLOCK_AIRPORTS, airportCount);
+            for(uint32_t index = begin; index < end; ++index)
+                exporter.appendAirport(tables, index, text);
+        });
+        for(size_t block = 0; block < batchSize; ++block)
+            out.write(blocks[block].data(), blocks[block].size());
+    }
+
+    string footer;
+    exporter.appendFooter(tables, footer);
+    out.write(footer.data(), footer.size());
+}
+
+/// XML
+///
+
+void XMLExporter::appendHeader(const exportTables &, string &out) const {
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+}
+
+void XMLExporter::appendAirport(const exportTables &tables, uint32_t index, string &out) const {
+    const AirportTable &airports = *tables.airports;
+    const RouteGraph &routes = *tables.routes;
+
+    out += "<vertex>\n\t<id>";
+    appendInt(airports.id(index), out);
+    out += "</id>\n\t<name>";
+    appendXMLEscaped(airports.name(index), out);
+    out += "</name>\n\t<city>";
+    appendXMLEscaped(airports.city(index), out);
+    out += "</city>\n\t<latitude>";
+    appendShortDouble(airports.latitude(index), out);
+    out += "</latitude>\n\t<longitude>";
+    appendShortDouble(airports.longitude(index), out);
+    out += "</longitude>\n\t<edges>\n";
+    for(uint32_t e = routes.edgeBegin(index); e < routes.edgeEnd(index); ++e) {
+        out += "\t\t<edge>\n\t\t\t<airportID>";
+        appendInt(airports.id(routes.target(e)), out);
+        out += "</airportID>\n\t\t\t<airportCode>";
+        appendXMLEscaped(airports.code(routes.target(e)), out);
+        out += "</airportCode>\n\t\t\t<carrierID>";
+        appendInt(routes.carrier(e), out);
+        out += "</carrierID>\n\t\t\t<carrierName>";
+        appendXMLEscaped(tables.carriers->name(routes.carrier(e)), out);
+        out += "</carrierName>\n\t\t\t<distance>";
+        appendShortDouble(routes.weight(e), out);
+        out += "</distance>\n\t\t</edge>\n";
+    }
+    out += "\t</edges>\n</vertex>\n";
+}
+
+void XMLExporter::appendFooter(const exportTables &, string &) const {
+}
+
+/// JSON LINES
+///
+
+void JSONLinesExporter::appendHeader(const exportTables &, string &) const {
+}
+
+void JSONLinesExporter::appendAirport(const exportTables &tables, uint32_t index, string &out) const {
+    const AirportTable &airports = *tables.airports;
+    const RouteGraph &routes = *tables.routes;
+
+    out += "{\"id\":";
+    appendInt(airports.id(index), out);
+    out += ",\"code\":\"";
+    appendJSONEscaped(airports.code(index), out);
+    out += "\",\"name\":\"";
+    appendJSONEscaped(airports.name(index), out);
+    out += "\",\"city\":\"";
+    appendJSONEscaped(airports.city(index), out);
+    out += "\",\"latitude\":";
+    appendExactDouble(airports.latitude(index), out);
+    out += ",\"longitude\":";
+    appendExactDouble(airports.longitude(index), out);
+    out += ",\"routes\":[";
+    for(uint32_t e = routes.edgeBegin(index); e < routes.edgeEnd(index); ++e) {
+        if(e != routes.edgeBegin(index))
+            out += ',';
+        out += "{\"airportId\":";
+        appendInt(airports.id(routes.target(e)), out);
+        out += ",\"airportCode\":\"";
+        appendJSONEscaped(airports.code(routes.target(e)), out);
+        out += "\",\"carrierId\":";
+        appendInt(routes.carrier(e), out);
+        out += ",\"carrierName\":\"";
+        appendJSONEscaped(tables.carriers->name(routes.carrier(e)), out);
+        out += "\",\"distance\":";
+        appendExactDouble(routes.weight(e), out);
+        out += '}';
+    }
+    out += "]}\n";
+}
+
+void JSONLinesExporter::appendFooter(const exportTables &, string &) const {
+}
+
+/// BINARY EDGE LIST
+///
+
+void BinaryEdgeExporter::appendHeader(const exportTables &tables, string &out) const {
+    out.append(EDGE_LIST_MAGIC, sizeof(EDGE_LIST_MAGIC));
+    appendRaw(uint32_t(tables.airports->size()), out);
+    appendRaw(uint64_t(tables.routes->edgeCount()), out);
+}
+
+void BinaryEdgeExporter::appendAirport(const exportTables &tables, uint32_t index, string &out) const {
+    const AirportTable &airports = *tables.airports;
+    const RouteGraph &routes = *tables.routes;
+    int32_t sourceId = airports.id(index);
+    for(uint32_t e = routes.edgeBegin(index); e < routes.edgeEnd(index); ++e) {
+        appendRaw(sourceId, out);
+        appendRaw(int32_t(airports.id(routes.target(e))), out);
+        appendRaw(int32_t(routes.carrier(e)), out);
+        appendRaw(float(routes.weight(e)), out);
+    }
+}
+
+void BinaryEdgeExporter::appendFooter(const exportTables &, string &) const {
+}
@@ -0,0 +1,74 @@
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include "routegraph.h"
+#include "metadata.h"
+#include "threadpool.h"
+
+#ifndef GRAPHEXPORT_H
+#define GRAPHEXPORT_H
+
+enum exportFormats {
+    EXPORT_XML,         // The <vertex>/<edges> layout of writeCSVToXML
+    EXPORT_JSON_LINES,  // One JSON object per airport, routes included
+    EXPORT_BINARY       // Header, then one fixed size record per route
+};
+
+// Tables an exporter reads
+struct exportTables {
+    const AirportTable *airports;
+    const CarrierTable *carriers;
+    const RouteGraph *routes;
+};
+
+// Serializes the graph one airport at a time into a string
+// Airports are appended from several threads at once (each into its own string),
+// so implementations must not keep any state between calls
+class GraphExporter {
+
+public:
+
+    virtual ~GraphExporter() {}
+
+    virtual void appendHeader(const exportTables &tables, std::string &out) const = 0;
+    virtual void appendAirport(const exportTables &tables, uint32_t index, std::string &out) const = 0;
+    virtual void appendFooter(const exportTables &tables, std::string &out) const = 0;
+};
+
+class XMLExporter : public GraphExporter {
+
+public:
+
+    void appendHeader(const exportTables &tables, std::string &out) const;
+    void appendAirport(const exportTables &tables, uint32_t index, std::string &out) const;
+    void appendFooter(const exportTables &tables, std::string &out) const;
+};
+
+class JSONLinesExporter : public GraphExporter {
+
+public:
+
+    void appendHeader(const exportTables &tables, std::string &out) const;
+    void appendAirport(const exportTables &tables, uint32_t index, std::string &out) const;
+    void appendFooter(const exportTables &tables, std::string &out) const;
+};
+
+// Magic "FPEDGES1", airport count (uint32), route count (uint64), then per route:
+// source airport id, target airport id, airline id (int32 each) and distance in miles (float32)
+class BinaryEdgeExporter : public GraphExporter {
+
+public:
+
+    void appendHeader(const exportTables &tables, std::string &out) const;
+    void appendAirport(const exportTables &tables, uint32_t index, std::string &out) const;
+    void appendFooter(const exportTables &tables, std::string &out) const;
+};
+
+void exportGraph(const exportTables &tables, const GraphExporter &exporter, ThreadPool &pool, std::ostream &out);
+
+void appendXMLEscaped(std::string_view text, std::string &out);
+void appendJSONEscaped(std::string_view text, std::string &out);
+
+#endif // GRAPHEXPORT_H
@@ -0,0 +1,63 @@
+#include "itinerary.h"
+
+using namespace std;
+
+Itinerary::Itinerary() : totalDistance(0) {
+}
+
+Itinerary::Itinerary(shared_ptr<const AirportTable> airports, shared_ptr<const CarrierTable> carriers)
+    : airports(airports), carriers(carriers), totalDistance(0) {
+}
+
+// Appends a flight, which must leave from where the previous one arrived
+void Itinerary::addLeg(itineraryLeg leg) {
+    totalDistance += leg.distance;
+    legs.push_back(move(leg));
+}
+
+// Lists the airports flown through, from the origin to the destination
+vector<uint32_t> Itinerary::airportPath() const {
+    vector<uint32_t> path;
+    if(legs.empty())
+        return path;
+    path.push_back(legs[0].from);
+    for(size_t i = 0; i < legs.size(); ++i)
+        path.push_back(legs[i].to);
+    return path;
+}
+
+// Creates a vector of string, with the directions/itinerary in order
+// For example: [0] : "Start from Starting Airport"
+// [1] : "Fly to Other Airport for x miles using\n
+//           - Airline 1
+//           - Airline 2...
+// [2] : Arrive at Ending Airport
+vector<string> Itinerary::format() const {
+    vector<string> lines;
+    if(legs.empty())
+        return lines;
+    lines.push_back("Start from " + string(airportCode(legs[0].from)) + " (" + string(airportName(legs[0].from)) + ")");
+
+    // Input varies on whether there are multiple airlines or just one
+    for(size_t i = 0; i < legs.size(); ++i) {
+        const itineraryLeg &flight = legs[i];
+        string line = "Fly to " + string(airportCode(flight.to)) + " (" + string(airportName(flight.to))
+                    + ") over " + to_string((int)flight.distance) + " miles using";
+        if(flight.carrierIds.size() == 1) {
+            line += " ";
+            line += carrierName(flight.carrierIds[0]);
+        }
+        else {
+            line += " one of the following:";
+            for(size_t j = 0; j < flight.carrierIds.size(); ++j) {
+                line += "\n  - ";
+                line += carrierName(flight.carrierIds[j]);
+            }
+        }
+        lines.push_back(line);
+    }
+
+    uint32_t destination = legs.back().to;
+    lines.push_back("Arrive at " + string(airportCode(destination)) + " (" + string(airportName(destination)) + ")");
+    return lines;
+}
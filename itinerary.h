@@ -0,0 +1,54 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "metadata.h"
+
+#ifndef ITINERARY_H
+#define ITINERARY_H
+
+// One flight of an Itinerary, between two dense airport indices
+struct itineraryLeg {
+    uint32_t from;
+    uint32_t to;
+    double distance;
+    std::vector<int32_t> carrierIds; // OpenFlights ids of the airlines flying it, in the order of the route data
+};
+
+// Path found by a query, kept as airport indices and airline ids rather than text
+// It shares the tables of the graph version it was found in, so it reads the same
+// after the graph is updated, and names are only looked up when asked for
+class Itinerary {
+
+public:
+
+    Itinerary();
+    Itinerary(std::shared_ptr<const AirportTable> airports, std::shared_ptr<const CarrierTable> carriers);
+
+    void addLeg(itineraryLeg leg);
+
+    bool empty() const { return legs.empty(); }
+    size_t legCount() const { return legs.size(); }
+    const itineraryLeg &leg(size_t index) const { return legs[index]; }
+    const std::vector<itineraryLeg> &getLegs() const { return legs; }
+    double distance() const { return totalDistance; }
+    std::vector<uint32_t> airportPath() const;
+
+    std::string_view airportCode(uint32_t airport) const { return airports->code(airport); }
+    std::string_view airportName(uint32_t airport) const { return airports->name(airport); }
+    std::string_view carrierName(int carrierId) const { return carriers->name(carrierId); }
+
+    std::vector<std::string> format() const;
+
+
+private:
+
+    std::shared_ptr<const AirportTable> airports;
+    std::shared_ptr<const CarrierTable> carriers;
+    std::vector<itineraryLeg> legs;
+    double totalDistance;
+};
+
+#endif // ITINERARY_H
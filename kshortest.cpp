@@ -0,0 +1,163 @@
+#include "kshortest.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+using namespace std;
+
+KShortestPathSearch::KShortestPathSearch() : generation(0), spurSearches(0) {
+    treeSearch.setAlgorithm(DIJKSTRA_INDEXED_HEAP);
+}
+
+// Finds up to "k" loopless paths from "source" to "target", shortest first
+// "reverse" must be the reversed route graph that "graph" was merged from
+// Each new path is the shortest candidate that leaves an earlier path at some spur airport:
+// it keeps that path's airports up to the spur, and avoids every route out of the spur
+// that an earlier path with the same start already took
+void KShortestPathSearch::run(const CarrierGraph &graph, const RouteGraph &reverse, uint32_t source, uint32_t target, size_t k) {
+    paths.clear();
+    distances.clear();
+    candidates.clear();
+    seenPaths.clear();
+    spurSearches = 0;
+
+    searchGraphs graphs = {&reverse, nullptr, nullptr, nullptr, nullptr, nullptr};
+    treeSearch.run(graphs, target, nullptr, 0);
+    if(k == 0 || source == target || !treeSearch.isSettled(source))
+        return;
+
+    // The tree already holds a shortest path, walking parents toward the target
+    vector<uint32_t> first;
+    for(uint32_t node = source; node != ShortestPathSearch::NO_PARENT; node = treeSearch.parent(node))
+        first.push_back(node);
+    paths.push_back(first);
+    distances.push_back(pathDistance(graph, first));
+    seenPaths.insert(first);
+
+    while(paths.size() < k) {
+        const vector<uint32_t> last = paths.back();
+        for(size_t i = 0; i + 1 < last.size(); ++i) {
+            uint32_t spur = last[i];
+            beginSpur(graph.nodeCount());
+            for(size_t j = 0; j < i; ++j)
+                blockedIn[last[j]] = generation;
+            for(size_t p = 0; p < paths.size(); ++p) {
+                if(paths[p].size() > i + 1 && equal(last.begin(), last.begin() + i + 1, paths[p].begin()))
+                    blockedTargets.push_back(paths[p][i + 1]);
+            }
+            if(!findSpurPath(graph, spur, target))
+                continue;
+
+            vector<uint32_t> candidate(last.begin(), last.begin() + i);
+            candidate.insert(candidate.end(), spurPath.begin(), spurPath.end());
+            if(seenPaths.insert(candidate).second)
+                candidates.insert(make_pair(pathDistance(graph, candidate), candidate));
+        }
+
+        if(candidates.empty())
+            break;
+        paths.push_back(candidates.begin()->second);
+        distances.push_back(candidates.begin()->first);
+        candidates.erase(candidates.begin());
+    }
+}
+
+// Starts a new generation of spur scratch arrays, growing them only when the graph did
+void KShortestPathSearch::beginSpur(size_t nodeCount) {
+    if(reachedIn.size() != nodeCount || generation == UINT32_MAX) {
+        reachedIn.assign(nodeCount, 0);
+        blockedIn.assign(nodeCount, 0);
+        settledIn.assign(nodeCount, 0);
+        spurDistances.resize(nodeCount);
+        spurParents.resize(nodeCount);
+        generation = 0;
+    }
+    ++generation;
+    blockedTargets.clear();
+}
+
+// True if the route "from" -> "to" was removed for the current spur search
+bool KShortestPathSearch::isBlockedRoute(uint32_t from, uint32_t to, uint32_t spur) const {
+    if(blockedIn[to] == generation)
+        return true;
+    return from == spur && find(blockedTargets.begin(), blockedTargets.end(), to) != blockedTargets.end();
+}
+
+// Fills "spurPath" with the shortest path from "spur" to "target" that avoids the removed airports and routes
+// Returns false if there is none
+bool KShortestPathSearch::findSpurPath(const CarrierGraph &graph, uint32_t spur, uint32_t target) {
+    spurPath.clear();
+    if(!treeSearch.isSettled(spur))
+        return false;
+
+    // The tree's path is as short as any path can be, so it wins whenever it is still allowed
+    uint32_t node = spur;
+    spurPath.push_back(node);
+    while(node != target) {
+        uint32_t next = treeSearch.parent(node);
+        if(isBlockedRoute(node, next, spur))
+            break;
+        spurPath.push_back(next);
+        node = next;
+    }
+    if(node == target)
+        return true;
+
+    // A* search, ordered by distance so far plus the exact distance left in the unmodified graph
+    ++spurSearches;
+    spurPath.clear();
+    heap.clear();
+    reachedIn[spur] = generation;
+    spurDistances[spur] = 0;
+    heap.push_back(queueEntry(treeSearch.distance(spur), spur));
+
+    bool found = false;
+    while(!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), greater<queueEntry>());
+        uint32_t next = heap.back().second;
+        heap.pop_back();
+        if(settledIn[next] == generation)
+            continue;
+        settledIn[next] = generation;
+        if(next == target) {
+            found = true;
+            break;
+        }
+
+        for(uint32_t e = graph.edgeBegin(next); e < graph.edgeEnd(next); ++e) {
+            uint32_t neighbor = graph.target(e);
+            if(settledIn[neighbor] == generation || !treeSearch.isSettled(neighbor) || isBlockedRoute(next, neighbor, spur))
+                continue;
+            double candidate = spurDistances[next] + graph.weight(e);
+            if(reachedIn[neighbor] != generation || candidate < spurDistances[neighbor]) {
+                reachedIn[neighbor] = generation;
+                spurDistances[neighbor] = candidate;
+                spurParents[neighbor] = next;
+                heap.push_back(queueEntry(candidate + treeSearch.distance(neighbor), neighbor));
+                push_heap(heap.begin(), heap.end(), greater<queueEntry>());
+            }
+        }
+    }
+    if(!found)
+        return false;
+
+    for(uint32_t current = target; current != spur; current = spurParents[current])
+        spurPath.push_back(current);
+    spurPath.push_back(spur);
+    reverse(spurPath.begin(), spurPath.end());
+    return true;
+}
+
+// Sums the route lengths along "nodes" from the start, the same way a Dijkstra search would
+double KShortestPathSearch::pathDistance(const CarrierGraph &graph, const vector<uint32_t> &nodes) const {
+    double total = 0;
+    for(size_t i = 1; i < nodes.size(); ++i) {
+        double shortest = numeric_limits<double>::infinity();
+        for(uint32_t e = graph.edgeBegin(nodes[i - 1]); e < graph.edgeEnd(nodes[i - 1]); ++e) {
+            if(graph.target(e) == nodes[i])
+                shortest = min(shortest, graph.weight(e));
+        }
+        total += shortest;
+    }
+    return total;
+}
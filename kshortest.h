@@ -0,0 +1,63 @@
+#include <vector>
+#include <set>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "routegraph.h"
+#include "carriergraph.h"
+#include "pathsearch.h"
+
+#ifndef KSHORTEST_H
+#define KSHORTEST_H
+
+// The k shortest loopless paths between two airports, by Yen's algorithm
+// Paths are sequences of airports, so parallel routes are taken from the merged CarrierGraph
+// One search from the target over the reversed graph gives the exact distance to the target from
+// every airport: it yields the first path directly, and is the A* estimate of every spur search,
+// which can never be too high since spur searches only ever remove airports and routes
+// Where the tree's own path from a spur airport avoids everything removed, it is used with no search
+// Like ShortestPathSearch, one instance answers many queries in a row with reusable scratch arrays
+class KShortestPathSearch {
+
+public:
+
+    KShortestPathSearch();
+
+    void run(const CarrierGraph &graph, const RouteGraph &reverse, uint32_t source, uint32_t target, size_t k);
+
+    // Results of the last search, shortest first
+    size_t pathCount() const { return paths.size(); }
+    const std::vector<uint32_t> &path(size_t index) const { return paths[index]; }
+    double distance(size_t index) const { return distances[index]; }
+    size_t spurSearchCount() const { return spurSearches; }
+
+
+private:
+
+    typedef std::pair<double, uint32_t> queueEntry;
+
+    ShortestPathSearch treeSearch; // Search from the target over the reversed graph
+    std::vector<std::vector<uint32_t>> paths;
+    std::vector<double> distances;
+    std::set<std::pair<double, std::vector<uint32_t>>> candidates;
+    std::set<std::vector<uint32_t>> seenPaths;
+
+    // Spur search scratch arrays, only meaningful where reachedIn[node] == generation
+    uint32_t generation;
+    std::vector<uint32_t> reachedIn;
+    std::vector<uint32_t> blockedIn;
+    std::vector<uint32_t> settledIn;
+    std::vector<double> spurDistances;
+    std::vector<uint32_t> spurParents;
+    std::vector<queueEntry> heap;
+    std::vector<uint32_t> blockedTargets; // Routes out of the spur airport that are removed
+    std::vector<uint32_t> spurPath;
+    size_t spurSearches;
+
+    void beginSpur(size_t nodeCount);
+    bool findSpurPath(const CarrierGraph &graph, uint32_t spur, uint32_t target);
+    bool isBlockedRoute(uint32_t from, uint32_t to, uint32_t spur) const;
+    double pathDistance(const CarrierGraph &graph, const std::vector<uint32_t> &nodes) const;
+};
+
+#endif // KSHORTEST_H
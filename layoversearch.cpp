@@ -0,0 +1,120 @@
+#include "layoversearch.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+using namespace std;
+
+LayoverSearch::LayoverSearch()
+    : generation(0), target(0), maxFlights(0), stateWidth(1), settledStates(0) {
+}
+
+// Settles (airport, flights) states outward from "source" in order of distance
+// Each time the target is settled with fewer flights than before, that is the shortest path
+// for its flight count, and also for every larger count up to the next one found
+// Stops after a direct flight to the target, since no path can have fewer flights
+void LayoverSearch::run(const RouteGraph &graph, uint32_t source, uint32_t target, uint32_t maxLayovers) {
+    this->target = target;
+    size_t nodeCount = graph.nodeCount();
+    maxFlights = clampLayovers(nodeCount, maxLayovers) + 1;
+    stateWidth = maxFlights + 1;
+    beginSearch(nodeCount);
+
+    size_t sourceState = size_t(source) * stateWidth;
+    reachedIn[sourceState] = generation;
+    distances[sourceState] = 0;
+    parents[sourceState] = NO_PARENT;
+    heap.push_back(heapEntry{0, sourceState});
+
+    while(!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), greater<heapEntry>());
+        heapEntry next = heap.back();
+        heap.pop_back();
+        if(next.distance > distances[next.state])
+            continue;
+
+        uint32_t node = uint32_t(next.state / stateWidth);
+        uint32_t flights = uint32_t(next.state % stateWidth);
+        if(settledIn[node] == generation && fewestFlights[node] <= flights)
+            continue;
+        settledIn[node] = generation;
+        fewestFlights[node] = flights;
+        ++settledStates;
+
+        if(node == target) {
+            targetFlights.push_back(flights);
+            if(flights <= 1)
+                break;
+            continue;
+        }
+        if(flights == maxFlights)
+            continue;
+
+        for(uint32_t e = graph.edgeBegin(node); e < graph.edgeEnd(node); ++e) {
+            uint32_t neighbor = graph.target(e);
+            if(settledIn[neighbor] == generation && fewestFlights[neighbor] <= flights + 1)
+                continue;
+            size_t state = size_t(neighbor) * stateWidth + flights + 1;
+            double candidate = next.distance + graph.weight(e);
+            if(reachedIn[state] != generation || candidate < distances[state]) {
+                reachedIn[state] = generation;
+                distances[state] = candidate;
+                parents[state] = node;
+                heap.push_back(heapEntry{candidate, state});
+                push_heap(heap.begin(), heap.end(), greater<heapEntry>());
+            }
+        }
+    }
+}
+
+// Returns infinity if no path has at most "layovers" layovers
+double LayoverSearch::distance(uint32_t layovers) const {
+    uint32_t flights = bestFlights(layovers);
+    if(flights == NO_PARENT)
+        return numeric_limits<double>::infinity();
+    return distances[size_t(target) * stateWidth + flights];
+}
+
+// Walks the parents back from the target, one flight at a time
+// The returned deque is ordered from the source to the target, and is empty if nothing was found
+deque<uint32_t> LayoverSearch::pathTo(uint32_t layovers) const {
+    deque<uint32_t> path;
+    uint32_t flights = bestFlights(layovers);
+    if(flights == NO_PARENT)
+        return path;
+    for(uint32_t node = target; node != NO_PARENT; --flights) {
+        path.push_front(node);
+        node = parents[size_t(node) * stateWidth + flights];
+    }
+    return path;
+}
+
+// Starts a new generation, only (re)filling the arrays when they are too small or the counter wrapped
+void LayoverSearch::beginSearch(size_t nodeCount) {
+    size_t stateCount = nodeCount * stateWidth;
+    if(reachedIn.size() < stateCount || settledIn.size() != nodeCount || generation == UINT32_MAX) {
+        reachedIn.assign(max(reachedIn.size(), stateCount), 0);
+        distances.resize(reachedIn.size());
+        parents.resize(reachedIn.size());
+        settledIn.assign(nodeCount, 0);
+        fewestFlights.resize(nodeCount);
+        generation = 0;
+    }
+    ++generation;
+    heap.clear();
+    targetFlights.clear();
+    settledStates = 0;
+}
+
+// The target was settled with fewer flights each time, at a longer distance,
+// so the first one within the limit is the shortest
+uint32_t LayoverSearch::bestFlights(uint32_t layovers) const {
+    if(maxFlights == 0)
+        return NO_PARENT;
+    layovers = min(layovers, maxFlights - 1);
+    for(size_t i = 0; i < targetFlights.size(); ++i) {
+        if(targetFlights[i] <= layovers + 1)
+            return targetFlights[i];
+    }
+    return NO_PARENT;
+}
@@ -0,0 +1,78 @@
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+#include "routegraph.h"
+
+#ifndef LAYOVERSEARCH_H
+#define LAYOVERSEARCH_H
+
+// Shortest paths with a limited number of layovers, found by Dijkstra over (airport, flights taken) states
+// A state is dominated, and never expanded, once the same airport was settled with no more flights,
+// since Dijkstra settles states in order of distance and that earlier state is no longer
+// One search yields the shortest path for every layover limit from 0 up to "maxLayovers"
+// Limits above nodeCount - 2 are searched as nodeCount - 2: no path without a repeated airport takes
+// more flights, and a shortest path never repeats one
+// Like ShortestPathSearch, one instance answers many searches in a row with reusable scratch arrays
+class LayoverSearch {
+
+public:
+
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    LayoverSearch();
+
+    void run(const RouteGraph &graph, uint32_t source, uint32_t target, uint32_t maxLayovers);
+
+    // Layover limit a search of a graph of "nodeCount" airports actually tells apart for "maxLayovers"
+    static uint32_t clampLayovers(size_t nodeCount, uint32_t maxLayovers) {
+        return uint32_t(std::min<size_t>(maxLayovers, nodeCount < 2 ? 0 : nodeCount - 2));
+    }
+
+    // Largest layover limit the last search told apart, its "maxLayovers" after clamping
+    uint32_t layoverLimit() const { return maxFlights - 1; }
+
+    // Results of the last search, for paths with at most "layovers" layovers
+    // Limits above layoverLimit() get the answer of layoverLimit()
+    bool isFound(uint32_t layovers) const { return bestFlights(layovers) != NO_PARENT; }
+    double distance(uint32_t layovers) const;
+    std::deque<uint32_t> pathTo(uint32_t layovers) const;
+    size_t settledCount() const { return settledStates; }
+
+
+private:
+
+    struct heapEntry {
+        double distance;
+        size_t state;
+
+        friend
+        bool operator>(const heapEntry &a, const heapEntry &b) {
+            return a.distance > b.distance || (a.distance == b.distance && a.state > b.state);
+        }
+    };
+
+    uint32_t generation;
+    uint32_t target;
+    uint32_t maxFlights;  // maxLayovers + 1
+    uint32_t stateWidth;  // States per airport, one for each flight count 0..maxFlights
+
+    // State scratch arrays, indexed by airport * stateWidth + flights (worked out in size_t, it can pass 2^32)
+    std::vector<uint32_t> reachedIn;
+    std::vector<double> distances;
+    std::vector<uint32_t> parents;
+
+    // Airport scratch arrays: the fewest flights any settled state of the airport took
+    std::vector<uint32_t> settledIn;
+    std::vector<uint32_t> fewestFlights;
+
+    std::vector<heapEntry> heap;
+    std::vector<uint32_t> targetFlights; // Flight counts the target was settled with, most first
+    size_t settledStates;
+
+    void beginSearch(size_t nodeCount);
+    uint32_t bestFlights(uint32_t layovers) const;
+};
+
+#endif // LAYOVERSEARCH_H
@@ -0,0 +1,209 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// Airports most routes touch, paired at random when no request file is given
+const char *const HUB_CODES[] = {
+    "ATL", "PEK", "DXB", "LAX", "HND", "ORD", "LHR", "HKG", "PVG", "CDG", "AMS", "DFW", "CAN", "FRA",
+    "IST", "DEL", "CGK", "SIN", "ICN", "DEN", "BKK", "JFK", "KUL", "SFO", "MAD", "CTU", "LAS", "BCN",
+    "BOM", "YYZ", "SEA", "CLT", "LGW", "SZX", "TPE", "MEX", "KMG", "MUC", "MCO", "MIA", "PHX", "SYD",
+    "EWR", "MNL", "SHA", "FCO", "NRT", "IAH", "GRU", "SVO", "JNB", "ZRH", "CPH", "OSL", "DUB", "VIE"
+};
+
+// A client never has more requests in flight than this, so the server's answers always fit
+// in what it queues per client, and neither side can stall the other
+const size_t MAX_WINDOW = 1024;
+
+// What one client thread measured
+struct clientResult {
+    size_t answered;
+    size_t failed;     // Answers with "ok":false
+    bool isConnected;  // False if the connection could not be made or broke early
+    vector<double> latencies; // Milliseconds from sending each request to reading its answer
+};
+
+/// Prototypes - - - - - - - - -
+///
+void runClient(const string &socketPath, const vector<string> &requests, size_t requestCount,
+               size_t window, unsigned seed, clientResult &result);
+bool writeAll(int fd, const string &data);
+double percentile(const vector<double> &sorted, double fraction);
+
+/// Functions - - - - - - - - - -
+///
+// Usage: loadgen SOCKET [--clients C] [--requests N] [--window W] [--pairs FILE] [--seed S]
+//   Opens C connections to a "main --serve SOCKET" server, and has each one send N requests,
+//   keeping up to W of them in flight (pipelined) at a time
+//   --pairs FILE : request lines to pick from at random, instead of random pairs of hub airports
+// Prints the throughput and the latency percentiles over every request
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        cerr << "Usage: loadgen SOCKET [--clients C] [--requests N] [--window W] [--pairs FILE] [--seed S]" << endl;
+        return 1;
+    }
+    string socketPath = argv[1];
+    size_t clientCount = 8, requestCount = 10000, window = 16;
+    unsigned seed = 1;
+    string pairsFile;
+    for(int i = 2; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if(option == "--clients")
+            clientCount = max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        else if(option == "--requests")
+            requestCount = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--window")
+            window = min(MAX_WINDOW, max(1ul, strtoul(argv[i + 1], nullptr, 10)));
+        else if(option == "--pairs")
+            pairsFile = argv[i + 1];
+        else if(option == "--seed")
+            seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    vector<string> requests;
+    if(!pairsFile.empty()) {
+        ifstream fin(pairsFile.c_str());
+        string line;
+        while(getline(fin, line)) {
+            if(!line.empty())
+                requests.push_back(line);
+        }
+        if(requests.empty()) {
+            cerr << "No requests in " << pairsFile << endl;
+            return 1;
+        }
+    }
+    else {
+        size_t hubCount = sizeof(HUB_CODES) / sizeof(HUB_CODES[0]);
+        for(size_t a = 0; a < hubCount; ++a) {
+            for(size_t b = 0; b < hubCount; ++b) {
+                if(a != b)
+                    requests.push_back(string(HUB_CODES[a]) + " " + HUB_CODES[b]);
+            }
+        }
+    }
+
+    vector<clientResult> results(clientCount);
+    vector<thread> clients;
+    steady_clock::time_point begin = steady_clock::now();
+    for(size_t i = 0; i < clientCount; ++i)
+        clients.push_back(thread(runClient, socketPath, cref(requests), requestCount, window, seed + i, ref(results[i])));
+    for(size_t i = 0; i < clientCount; ++i)
+        clients[i].join();
+    double seconds = duration<double>(steady_clock::now() - begin).count();
+
+    size_t answered = 0, failed = 0, brokenClients = 0;
+    vector<double> latencies;
+    for(size_t i = 0; i < clientCount; ++i) {
+        answered += results[i].answered;
+        failed += results[i].failed;
+        if(!results[i].isConnected)
+            ++brokenClients;
+        latencies.insert(latencies.end(), results[i].latencies.begin(), results[i].latencies.end());
+    }
+    sort(latencies.begin(), latencies.end());
+
+    cout << "clients " << clientCount << ", window " << window << ", " << answered << " answered ("
+         << failed << " errors) in " << seconds << " s" << endl;
+    if(brokenClients != 0)
+        cout << brokenClients << " clients could not connect or lost their connection" << endl;
+    if(latencies.empty())
+        return 1;
+    cout << "throughput " << answered / seconds << " requests/s" << endl;
+    cout << "latency ms: p50 " << percentile(latencies, 0.5) << ", p99 " << percentile(latencies, 0.99)
+         << ", p99.9 " << percentile(latencies, 0.999) << ", max " << latencies.back() << endl;
+    return brokenClients == 0 ? 0 : 1;
+}
+
+// Sends "requestCount" random picks of "requests" over one connection, keeping up to "window" in flight,
+// and times each one from when it was sent to when its answer line arrived
+void runClient(const string &socketPath, const vector<string> &requests, size_t requestCount,
+               size_t window, unsigned seed, clientResult &result) {
+    result.answered = 0;
+    result.failed = 0;
+    result.isConnected = false;
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return;
+    if(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return;
+    }
+    result.isConnected = true;
+
+    mt19937 random(seed);
+    uniform_int_distribution<size_t> pick(0, requests.size() - 1);
+    deque<steady_clock::time_point> sendTimes;
+    string batch, input;
+    char buffer[64 * 1024];
+    size_t sent = 0;
+    while(result.answered < requestCount) {
+        batch.clear();
+        while(sent < requestCount && sent - result.answered < window) {
+            batch += requests[pick(random)];
+            batch += '\n';
+            sendTimes.push_back(steady_clock::now());
+            ++sent;
+        }
+        if(!batch.empty() && !writeAll(fd, batch)) {
+            result.isConnected = false;
+            break;
+        }
+
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if(count <= 0) {
+            result.isConnected = false;
+            break;
+        }
+        input.append(buffer, count);
+
+        size_t lineStart = 0, lineEnd;
+        while((lineEnd = input.find('\n', lineStart)) != string::npos) {
+            steady_clock::time_point now = steady_clock::now();
+            result.latencies.push_back(duration<double, milli>(now - sendTimes.front()).count());
+            sendTimes.pop_front();
+            if(input.compare(lineStart, 10, "{\"ok\":true") != 0)
+                ++result.failed;
+            ++result.answered;
+            lineStart = lineEnd + 1;
+        }
+        input.erase(0, lineStart);
+    }
+    close(fd);
+}
+
+// Writes all of "data", returning false if the connection broke
+bool writeAll(int fd, const string &data) {
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if(count <= 0)
+            return false;
+        written += count;
+    }
+    return true;
+}
+
+// Value below which "fraction" of the sorted samples fall
+double percentile(const vector<double> &sorted, double fraction) {
+    size_t index = min(sorted.size() - 1, size_t(fraction * sorted.size()));
+    return sorted[index];
+}
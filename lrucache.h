@@ -0,0 +1,114 @@
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+// Running totals of a cache, since it was created or last reset
+struct cacheCounters {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// Thread-safe cache holding at most "capacity" entries, evicting the least recently used one
+// Values are copied in and out under the lock, so large values are best kept behind a shared_ptr
+// A capacity of 0 disables the cache
+template<typename Key, typename Value>
+class LRUCache {
+
+public:
+
+    LRUCache(size_t capacity) : capacity(capacity), counters{0, 0, 0} {}
+
+    // Copies "value" out and marks the entry as most recently used, if "key" is cached
+    bool find(const Key &key, Value &value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        typename std::unordered_map<Key, entryIterator>::iterator found = index.find(key);
+        if(found == index.end()) {
+            ++counters.misses;
+            return false;
+        }
+        ++counters.hits;
+        entries.splice(entries.begin(), entries, found->second);
+        value = found->second->second;
+        return true;
+    }
+
+    // Adds or replaces the entry of "key", evicting the least recently used entry when full
+    void insert(const Key &key, const Value &value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(capacity == 0)
+            return;
+        typename std::unordered_map<Key, entryIterator>::iterator found = index.find(key);
+        if(found != index.end()) {
+            found->second->second = value;
+            entries.splice(entries.begin(), entries, found->second);
+            return;
+        }
+        if(entries.size() == capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+        entries.push_front(std::make_pair(key, value));
+        index[key] = entries.begin();
+    }
+
+    // Drops every entry, keeping the counters
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+    }
+
+    // Changes the capacity, evicting the least recently used entries that no longer fit
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->capacity = capacity;
+        while(entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+    }
+
+    // Calls "visit(key, value)" on every entry under the lock, least recently used first,
+    // so inserting them in that order into another cache keeps their order of use
+    template<typename Visit>
+    void forEach(Visit visit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(typename std::list<std::pair<Key, Value>>::reverse_iterator entry = entries.rbegin(); entry != entries.rend(); ++entry)
+            visit(entry->first, entry->second);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    cacheCounters getCounters() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+
+private:
+
+    typedef typename std::list<std::pair<Key, Value>>::iterator entryIterator;
+
+    std::mutex mutex;
+    size_t capacity;
+    std::list<std::pair<Key, Value>> entries; // Most recently used first
+    std::unordered_map<Key, entryIterator> index;
+    cacheCounters counters;
+
+    LRUCache(const LRUCache &other);
+    LRUCache &operator=(const LRUCache &other);
+};
+
+#endif // LRUCACHE_H
@@ -1,115 +1,316 @@
-#include <iostream>
-#include "controller.h"
-
-using namespace std;
-
-/// Prototypes - - - - - - - - -
-///
-string getInput(const string &question, const bool &allCaps);
-void getStartEndAirports(string &startAirport, string &endAirport);
-void askToOutputXML(Controller &c);
-void printItinerary(const vector<string> &itinerary);
-bool isValidIATAFormat(const string &code);
-void capitalizeText(string &text);
-
-/// Functions - - - - - - - - - -
-///
-int main() {
-    Controller mainC("airports.dat", "airlines.dat", "routes.dat");
-    string startAirportCode, endAirportCode;
-    try {
-        getStartEndAirports(startAirportCode, endAirportCode);
-        printItinerary(mainC.getShortestPath(startAirportCode, endAirportCode));
-        askToOutputXML(mainC);
-    }
-    catch (CONTROLLER_ERRORS e) {
-        if(e == START_NOT_FOUND)
-            cout << "ERROR: Starting airport not found.";
-        else if(e == END_NOT_FOUND)
-            cout << "ERROR: Ending airport not found.";
-        else if(e == START_END_SAME)
-            cout << "ERROR: Start and ending airport is the same.";
-        else if(e == NO_ROUTE_FOUND)
-            cout << "ERROR: No possible route found. Airports may be non-commercial.";
-        else if(e == INVALID_FILENAME)
-            cout << "ERROR: Invalid filename. Must end with '.xml'";
-        cout << endl;
-    }
-    catch (...) {
-        cout << "ERROR: Unknown Error Occured!" << endl;
-    }
-    return 0;
-}
-
-// Asks user for start and end IATA code, while checking for errors in input
-void getStartEndAirports(string &startAirport, string &endAirport) {
-
-    bool valid = false;
-
-    while(!valid) {
-
-        startAirport = getInput("Insert IATA code of starting airport: ", true);
-        while(!isValidIATAFormat(startAirport)) {
-            startAirport = getInput("ERROR: Improper format. Try again: ", true);
-        }
-
-        endAirport = getInput("Insert IATA code of ending airport: ", true);
-        while(!isValidIATAFormat(endAirport)) {
-            endAirport = getInput("ERROR: Improper format. Try again: ", true);
-        }
-
-        valid = true;
-        if(startAirport == endAirport) {
-            cout << "ERROR: Can not be the same airport!" << endl;
-            valid = false;
-        }
-    }
-}
-
-// Asks user if they want to output all airport info to an XML
-void askToOutputXML(Controller &c) {
-    string input = getInput("Print all airport information to XML? (Y/N): ", false);
-    if(!input.empty() && toupper(input[0]) == 'Y') {
-        string filename = getInput("Print filename for XML (Must end in .xml): ", false);
-        c.writeCSVToXML(filename);
-    }
-    cout << "...Done" << endl << endl;
-}
-
-// Prints a vector of strings containing route instructions
-void printItinerary(const vector<string> &itinerary) {
-    cout << endl << " - - - ITINERARY - - - " << endl << endl;
-    for(size_t i = 0 ; i < itinerary.size(); ++i) {
-        cout << itinerary[i] << endl << endl;
-    }
-    cout << " - - - - - - - - - - - " << endl << endl;
-}
-
-// Asks for input using "question", and can return it in all caps
-string getInput(const string &question, const bool &allCaps) {
-    string line;
-    cout << question;
-    getline(cin, line);
-    if(allCaps)
-        capitalizeText(line);
-    return line;
-}
-
-// Returns true if string is 3 alphabetical characters (IATA style)
-bool isValidIATAFormat(const string &code) {
-    if(code.size() != 3)
-        return false;
-    bool isAllAlphabet = true;
-    for(size_t i = 0; i < code.size(); ++i)
-        if(!isalpha(code[i]))
-            isAllAlphabet = false;
-    return isAllAlphabet;
-}
-
-
-// Helper function: converts string to ALL CAPS
-void capitalizeText(string &text) {
-    for(size_t i = 0; i < text.size(); ++i)
-        text[i] = toupper(text[i]);
-}
-
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+#include <thread>
+#include "controller.h"
+#include "queryserver.h"
+
+using namespace std;
+
+// Most layovers --max-layovers takes, the same as the server's "layovers=" option
+const long MAX_LAYOVERS = 16;
+
+/// Prototypes - - - - - - - - -
+///
+string getInput(const string &question, const bool &allCaps);
+void getStartEndAirports(string &startAirport, string &endAirport);
+void askToOutputXML(Controller &c);
+void printItinerary(const vector<string> &itinerary);
+bool isValidIATAFormat(const string &code);
+void capitalizeText(string &text);
+vector<int> parseIdList(const string &list);
+void printRouteOptions(const vector<Itinerary> &options);
+void stopServer(int signalNumber);
+
+// Server that SIGINT and SIGTERM shut down, while one is running
+QueryServer *runningServer = nullptr;
+
+/// Functions - - - - - - - - - -
+///
+// Usage: main [--snapshot FILE] [--compile FILE] [--verify-ch PAIRS] [--matrix FILE] [--max-layovers K]
+//             [--allow-carriers IDS | --deny-carriers IDS] [--k-shortest K]
+//             [--export FILE] [--serve stdin|SOCKET] [--threads N] [--apply-delta FILE] [--stats]
+//   --snapshot FILE   : maps the prebuilt graph in FILE instead of parsing the .dat files
+//   --compile FILE    : builds the contraction hierarchy, writes it and the graph to the snapshot FILE and exits
+//   --verify-ch PAIRS : checks the contraction hierarchy against Dijkstra on PAIRS random pairs and exits
+//   --matrix FILE     : writes the distance between every pair of airports to FILE (CSV if it ends in .csv,
+//                       binary otherwise) and exits
+//   --max-layovers K  : only accepts itineraries with at most K layovers (0 to MAX_LAYOVERS)
+//   --allow-carriers IDS, --deny-carriers IDS : only flies (or never flies) the comma separated airline ids
+//   --k-shortest K    : prints the K shortest itineraries that do not visit an airport twice
+//   --export FILE     : writes every airport and route to FILE (XML if it ends in .xml, JSON Lines if it
+//                       ends in .jsonl, a binary edge list otherwise) and exits
+//   --serve stdin     : answers "START END [option]" lines from stdin with JSON lines on stdout, until stdin ends
+//   --serve SOCKET    : answers the same requests from any number of clients on the Unix domain socket SOCKET,
+//                       until interrupted
+//   --threads N       : worker threads answering server requests (one per core by default)
+//   --apply-delta FILE : applies the airport and route changes in FILE once the graph is loaded,
+//                        before doing anything else (including --compile)
+//   --stats           : prints the time and record counts of each load step, then the work each query did
+//                       (when serving, the totals over every query are printed on shutdown)
+// Exits with status 1 if --compile, --verify-ch, --matrix, --export, --serve or --apply-delta fails
+int main(int argc, char *argv[]) {
+    string snapshotFile, compileFile, matrixFile, exportFile, serveTarget, deltaFile;
+    size_t serverThreads = thread::hardware_concurrency();
+    size_t verifyPairs = 0;
+    long maxLayovers = -1;
+    size_t kShortest = 0;
+    carrierFilter filter;
+    bool isFiltered = false, showStats = false;
+    for(int i = 1; i < argc; i += 2) {
+        string option = argv[i];
+        if(option == "--stats") {
+            showStats = true;
+            --i; // Takes no value
+            continue;
+        }
+        if(i + 1 == argc)
+            break;
+        if(option == "--snapshot")
+            snapshotFile = argv[i + 1];
+        else if(option == "--compile")
+            compileFile = argv[i + 1];
+        else if(option == "--verify-ch")
+            verifyPairs = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--export")
+            exportFile = argv[i + 1];
+        else if(option == "--serve")
+            serveTarget = argv[i + 1];
+        else if(option == "--apply-delta")
+            deltaFile = argv[i + 1];
+        else if(option == "--threads")
+            serverThreads = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--matrix")
+            matrixFile = argv[i + 1];
+        else if(option == "--max-layovers") {
+            char *parsedEnd;
+            maxLayovers = strtol(argv[i + 1], &parsedEnd, 10);
+            if(parsedEnd == argv[i + 1] || *parsedEnd != '\0' || maxLayovers < 0 || maxLayovers > MAX_LAYOVERS) {
+                cout << "ERROR: --max-layovers takes a number from 0 to " << MAX_LAYOVERS << "." << endl;
+                return 1;
+            }
+        }
+        else if(option == "--k-shortest")
+            kShortest = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--allow-carriers" || option == "--deny-carriers") {
+            filter.mode = option == "--allow-carriers" ? ALLOW_CARRIERS : DENY_CARRIERS;
+            filter.carrierIds = parseIdList(argv[i + 1]);
+            isFiltered = true;
+        }
+    }
+
+    Controller mainC = snapshotFile.empty()
+                     ? Controller("airports.dat", "airlines.dat", "routes.dat")
+                     : Controller(snapshotFile, "airports.dat", "airlines.dat", "routes.dat");
+    if(!snapshotFile.empty() && !mainC.isSnapshotLoaded())
+        (serveTarget.empty() ? cout : cerr) << "NOTE: Snapshot missing, stale or corrupt. Loaded the .dat files instead." << endl;
+    if(showStats)
+        mainC.setStatsEnabled(true);
+
+    // Modes that run without prompting and exit, whose failures a script can only see in the exit status
+    bool isUnattended = !matrixFile.empty() || !compileFile.empty() || !exportFile.empty()
+                     || !deltaFile.empty() || !serveTarget.empty();
+    string startAirportCode, endAirportCode;
+    try {
+        if(!deltaFile.empty()) {
+            deltaCounts counts = mainC.applyDelta(deltaFile);
+            (serveTarget.empty() ? cout : cerr) << "Applied " << deltaFile << ": " << counts.airportsAdded << " airports added, "
+                << counts.airportsChanged << " changed, " << counts.routesAdded << " routes added, "
+                << counts.routesRemoved << " removed" << endl;
+        }
+        if(!serveTarget.empty()) {
+            QueryServer server(mainC, serverThreads);
+            runningServer = &server;
+            signal(SIGINT, stopServer);
+            signal(SIGTERM, stopServer);
+            if(serveTarget == "stdin")
+                server.serveStdio();
+            else {
+                cerr << "Listening on " << serveTarget << endl;
+                server.serveSocket(serveTarget);
+            }
+            runningServer = nullptr;
+            if(showStats)
+                mainC.writeStats(cerr);
+            return 0;
+        }
+        if(verifyPairs != 0)
+            return mainC.verifyHierarchy(verifyPairs, 1, cout) == 0 ? 0 : 1;
+        if(!exportFile.empty()) {
+            exportFormats format = EXPORT_BINARY;
+            if(exportFile.size() >= 4 && exportFile.substr(exportFile.size() - 4) == ".xml")
+                format = EXPORT_XML;
+            else if(exportFile.size() >= 6 && exportFile.substr(exportFile.size() - 6) == ".jsonl")
+                format = EXPORT_JSON_LINES;
+            mainC.exportGraph(exportFile, format);
+            cout << "Exported graph to " << exportFile << endl;
+            return 0;
+        }
+        if(!matrixFile.empty()) {
+            bool isCSV = matrixFile.size() >= 4 && matrixFile.substr(matrixFile.size() - 4) == ".csv";
+            mainC.writeDistanceMatrix(matrixFile, isCSV ? MATRIX_CSV : MATRIX_BINARY);
+            cout << "Wrote distance matrix to " << matrixFile << endl;
+            return 0;
+        }
+        if(!compileFile.empty()) {
+            mainC.buildHierarchy();
+            mainC.compile(compileFile);
+            cout << "Compiled graph snapshot to " << compileFile << endl;
+            return 0;
+        }
+        getStartEndAirports(startAirportCode, endAirportCode);
+        if(kShortest != 0)
+            printRouteOptions(mainC.getKShortestPaths(startAirportCode, endAirportCode, kShortest));
+        else if(isFiltered)
+            printItinerary(mainC.getShortestPath(startAirportCode, endAirportCode, filter));
+        else if(maxLayovers >= 0)
+            printItinerary(mainC.getShortestPathWithLayovers(startAirportCode, endAirportCode, maxLayovers));
+        else
+            printItinerary(mainC.getShortestPath(startAirportCode, endAirportCode));
+        askToOutputXML(mainC);
+    }
+    catch (CONTROLLER_ERRORS e) {
+        // Stdout carries the server protocol when serving
+        ostream &errorOut = serveTarget.empty() ? cout : cerr;
+        if(e == START_NOT_FOUND)
+            errorOut << "ERROR: Starting airport not found.";
+        else if(e == END_NOT_FOUND)
+            errorOut << "ERROR: Ending airport not found.";
+        else if(e == START_END_SAME)
+            errorOut << "ERROR: Start and ending airport is the same.";
+        else if(e == NO_ROUTE_FOUND)
+            errorOut << "ERROR: No possible route found. Airports may be non-commercial.";
+        else if(e == INVALID_FILENAME && !exportFile.empty())
+            errorOut << "ERROR: Could not write " << exportFile << ".";
+        else if(e == INVALID_FILENAME && !matrixFile.empty())
+            errorOut << "ERROR: Could not write " << matrixFile << ".";
+        else if(e == INVALID_FILENAME)
+            errorOut << "ERROR: Invalid filename. Must end with '.xml'";
+        else if(e == SNAPSHOT_NOT_WRITTEN)
+            errorOut << "ERROR: Could not write the graph snapshot.";
+        else if(e == SERVER_NOT_STARTED)
+            errorOut << "ERROR: Could not listen on the server socket.";
+        else if(e == DELTA_NOT_READ)
+            errorOut << "ERROR: Could not read the delta file.";
+        errorOut << endl;
+        if(isUnattended)
+            return 1;
+    }
+    catch (...) {
+        (serveTarget.empty() ? cout : cerr) << "ERROR: Unknown Error Occured!" << endl;
+        if(isUnattended)
+            return 1;
+    }
+    if(showStats)
+        mainC.writeStats(cout);
+    return 0;
+}
+
+// Asks user for start and end IATA code, while checking for errors in input
+void getStartEndAirports(string &startAirport, string &endAirport) {
+
+    bool valid = false;
+
+    while(!valid) {
+
+        startAirport = getInput("Insert IATA code of starting airport: ", true);
+        while(!isValidIATAFormat(startAirport)) {
+            startAirport = getInput("ERROR: Improper format. Try again: ", true);
+        }
+
+        endAirport = getInput("Insert IATA code of ending airport: ", true);
+        while(!isValidIATAFormat(endAirport)) {
+            endAirport = getInput("ERROR: Improper format. Try again: ", true);
+        }
+
+        valid = true;
+        if(startAirport == endAirport) {
+            cout << "ERROR: Can not be the same airport!" << endl;
+            valid = false;
+        }
+    }
+}
+
+// Asks user if they want to output all airport info to an XML
+void askToOutputXML(Controller &c) {
+    string input = getInput("Print all airport information to XML? (Y/N): ", false);
+    if(!input.empty() && toupper(input[0]) == 'Y') {
+        string filename = getInput("Print filename for XML (Must end in .xml): ", false);
+        c.writeCSVToXML(filename);
+    }
+    cout << "...Done" << endl << endl;
+}
+
+// Prints a vector of strings containing route instructions
+void printItinerary(const vector<string> &itinerary) {
+    cout << endl << " - - - ITINERARY - - - " << endl << endl;
+    for(size_t i = 0 ; i < itinerary.size(); ++i) {
+        cout << itinerary[i] << endl << endl;
+    }
+    cout << " - - - - - - - - - - - " << endl << endl;
+}
+
+// Prints alternative itineraries, one line per leg
+void printRouteOptions(const vector<Itinerary> &options) {
+    for(size_t i = 0; i < options.size(); ++i) {
+        cout << endl << " - - - OPTION " << i + 1 << ": " << (int)options[i].distance() << " miles - - - " << endl << endl;
+        for(size_t j = 0; j < options[i].legCount(); ++j) {
+            const itineraryLeg &leg = options[i].leg(j);
+            cout << options[i].airportCode(leg.from) << " -> " << options[i].airportCode(leg.to) << " (" << (int)leg.distance
+                 << " miles) using " << options[i].carrierName(leg.carrierIds[0]);
+            if(leg.carrierIds.size() > 1)
+                cout << " or " << leg.carrierIds.size() - 1 << " other airline(s)";
+            cout << endl;
+        }
+    }
+    cout << endl;
+}
+
+// Asks for input using "question", and can return it in all caps
+string getInput(const string &question, const bool &allCaps) {
+    string line;
+    cout << question;
+    getline(cin, line);
+    if(allCaps)
+        capitalizeText(line);
+    return line;
+}
+
+// Returns true if string is 3 alphabetical characters (IATA style)
+bool isValidIATAFormat(const string &code) {
+    if(code.size() != 3)
+        return false;
+    bool isAllAlphabet = true;
+    for(size_t i = 0; i < code.size(); ++i)
+        if(!isalpha(code[i]))
+            isAllAlphabet = false;
+    return isAllAlphabet;
+}
+
+
+// Helper function: converts string to ALL CAPS
+void capitalizeText(string &text) {
+    for(size_t i = 0; i < text.size(); ++i)
+        text[i] = toupper(text[i]);
+}
+
+
+// Helper function: splits a comma separated list of ids, skipping anything that is not a number
+vector<int> parseIdList(const string &list) {
+    vector<int> ids;
+    stringstream stream(list);
+    string field;
+    while(getline(stream, field, ',')) {
+        char *end;
+        long id = strtol(field.c_str(), &end, 10);
+        if(!field.empty() && *end == '\0')
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+// Signal handler: asks the running server to finish its current pass and return
+void stopServer(int) {
+    if(runningServer != nullptr)
+        runningServer->stop();
+}
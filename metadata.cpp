@@ -0,0 +1,443 @@
+#include "metadata.h"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+// Returns where "text" is in the character pool, appending it only if "interned" has not seen it yet
+// City names, airline names and blank fields repeat a lot, so each distinct string is stored once
+// "interned" views the strings passed in, so they must outlive it
+static stringRef internInPool(vector<char> &pool, unordered_map<string_view, stringRef> &interned, string_view text) {
+    pair<unordered_map<string_view, stringRef>::iterator, bool> inserted = interned.emplace(text, stringRef());
+    if(!inserted.second)
+        return inserted.first->second;
+    stringRef &ref = inserted.first->second;
+    ref.offset = pool.size();
+    ref.length = text.size();
+    pool.insert(pool.end(), text.begin(), text.end());
+    return ref;
+}
+
+// Base-26 value of a three letter code, or AirportTable::NOT_FOUND if it is anything else
+static uint32_t letterCodeValue(string_view code) {
+    if(code.size() != 3)
+        return AirportTable::NOT_FOUND;
+    uint32_t value = 0;
+    for(size_t i = 0; i < code.size(); ++i) {
+        if(code[i] < 'A' || code[i] > 'Z')
+            return AirportTable::NOT_FOUND;
+        value = value * 26 + (code[i] - 'A');
+    }
+    return value;
+}
+
+// Packs a code of one to four characters into an integer, or returns 0 if it is empty or longer
+static uint32_t packCode(string_view code) {
+    if(code.empty() || code.size() > 4)
+        return 0;
+    uint32_t packed = 0;
+    for(size_t i = 0; i < 4; ++i)
+        packed = (packed << 8) | (i < code.size() ? uint8_t(code[i]) : 0);
+    return packed;
+}
+
+// Finds "code" among entries sorted by packed code, returning its airport or AirportTable::NOT_FOUND
+static uint32_t findPackedCode(const FlatArray<codeEntry> &entries, string_view code) {
+    uint32_t packed = packCode(code);
+    if(packed == 0)
+        return AirportTable::NOT_FOUND;
+    const codeEntry *found = lower_bound(entries.begin(), entries.end(), packed, [](const codeEntry &entry, uint32_t key) {
+        return entry.code < key;
+    });
+    if(found == entries.end() || found->code != packed)
+        return AirportTable::NOT_FOUND;
+    return found->index;
+}
+
+// Whether "index" is the airport "entries" (sorted by packed code) give for the code "packed"
+static bool holdsPackedCode(const vector<codeEntry> &entries, uint32_t packed, uint32_t index) {
+    vector<codeEntry>::const_iterator found = lower_bound(entries.begin(), entries.end(), packed, [](const codeEntry &entry, uint32_t key) {
+        return entry.code < key;
+    });
+    return found != entries.end() && found->code == packed && found->index == index;
+}
+
+// Gives the code "packed" to "index" in "entries", unless an airport listed before it already has it
+static void addPackedCode(vector<codeEntry> &entries, uint32_t packed, uint32_t index) {
+    vector<codeEntry>::iterator found = lower_bound(entries.begin(), entries.end(), packed, [](const codeEntry &entry, uint32_t key) {
+        return entry.code < key;
+    });
+    if(found == entries.end() || found->code != packed)
+        entries.insert(found, codeEntry{packed, index});
+    else
+        found->index = min(found->index, index);
+}
+
+/// AIRPORT TABLE
+///
+
+AirportTable::AirportTable() : compactedPoolSize(0) {
+}
+
+// Packs airports into columns, keeping their order as their dense index
+// Also sorts an index array by id so ids can be looked up with a binary search, and indexes the codes
+void AirportTable::build(const vector<node> &airports) {
+    vector<int32_t> builtIds(airports.size());
+    vector<double> builtLatitudes(airports.size());
+    vector<double> builtLongitudes(airports.size());
+    vector<airportStrings> builtStrings(airports.size());
+    vector<char> builtPool;
+    unordered_map<string_view, stringRef> interned;
+    interned.reserve(airports.size() * 4);
+
+    for(size_t i = 0; i < airports.size(); ++i) {
+        builtIds[i] = airports[i].id;
+        builtLatitudes[i] = airports[i].latitude;
+        builtLongitudes[i] = airports[i].longitude;
+        builtStrings[i].name = internInPool(builtPool, interned, airports[i].name);
+        builtStrings[i].code = internInPool(builtPool, interned, airports[i].code);
+        builtStrings[i].city = internInPool(builtPool, interned, airports[i].city);
+        builtStrings[i].icao = internInPool(builtPool, interned, airports[i].icao);
+    }
+
+    vector<uint32_t> builtIdOrder(airports.size());
+    for(size_t i = 0; i < airports.size(); ++i)
+        builtIdOrder[i] = i;
+    stable_sort(builtIdOrder.begin(), builtIdOrder.end(), [&](uint32_t a, uint32_t b) {
+        return airports[a].id < airports[b].id;
+    });
+
+    ids.assign(move(builtIds));
+    latitudes.assign(move(builtLatitudes));
+    longitudes.assign(move(builtLongitudes));
+    strings.assign(move(builtStrings));
+    pool.assign(move(builtPool));
+    idOrder.assign(move(builtIdOrder));
+    compactedPoolSize = pool.size();
+    indexCodes();
+    geo.build(latitudes.data(), longitudes.data(), size());
+    spatial.build(latitudes.data(), longitudes.data(), size());
+}
+
+// Copies the table with the airports of "changed" (by dense index) replaced, and "added" appended
+// as new dense indices, keeping the index of every other airport
+// Replaced airports keep their id, and the strings they keep unchanged; their other old strings stay
+// unused in the pool until it has doubled since it was last packed, when every airport's strings are
+// interned into a new pool, so the pool stays bounded and packing costs are spread over the deltas
+// Only added airports are sorted, then merged into the existing id index, and only the codes that
+// changed move in the code indexes, unless an airport loses a code it held, which rebuilds them
+// Only the trig of moved and added airports is worked out again, and the spatial index is kept unless
+// an airport moved or was added, which rebuilds it for the whole table in a couple of milliseconds
+AirportTable AirportTable::withChanges(const vector<pair<uint32_t, node>> &changed, const vector<node> &added) const {
+    vector<int32_t> builtIds(ids.begin(), ids.end());
+    vector<double> builtLatitudes(latitudes.begin(), latitudes.end());
+    vector<double> builtLongitudes(longitudes.begin(), longitudes.end());
+    vector<airportStrings> builtStrings(strings.begin(), strings.end());
+    vector<char> builtPool(pool.begin(), pool.end());
+    vector<uint32_t> builtLetterCodes(letterCodes.begin(), letterCodes.end());
+    vector<codeEntry> builtOtherCodes(otherCodes.begin(), otherCodes.end());
+    vector<codeEntry> builtIcaoCodes(icaoCodes.begin(), icaoCodes.end());
+    unordered_map<string_view, stringRef> interned;
+    vector<uint32_t> movedAirports;
+    bool isReindexed = false;
+
+    // Keeps the old string of a field that did not change, otherwise interns the new one
+    auto internField = [&](const stringRef &old, bool isAdded, const string &text) {
+        if(!isAdded && view(old) == text)
+            return old;
+        return internInPool(builtPool, interned, text);
+    };
+
+    for(size_t i = 0; i < changed.size() + added.size(); ++i) {
+        bool isAdded = i >= changed.size();
+        const node &airport = isAdded ? added[i - changed.size()] : changed[i].second;
+        uint32_t index = isAdded ? builtIds.size() : changed[i].first;
+        if(isAdded) {
+            builtIds.push_back(airport.id);
+            builtLatitudes.push_back(airport.latitude);
+            builtLongitudes.push_back(airport.longitude);
+            builtStrings.push_back(airportStrings());
+        }
+        airportStrings old = builtStrings[index];
+        if(!isAdded && (builtLatitudes[index] != airport.latitude || builtLongitudes[index] != airport.longitude))
+            movedAirports.push_back(index);
+        builtLatitudes[index] = airport.latitude;
+        builtLongitudes[index] = airport.longitude;
+        builtStrings[index].name = internField(old.name, isAdded, airport.name);
+        builtStrings[index].code = internField(old.code, isAdded, airport.code);
+        builtStrings[index].city = internField(old.city, isAdded, airport.city);
+        builtStrings[index].icao = internField(old.icao, isAdded, airport.icao);
+
+        // Gives the airport its new codes; one that held an old code it lost leaves a gap only a rebuild fills
+        bool isCodeChanged = isAdded || view(old.code) != airport.code;
+        bool isIcaoChanged = isAdded || view(old.icao) != airport.icao;
+        if(!isAdded && isCodeChanged) {
+            uint32_t value = letterCodeValue(view(old.code));
+            isReindexed = isReindexed || (value != NOT_FOUND ? builtLetterCodes[value] == index
+                                                             : holdsPackedCode(builtOtherCodes, packCode(view(old.code)), index));
+        }
+        if(!isAdded && isIcaoChanged)
+            isReindexed = isReindexed || holdsPackedCode(builtIcaoCodes, packCode(view(old.icao)), index);
+        if(isCodeChanged) {
+            uint32_t value = letterCodeValue(airport.code);
+            if(value != NOT_FOUND)
+                builtLetterCodes[value] = min(builtLetterCodes[value], index);
+            else if(packCode(airport.code) != 0)
+                addPackedCode(builtOtherCodes, packCode(airport.code), index);
+        }
+        if(isIcaoChanged && packCode(airport.icao) != 0)
+            addPackedCode(builtIcaoCodes, packCode(airport.icao), index);
+    }
+
+    size_t packedSize = compactedPoolSize;
+    if(builtPool.size() > 2 * compactedPoolSize) {
+        vector<char> packedPool;
+        unordered_map<string_view, stringRef> packed;
+        packed.reserve(builtStrings.size() * 4);
+        for(size_t i = 0; i < builtStrings.size(); ++i) {
+            stringRef *refs[4] = {&builtStrings[i].name, &builtStrings[i].code, &builtStrings[i].city, &builtStrings[i].icao};
+            for(size_t j = 0; j < 4; ++j)
+                *refs[j] = internInPool(packedPool, packed, string_view(builtPool.data() + refs[j]->offset, refs[j]->length));
+        }
+        builtPool.swap(packedPool);
+        packedSize = builtPool.size();
+    }
+
+    auto byId = [&](uint32_t a, uint32_t b) {
+        return builtIds[a] < builtIds[b];
+    };
+
+    // Ids never change, so only the added airports join the id index
+    vector<uint32_t> addedIds;
+    for(size_t i = 0; i < added.size(); ++i)
+        addedIds.push_back(ids.size() + i);
+    sort(addedIds.begin(), addedIds.end(), byId);
+    vector<uint32_t> builtIdOrder(idOrder.size() + addedIds.size());
+    merge(idOrder.begin(), idOrder.end(), addedIds.begin(), addedIds.end(), builtIdOrder.begin(), byId);
+
+    AirportTable updated;
+    updated.ids.assign(move(builtIds));
+    updated.latitudes.assign(move(builtLatitudes));
+    updated.longitudes.assign(move(builtLongitudes));
+    updated.strings.assign(move(builtStrings));
+    updated.compactedPoolSize = packedSize;
+    updated.pool.assign(move(builtPool));
+    updated.idOrder.assign(move(builtIdOrder));
+    if(isReindexed)
+        updated.indexCodes();
+    else {
+        updated.letterCodes.assign(move(builtLetterCodes));
+        updated.otherCodes.assign(move(builtOtherCodes));
+        updated.icaoCodes.assign(move(builtIcaoCodes));
+    }
+    updated.geo = geo.withChanges(updated.latitudes.data(), updated.longitudes.data(), updated.size(), movedAirports);
+    if(movedAirports.empty() && added.empty())
+        updated.spatial = spatial;
+    else
+        updated.spatial.build(updated.latitudes.data(), updated.longitudes.data(), updated.size());
+    return updated;
+}
+
+void AirportTable::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_AIRPORT_IDS, ids);
+    writer.addSection(SECTION_AIRPORT_LATITUDES, latitudes);
+    writer.addSection(SECTION_AIRPORT_LONGITUDES, longitudes);
+    writer.addSection(SECTION_AIRPORT_STRINGS, strings);
+    writer.addSection(SECTION_AIRPORT_POOL, pool);
+    writer.addSection(SECTION_AIRPORT_LETTER_CODES, letterCodes);
+    writer.addSection(SECTION_AIRPORT_OTHER_CODES, otherCodes);
+    writer.addSection(SECTION_AIRPORT_ICAO_CODES, icaoCodes);
+    writer.addSection(SECTION_AIRPORT_ID_ORDER, idOrder);
+    geo.write(writer);
+    spatial.write(writer);
+}
+
+// Attaches every column to the snapshot, and checks that the columns agree with each other
+bool AirportTable::read(const SnapshotReader &reader) {
+    if(!reader.attachSection(SECTION_AIRPORT_IDS, ids)
+            || !reader.attachSection(SECTION_AIRPORT_LATITUDES, latitudes)
+            || !reader.attachSection(SECTION_AIRPORT_LONGITUDES, longitudes)
+            || !reader.attachSection(SECTION_AIRPORT_STRINGS, strings)
+            || !reader.attachSection(SECTION_AIRPORT_POOL, pool)
+            || !reader.attachSection(SECTION_AIRPORT_LETTER_CODES, letterCodes)
+            || !reader.attachSection(SECTION_AIRPORT_OTHER_CODES, otherCodes)
+            || !reader.attachSection(SECTION_AIRPORT_ICAO_CODES, icaoCodes)
+            || !reader.attachSection(SECTION_AIRPORT_ID_ORDER, idOrder))
+        return false;
+
+    size_t count = ids.size();
+    compactedPoolSize = pool.size();
+    if(!geo.read(reader, count) || !spatial.read(reader, count))
+        return false;
+    if(latitudes.size() != count || longitudes.size() != count || strings.size() != count
+            || letterCodes.size() != LETTER_CODE_COUNT || otherCodes.size() > count || icaoCodes.size() > count
+            || idOrder.size() != count)
+        return false;
+
+    for(size_t i = 0; i < count; ++i) {
+        const stringRef refs[4] = {strings[i].name, strings[i].code, strings[i].city, strings[i].icao};
+        for(size_t j = 0; j < 4; ++j) {
+            if(uint64_t(refs[j].offset) + refs[j].length > pool.size())
+                return false;
+        }
+        if(idOrder[i] >= count)
+            return false;
+    }
+    for(size_t i = 0; i < letterCodes.size(); ++i) {
+        if(letterCodes[i] != NOT_FOUND && letterCodes[i] >= count)
+            return false;
+    }
+    for(size_t i = 0; i < otherCodes.size(); ++i) {
+        if(otherCodes[i].index >= count)
+            return false;
+    }
+    for(size_t i = 0; i < icaoCodes.size(); ++i) {
+        if(icaoCodes[i].index >= count)
+            return false;
+    }
+    return true;
+}
+
+void AirportTable::clear() {
+    ids.clear();
+    latitudes.clear();
+    longitudes.clear();
+    strings.clear();
+    pool.clear();
+    letterCodes.clear();
+    otherCodes.clear();
+    icaoCodes.clear();
+    idOrder.clear();
+    geo.clear();
+    spatial.clear();
+    compactedPoolSize = 0;
+}
+
+// Returns the index of the first airport listed with the IATA "code", or NOT_FOUND
+uint32_t AirportTable::findCode(string_view code) const {
+    uint32_t value = letterCodeValue(code);
+    if(value != NOT_FOUND)
+        return letterCodes[value];
+    return findPackedCode(otherCodes, code);
+}
+
+// Returns the index of the first airport listed with the ICAO "code", or NOT_FOUND
+uint32_t AirportTable::findICAO(string_view code) const {
+    return findPackedCode(icaoCodes, code);
+}
+
+// Looks a code typed in a query up as an ICAO code when it has four characters, else as an IATA code
+uint32_t AirportTable::findAirport(string_view code) const {
+    return code.size() == 4 ? findICAO(code) : findCode(code);
+}
+
+// Returns the index of the airport with the OpenFlights "id", or NOT_FOUND
+uint32_t AirportTable::findId(int id) const {
+    const uint32_t *found = lower_bound(idOrder.begin(), idOrder.end(), id, [&](uint32_t index, int key) {
+        return ids[index] < key;
+    });
+    if(found == idOrder.end() || ids[*found] != id)
+        return NOT_FOUND;
+    return *found;
+}
+
+// Fills the code indexes from the strings of every airport
+// When airports share a code, the first one listed keeps it
+// Codes too long to pack (not real IATA or ICAO codes) are left out, like missing codes (\N)
+void AirportTable::indexCodes() {
+    vector<uint32_t> builtLetterCodes(LETTER_CODE_COUNT, NOT_FOUND);
+    vector<codeEntry> builtOtherCodes;
+    vector<codeEntry> builtIcaoCodes;
+    for(uint32_t index = 0; index < size(); ++index) {
+        uint32_t value = letterCodeValue(code(index));
+        if(value != NOT_FOUND) {
+            if(builtLetterCodes[value] == NOT_FOUND)
+                builtLetterCodes[value] = index;
+        }
+        else if(packCode(code(index)) != 0)
+            builtOtherCodes.push_back(codeEntry{packCode(code(index)), index});
+        if(packCode(icao(index)) != 0)
+            builtIcaoCodes.push_back(codeEntry{packCode(icao(index)), index});
+    }
+
+    // Entries are listed by index, so a stable sort keeps the first airport in front of a repeated code
+    auto byCode = [](const codeEntry &a, const codeEntry &b) {
+        return a.code < b.code;
+    };
+    auto sameCode = [](const codeEntry &a, const codeEntry &b) {
+        return a.code == b.code;
+    };
+    stable_sort(builtOtherCodes.begin(), builtOtherCodes.end(), byCode);
+    builtOtherCodes.erase(unique(builtOtherCodes.begin(), builtOtherCodes.end(), sameCode), builtOtherCodes.end());
+    stable_sort(builtIcaoCodes.begin(), builtIcaoCodes.end(), byCode);
+    builtIcaoCodes.erase(unique(builtIcaoCodes.begin(), builtIcaoCodes.end(), sameCode), builtIcaoCodes.end());
+
+    letterCodes.assign(move(builtLetterCodes));
+    otherCodes.assign(move(builtOtherCodes));
+    icaoCodes.assign(move(builtIcaoCodes));
+}
+
+/// CARRIER TABLE
+///
+
+// Sorts airlines by id, keeping only the first airline listed for a repeated id
+void CarrierTable::build(const vector<pair<int, string>> &airlines) {
+    vector<uint32_t> order(airlines.size());
+    for(size_t i = 0; i < airlines.size(); ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return airlines[a].first < airlines[b].first;
+    });
+
+    vector<int32_t> builtIds;
+    vector<stringRef> builtNames;
+    vector<char> builtPool;
+    unordered_map<string_view, stringRef> interned;
+    for(size_t i = 0; i < order.size(); ++i) {
+        const pair<int, string> &airline = airlines[order[i]];
+        if(!builtIds.empty() && builtIds.back() == airline.first)
+            continue;
+        builtIds.push_back(airline.first);
+        builtNames.push_back(internInPool(builtPool, interned, airline.second));
+    }
+
+    ids.assign(move(builtIds));
+    names.assign(move(builtNames));
+    pool.assign(move(builtPool));
+}
+
+void CarrierTable::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_CARRIER_IDS, ids);
+    writer.addSection(SECTION_CARRIER_NAMES, names);
+    writer.addSection(SECTION_CARRIER_POOL, pool);
+}
+
+bool CarrierTable::read(const SnapshotReader &reader) {
+    if(!reader.attachSection(SECTION_CARRIER_IDS, ids)
+            || !reader.attachSection(SECTION_CARRIER_NAMES, names)
+            || !reader.attachSection(SECTION_CARRIER_POOL, pool))
+        return false;
+
+    if(names.size() != ids.size())
+        return false;
+    for(size_t i = 0; i < names.size(); ++i) {
+        if(uint64_t(names[i].offset) + names[i].length > pool.size())
+            return false;
+    }
+    return true;
+}
+
+void CarrierTable::clear() {
+    ids.clear();
+    names.clear();
+    pool.clear();
+}
+
+// Returns the airline name for a carrier id, or a placeholder if it is unknown (id == \N)
+string_view CarrierTable::name(int carrierId) const {
+    const int32_t *found = lower_bound(ids.begin(), ids.end(), carrierId);
+    if(found == ids.end() || *found != carrierId)
+        return "Unknown Carrier";
+    const stringRef &ref = names[found - ids.begin()];
+    return string_view(pool.data() + ref.offset, ref.length);
+}
@@ -0,0 +1,122 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "flatarray.h"
+#include "snapshot.h"
+#include "geo.h"
+#include "spatialindex.h"
+
+#ifndef METADATA_H
+#define METADATA_H
+
+struct node {
+    int id;
+    double latitude;
+    double longitude;
+    std::string name;
+    std::string code;
+    std::string city;
+    std::string icao;
+};
+
+// Location of a string inside a table's character pool
+struct stringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct airportStrings {
+    stringRef name;
+    stringRef code;
+    stringRef city;
+    stringRef icao;
+};
+
+// Airport code packed into an integer, with the index of the airport it belongs to
+// Characters are packed first to last from the high byte down, so packed codes sort like the strings
+struct codeEntry {
+    uint32_t code;
+    uint32_t index;
+};
+
+// Airport information stored column-wise by dense airport index (0..N-1)
+// All strings live in one character pool, each distinct string once, so the table can be mapped
+// straight from a snapshot
+// IATA codes of three letters are looked up in a table with one entry per possible code,
+// the few IATA codes with digits and all ICAO codes by a binary search over packed codes
+class AirportTable {
+
+public:
+
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+    static constexpr size_t LETTER_CODE_COUNT = 26 * 26 * 26;
+
+    AirportTable();
+
+    void build(const std::vector<node> &airports);
+    AirportTable withChanges(const std::vector<std::pair<uint32_t, node>> &changed, const std::vector<node> &added) const;
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader);
+    void clear();
+
+    size_t size() const { return ids.size(); }
+    int id(uint32_t index) const { return ids[index]; }
+    double latitude(uint32_t index) const { return latitudes[index]; }
+    double longitude(uint32_t index) const { return longitudes[index]; }
+    std::string_view name(uint32_t index) const { return view(strings[index].name); }
+    std::string_view code(uint32_t index) const { return view(strings[index].code); }
+    std::string_view city(uint32_t index) const { return view(strings[index].city); }
+    std::string_view icao(uint32_t index) const { return view(strings[index].icao); }
+    const GeoTable &geometry() const { return geo; }
+    double distance(uint32_t source, uint32_t target) const { return geo.distance(source, target); }
+    const SpatialIndex &locations() const { return spatial; }
+
+    uint32_t findCode(std::string_view code) const;
+    uint32_t findICAO(std::string_view code) const;
+    uint32_t findAirport(std::string_view code) const;
+    uint32_t findId(int id) const;
+
+
+private:
+
+    FlatArray<int32_t> ids;
+    FlatArray<double> latitudes;
+    FlatArray<double> longitudes;
+    FlatArray<airportStrings> strings;
+    FlatArray<char> pool;
+    FlatArray<uint32_t> letterCodes; // Airport of each three letter IATA code, by the code's base-26 value
+    FlatArray<codeEntry> otherCodes; // IATA codes that are not three letters, sorted
+    FlatArray<codeEntry> icaoCodes;  // Sorted
+    FlatArray<uint32_t> idOrder;     // Indices sorted by OpenFlights id
+    GeoTable geo;
+    SpatialIndex spatial;
+    size_t compactedPoolSize; // Of the pool when it was last built, read or packed by withChanges
+
+    std::string_view view(const stringRef &ref) const { return std::string_view(pool.data() + ref.offset, ref.length); }
+    void indexCodes();
+};
+
+// Airline names sorted by OpenFlights airline id, sharing one character pool
+class CarrierTable {
+
+public:
+
+    void build(const std::vector<std::pair<int, std::string>> &airlines);
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader);
+    void clear();
+
+    size_t size() const { return ids.size(); }
+    std::string_view name(int carrierId) const;
+
+
+private:
+
+    FlatArray<int32_t> ids;
+    FlatArray<stringRef> names;
+    FlatArray<char> pool;
+};
+
+#endif // METADATA_H
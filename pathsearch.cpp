@@ -0,0 +1,566 @@
+#include "pathsearch.h"
+#include "geo.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+// Shrinks the great-circle estimate by a hair, so rounding in the haversine formula
+// can never make it larger than the remaining flight distance
+const double ESTIMATE_SCALE = 1 - 1e-9;
+
+ShortestPathSearch::ShortestPathSearch() : algorithm(DIJKSTRA_INDEXED_HEAP), generation(0), counters{0, 0, 0, 0} {
+    forward.heapSize = 0;
+    backward.heapSize = 0;
+}
+
+void ShortestPathSearch::run(const searchGraphs &graphs, uint32_t source, uint32_t target) {
+    run(graphs, source, &target, 1);
+}
+
+void ShortestPathSearch::run(const searchGraphs &graphs, uint32_t source, const uint32_t *targets, size_t targetCount) {
+    size_t targetsLeft = beginSearch(graphs.forward->nodeCount(), targets, targetCount);
+    bool singleTarget = targetsLeft == 1 && targets[0] != source;
+
+    if(graphs.carrierMask != nullptr && graphs.carriers != nullptr)
+        runRestricted(*graphs.carriers, graphs.carrierMask, source, targetsLeft);
+    else if(algorithm == CONTRACTION_HIERARCHY && singleTarget && graphs.hierarchy != nullptr
+            && graphs.hierarchy->nodeCount() == graphs.forward->nodeCount())
+        runHierarchy(*graphs.hierarchy, source, targets[0]);
+    else if(graphs.carriers != nullptr)
+        runSearch(*graphs.carriers, graphs, source, targets, targetsLeft);
+    else
+        runSearch(*graphs.forward, graphs, source, targets, targetsLeft);
+}
+
+uint32_t ShortestPathSearch::runBetween(const searchGraphs &graphs, const searchEndpoint *sources, size_t sourceCount,
+                                        const searchEndpoint *targets, size_t targetCount) {
+    beginSearch(graphs.forward->nodeCount(), nullptr, 0);
+    if(targetOffsets.size() != targetIn.size())
+        targetOffsets.resize(targetIn.size());
+
+    // An airport listed twice as a target keeps its smallest offset
+    for(size_t i = 0; i < targetCount; ++i) {
+        uint32_t target = targets[i].airport;
+        if(targetIn[target] != generation || targets[i].offset < targetOffsets[target])
+            targetOffsets[target] = targets[i].offset;
+        targetIn[target] = generation;
+    }
+
+    if(graphs.carriers != nullptr)
+        return runGroups(*graphs.carriers, sources, sourceCount);
+    return runGroups(*graphs.forward, sources, sourceCount);
+}
+
+// Picks the loop of the current algorithm, falling back to the indexed heap when it does not apply
+// Merged edges keep the order in which their targets first appear, and parallel routes are all
+// the same length, so both graphs settle the same airports with the same parents
+template<typename Graph>
+void ShortestPathSearch::runSearch(const Graph &graph, const searchGraphs &graphs, uint32_t source,
+                                   const uint32_t *targets, size_t targetsLeft) {
+    bool singleTarget = targetsLeft == 1 && targets[0] != source;
+    if(algorithm == DIJKSTRA_LAZY_HEAP)
+        runLazyHeap(graph, source, targetsLeft);
+    else if(algorithm == ASTAR && singleTarget && graphs.airports != nullptr)
+        runAStar(graph, *graphs.airports, source, targets[0]);
+    else if(algorithm == BIDIRECTIONAL && singleTarget && graphs.reverse != nullptr)
+        runBidirectional(graph, *graphs.reverse, source, targets[0]);
+    else
+        runIndexedHeap(graph, source, targetsLeft);
+}
+
+// Returns infinity for airports the last search never reached
+double ShortestPathSearch::distance(uint32_t node) const {
+    if(!forward.isReached(node, generation))
+        return numeric_limits<double>::infinity();
+    return forward.distances[node];
+}
+
+// Walks the parents back from a settled "target" to the source of the last search
+// The returned deque is ordered from the source to the target
+deque<uint32_t> ShortestPathSearch::pathTo(uint32_t target) const {
+    deque<uint32_t> path;
+    for(uint32_t current = target; current != NO_PARENT; current = parent(current))
+        path.push_front(current);
+    return path;
+}
+
+/// SCRATCH STATE
+///
+
+// Starts a new generation, which invalidates every scratch entry of the previous search at once
+// The arrays are only (re)filled when the graph grew or the generation counter wrapped around
+// (CONTRACTION_HIERARCHY uses two generations per search, so one is always kept spare)
+// Returns the number of distinct targets
+size_t ShortestPathSearch::beginSearch(size_t nodeCount, const uint32_t *targets, size_t targetCount) {
+    if(targetIn.size() != nodeCount || generation >= UINT32_MAX - 1) {
+        targetIn.assign(nodeCount, 0);
+        forward.resize(nodeCount);
+        backward.resize(0);
+        generation = 0;
+    }
+    ++generation;
+    forward.heapSize = 0;
+    backward.heapSize = 0;
+    counters = searchCounters{0, 0, 0, 0};
+
+    size_t distinctTargets = 0;
+    for(size_t i = 0; i < targetCount; ++i) {
+        if(targetIn[targets[i]] != generation) {
+            targetIn[targets[i]] = generation;
+            ++distinctTargets;
+        }
+    }
+    return distinctTargets;
+}
+
+void ShortestPathSearch::searchSide::resize(size_t nodeCount) {
+    reachedIn.assign(nodeCount, 0);
+    distances.resize(nodeCount);
+    parents.resize(nodeCount);
+    heapSlots.resize(nodeCount);
+    heap.resize(nodeCount);
+    heapSize = 0;
+}
+
+// Marks an airport as first reached in this search, with no distance or parent yet
+void ShortestPathSearch::searchSide::reach(uint32_t node, uint32_t generation) {
+    reachedIn[node] = generation;
+    distances[node] = numeric_limits<double>::infinity();
+    parents[node] = NO_PARENT;
+    heapSlots[node] = NOT_IN_HEAP;
+}
+
+/// SEARCH LOOPS
+///
+
+// Binary heap with lazy deletion: airports may be pushed several times,
+// and entries of airports that were already settled are skipped when popped
+template<typename Graph>
+void ShortestPathSearch::runLazyHeap(const Graph &graph, uint32_t source, size_t targetsLeft) {
+    // Orders entries like a min priority_queue of (distance, node) pairs
+    auto later = [](const heapEntry &a, const heapEntry &b) {
+        return a.key > b.key || (a.key == b.key && a.node > b.node);
+    };
+    vector<heapEntry> &heap = forward.heap;
+
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    heap.clear();
+    heap.push_back(heapEntry{0, source});
+
+    // Loops through until all targets are settled or no possible route is left
+    while(!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), later);
+        heapEntry next = heap.back();
+        heap.pop_back();
+
+        if(forward.heapSlots[next.node] == SETTLED) {
+            ++counters.stalePops;
+            continue;
+        }
+        forward.heapSlots[next.node] = SETTLED;
+        ++counters.settled;
+        if(targetIn[next.node] == generation && --targetsLeft == 0)
+            break;
+
+        counters.relaxed += graph.edgeEnd(next.node) - graph.edgeBegin(next.node);
+        for(uint32_t e = graph.edgeBegin(next.node); e < graph.edgeEnd(next.node); ++e) {
+            uint32_t target = graph.target(e);
+            if(forward.reachedIn[target] != generation)
+                forward.reach(target, generation);
+            double candidate = next.key + graph.weight(e);
+            if(candidate < forward.distances[target]) {
+                forward.distances[target] = candidate;
+                forward.parents[target] = next.node;
+                heap.push_back(heapEntry{candidate, target});
+                ++counters.heapPushes;
+                push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+    }
+
+    // Keeps the heap as large as the graph, so the indexed heap never has to grow
+    heap.resize(max(heap.size(), forward.reachedIn.size()));
+}
+
+// Indexed heap with decrease-key: every airport is in the heap at most once,
+// so each pop settles a new airport and no stale entries are ever handled
+template<typename Graph>
+void ShortestPathSearch::runIndexedHeap(const Graph &graph, uint32_t source, size_t targetsLeft) {
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    forward.pushOrDecrease(source, 0);
+
+    // Loops through until all targets are settled or no possible route is left
+    while(forward.heapSize != 0) {
+        uint32_t nextIndex = forward.popMinimum();
+        double nextDistance = forward.distances[nextIndex];
+        ++counters.settled;
+        if(targetIn[nextIndex] == generation && --targetsLeft == 0)
+            break;
+
+        counters.relaxed += graph.edgeEnd(nextIndex) - graph.edgeBegin(nextIndex);
+        for(uint32_t e = graph.edgeBegin(nextIndex); e < graph.edgeEnd(nextIndex); ++e) {
+            uint32_t target = graph.target(e);
+            if(forward.reachedIn[target] != generation)
+                forward.reach(target, generation);
+            else if(forward.heapSlots[target] == SETTLED)
+                continue;
+            double candidate = nextDistance + graph.weight(e);
+            if(candidate < forward.distances[target]) {
+                forward.distances[target] = candidate;
+                forward.parents[target] = nextIndex;
+                forward.pushOrDecrease(target, candidate);
+                ++counters.heapPushes;
+            }
+        }
+    }
+}
+
+// Indexed heap search seeded with every source at its offset, as if from one extra airport with a
+// route of that length to each of them; a target only counts as reached with its own offset added,
+// so the search keeps going until nothing left in the heap could beat the best target found
+template<typename Graph>
+uint32_t ShortestPathSearch::runGroups(const Graph &graph, const searchEndpoint *sources, size_t sourceCount) {
+    for(size_t i = 0; i < sourceCount; ++i) {
+        uint32_t source = sources[i].airport;
+        if(forward.reachedIn[source] != generation)
+            forward.reach(source, generation);
+        if(sources[i].offset < forward.distances[source]) {
+            forward.distances[source] = sources[i].offset;
+            forward.pushOrDecrease(source, sources[i].offset);
+            ++counters.heapPushes;
+        }
+    }
+
+    double best = numeric_limits<double>::infinity();
+    uint32_t bestTarget = NO_PARENT;
+    while(forward.heapSize != 0 && forward.minimumKey() < best) {
+        uint32_t nextIndex = forward.popMinimum();
+        double nextDistance = forward.distances[nextIndex];
+        ++counters.settled;
+        if(targetIn[nextIndex] == generation && nextDistance + targetOffsets[nextIndex] < best) {
+            best = nextDistance + targetOffsets[nextIndex];
+            bestTarget = nextIndex;
+        }
+
+        counters.relaxed += graph.edgeEnd(nextIndex) - graph.edgeBegin(nextIndex);
+        for(uint32_t e = graph.edgeBegin(nextIndex); e < graph.edgeEnd(nextIndex); ++e) {
+            uint32_t target = graph.target(e);
+            if(forward.reachedIn[target] != generation)
+                forward.reach(target, generation);
+            else if(forward.heapSlots[target] == SETTLED)
+                continue;
+            double candidate = nextDistance + graph.weight(e);
+            if(candidate < forward.distances[target]) {
+                forward.distances[target] = candidate;
+                forward.parents[target] = nextIndex;
+                forward.pushOrDecrease(target, candidate);
+                ++counters.heapPushes;
+            }
+        }
+    }
+    return bestTarget;
+}
+
+// Indexed heap search over the collapsed graph, skipping edges whose airlines are all filtered out
+// Kept apart from runIndexedHeap, so unrestricted searches never pay for the bitset test
+void ShortestPathSearch::runRestricted(const CarrierGraph &graph, const uint64_t *carrierMask, uint32_t source, size_t targetsLeft) {
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    forward.pushOrDecrease(source, 0);
+
+    while(forward.heapSize != 0) {
+        uint32_t nextIndex = forward.popMinimum();
+        double nextDistance = forward.distances[nextIndex];
+        ++counters.settled;
+        if(targetIn[nextIndex] == generation && --targetsLeft == 0)
+            break;
+
+        counters.relaxed += graph.edgeEnd(nextIndex) - graph.edgeBegin(nextIndex);
+        for(uint32_t e = graph.edgeBegin(nextIndex); e < graph.edgeEnd(nextIndex); ++e) {
+            uint32_t target = graph.target(e);
+            if(forward.reachedIn[target] != generation)
+                forward.reach(target, generation);
+            else if(forward.heapSlots[target] == SETTLED)
+                continue;
+            double candidate = nextDistance + graph.weight(e);
+            if(candidate < forward.distances[target] && graph.allows(e, carrierMask)) {
+                forward.distances[target] = candidate;
+                forward.parents[target] = nextIndex;
+                forward.pushOrDecrease(target, candidate);
+                ++counters.heapPushes;
+            }
+        }
+    }
+}
+
+// A* search: the heap is ordered by distance so far plus the great-circle distance left
+// Every route is as long as the great-circle arc it flies, so the estimate never overshoots
+// and never drops by more than a route's length, which keeps settled airports final
+// The estimate of an airport is worked out once, when it is first reached
+template<typename Graph>
+void ShortestPathSearch::runAStar(const Graph &graph, const AirportTable &airports, uint32_t source, uint32_t target) {
+    auto estimate = [&](uint32_t node) {
+        return ESTIMATE_SCALE * airports.distance(node, target);
+    };
+
+    if(estimates.size() != forward.distances.size())
+        estimates.resize(forward.distances.size());
+
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    estimates[source] = estimate(source);
+    forward.pushOrDecrease(source, estimates[source]);
+
+    while(forward.heapSize != 0) {
+        uint32_t nextIndex = forward.popMinimum();
+        double nextDistance = forward.distances[nextIndex];
+        ++counters.settled;
+        if(nextIndex == target)
+            break;
+
+        counters.relaxed += graph.edgeEnd(nextIndex) - graph.edgeBegin(nextIndex);
+        for(uint32_t e = graph.edgeBegin(nextIndex); e < graph.edgeEnd(nextIndex); ++e) {
+            uint32_t next = graph.target(e);
+            if(forward.reachedIn[next] != generation) {
+                forward.reach(next, generation);
+                estimates[next] = estimate(next);
+            }
+            else if(forward.heapSlots[next] == SETTLED)
+                continue;
+            double candidate = nextDistance + graph.weight(e);
+            if(candidate < forward.distances[next]) {
+                forward.distances[next] = candidate;
+                forward.parents[next] = nextIndex;
+                forward.pushOrDecrease(next, candidate + estimates[next]);
+                ++counters.heapPushes;
+            }
+        }
+    }
+}
+
+// Bidirectional Dijkstra: grows one search from the source over "graph" and one from the target
+// over "reverse", always expanding the side whose closest unsettled airport is nearer
+// Stops once the two closest unsettled airports together are at least as far as the best
+// connection found, then copies the backward half of the path into the forward parents
+template<typename Graph>
+void ShortestPathSearch::runBidirectional(const Graph &graph, const RouteGraph &reverse, uint32_t source, uint32_t target) {
+    if(backward.reachedIn.size() != forward.reachedIn.size())
+        backward.resize(forward.reachedIn.size());
+
+    double best = numeric_limits<double>::infinity();
+    uint32_t meeting = NO_PARENT;
+
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    forward.pushOrDecrease(source, 0);
+    backward.reach(target, generation);
+    backward.distances[target] = 0;
+    backward.pushOrDecrease(target, 0);
+
+    while(forward.heapSize != 0 && backward.heapSize != 0
+            && forward.minimumKey() + backward.minimumKey() < best) {
+
+        bool isForward = forward.minimumKey() <= backward.minimumKey();
+        searchSide &side = isForward ? forward : backward;
+        searchSide &other = isForward ? backward : forward;
+
+        uint32_t nextIndex = side.popMinimum();
+        double nextDistance = side.distances[nextIndex];
+        ++counters.settled;
+
+        // The two sides may be different kinds of graph, so the relaxation is written once for either
+        auto relax = [&](const auto &sideGraph) {
+            counters.relaxed += sideGraph.edgeEnd(nextIndex) - sideGraph.edgeBegin(nextIndex);
+            for(uint32_t e = sideGraph.edgeBegin(nextIndex); e < sideGraph.edgeEnd(nextIndex); ++e) {
+                uint32_t next = sideGraph.target(e);
+                if(side.reachedIn[next] != generation)
+                    side.reach(next, generation);
+                else if(side.heapSlots[next] == SETTLED)
+                    continue;
+                double candidate = nextDistance + sideGraph.weight(e);
+                if(candidate < side.distances[next]) {
+                    side.distances[next] = candidate;
+                    side.parents[next] = nextIndex;
+                    side.pushOrDecrease(next, candidate);
+                    ++counters.heapPushes;
+                }
+
+                // Records the best connection through an airport both searches have reached
+                if(other.reachedIn[next] == generation && side.distances[next] + other.distances[next] < best) {
+                    best = side.distances[next] + other.distances[next];
+                    meeting = next;
+                }
+            }
+        };
+        if(isForward)
+            relax(graph);
+        else
+            relax(reverse);
+    }
+
+    if(meeting == NO_PARENT)
+        return;
+
+    // Backward parents point toward the target, so following them extends the forward path
+    forward.heapSlots[meeting] = SETTLED;
+    for(uint32_t current = meeting; current != target; ) {
+        uint32_t next = backward.parents[current];
+        if(forward.reachedIn[next] != generation)
+            forward.reach(next, generation);
+        forward.parents[next] = current;
+        forward.distances[next] = best - backward.distances[next];
+        forward.heapSlots[next] = SETTLED;
+        current = next;
+    }
+}
+
+// Contraction hierarchy query: a search from the source over up arcs and one from the target
+// over down arcs, so both only ever move to higher ranked airports
+// Unlike plain bidirectional Dijkstra, the searches can not stop when they first meet, only once
+// each side's closest unsettled airport is at least as far as the best connection found
+// Their distances are not shortest distances to every airport they settle, so the path found
+// is unpacked into real routes and written into a fresh generation of the forward arrays,
+// summing route lengths from the source just like Dijkstra does
+void ShortestPathSearch::runHierarchy(const ContractionHierarchy &hierarchy, uint32_t source, uint32_t target) {
+    if(backward.reachedIn.size() != forward.reachedIn.size())
+        backward.resize(forward.reachedIn.size());
+
+    double best = numeric_limits<double>::infinity();
+    uint32_t meeting = NO_PARENT;
+
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    forward.pushOrDecrease(source, 0);
+    backward.reach(target, generation);
+    backward.distances[target] = 0;
+    backward.pushOrDecrease(target, 0);
+
+    while(true) {
+        bool forwardOpen = forward.heapSize != 0 && forward.minimumKey() < best;
+        bool backwardOpen = backward.heapSize != 0 && backward.minimumKey() < best;
+        if(!forwardOpen && !backwardOpen)
+            break;
+
+        bool isForward = forwardOpen && (!backwardOpen || forward.minimumKey() <= backward.minimumKey());
+        searchSide &side = isForward ? forward : backward;
+        searchSide &other = isForward ? backward : forward;
+
+        uint32_t nextIndex = side.popMinimum();
+        double nextDistance = side.distances[nextIndex];
+        ++counters.settled;
+
+        uint32_t arcBegin = isForward ? hierarchy.upBegin(nextIndex) : hierarchy.downBegin(nextIndex);
+        uint32_t arcEnd = isForward ? hierarchy.upEnd(nextIndex) : hierarchy.downEnd(nextIndex);
+        counters.relaxed += arcEnd - arcBegin;
+        for(uint32_t arc = arcBegin; arc < arcEnd; ++arc) {
+            uint32_t next = isForward ? hierarchy.upTarget(arc) : hierarchy.downTarget(arc);
+            if(side.reachedIn[next] != generation)
+                side.reach(next, generation);
+            else if(side.heapSlots[next] == SETTLED)
+                continue;
+            double candidate = nextDistance + (isForward ? hierarchy.upWeight(arc) : hierarchy.downWeight(arc));
+            if(candidate < side.distances[next]) {
+                side.distances[next] = candidate;
+                side.parents[next] = nextIndex;
+                side.pushOrDecrease(next, candidate);
+                ++counters.heapPushes;
+            }
+
+            // Records the best connection through an airport both searches have reached
+            if(other.reachedIn[next] == generation && side.distances[next] + other.distances[next] < best) {
+                best = side.distances[next] + other.distances[next];
+                meeting = next;
+            }
+        }
+    }
+
+    // Lists the hierarchy path from the source to the target
+    hierarchyPath.clear();
+    if(meeting != NO_PARENT) {
+        for(uint32_t current = meeting; current != NO_PARENT; current = forward.parents[current])
+            hierarchyPath.push_back(current);
+        reverse(hierarchyPath.begin(), hierarchyPath.end());
+        for(uint32_t current = backward.parents[meeting]; current != NO_PARENT; current = backward.parents[current])
+            hierarchyPath.push_back(current);
+    }
+    unpackedPath.clear();
+    for(size_t i = 1; i < hierarchyPath.size(); ++i)
+        hierarchy.unpack(hierarchyPath[i - 1], hierarchyPath[i], unpackedPath);
+
+    // Leaves only the unpacked path reached and settled, so nothing else reads as a shortest path
+    ++generation;
+    if(unpackedPath.empty())
+        return;
+    forward.reach(source, generation);
+    forward.distances[source] = 0;
+    forward.heapSlots[source] = SETTLED;
+    uint32_t previous = source;
+    for(size_t i = 0; i < unpackedPath.size(); ++i) {
+        uint32_t next = unpackedPath[i].first;
+        // An airport seen twice can only come from routes of zero length, and keeps its first parent
+        if(forward.reachedIn[next] != generation) {
+            forward.reach(next, generation);
+            forward.parents[next] = previous;
+            forward.distances[next] = forward.distances[previous] + unpackedPath[i].second;
+            forward.heapSlots[next] = SETTLED;
+        }
+        previous = next;
+    }
+}
+
+/// INDEXED HEAP
+///
+
+// Inserts "node" with "key", or lowers its key if it is already in the heap
+void ShortestPathSearch::searchSide::pushOrDecrease(uint32_t node, double key) {
+    size_t slot = heapSlots[node] == NOT_IN_HEAP ? heapSize++ : heapSlots[node];
+    siftUp(slot, heapEntry{key, node});
+}
+
+// Removes the airport with the smallest key from the heap and marks it settled
+uint32_t ShortestPathSearch::searchSide::popMinimum() {
+    uint32_t minimum = heap[0].node;
+    heapSlots[minimum] = SETTLED;
+    if(--heapSize != 0)
+        siftDown(0, heap[heapSize]);
+    return minimum;
+}
+
+// Moves "entry" from "slot" toward the root until its parent has a smaller key
+void ShortestPathSearch::searchSide::siftUp(size_t slot, heapEntry entry) {
+    while(slot != 0) {
+        size_t parentSlot = (slot - 1) / HEAP_ARITY;
+        if(heap[parentSlot].key <= entry.key)
+            break;
+        heap[slot] = heap[parentSlot];
+        heapSlots[heap[slot].node] = slot;
+        slot = parentSlot;
+    }
+    heap[slot] = entry;
+    heapSlots[entry.node] = slot;
+}
+
+// Moves "entry" from "slot" toward the leaves until no child has a smaller key
+void ShortestPathSearch::searchSide::siftDown(size_t slot, heapEntry entry) {
+    while(true) {
+        size_t firstChild = slot * HEAP_ARITY + 1;
+        if(firstChild >= heapSize)
+            break;
+        size_t lastChild = min(firstChild + HEAP_ARITY, heapSize);
+        size_t smallest = firstChild;
+        for(size_t child = firstChild + 1; child < lastChild; ++child) {
+            if(heap[child].key < heap[smallest].key)
+                smallest = child;
+        }
+        if(entry.key <= heap[smallest].key)
+            break;
+        heap[slot] = heap[smallest];
+        heapSlots[heap[slot].node] = slot;
+        slot = smallest;
+    }
+    heap[slot] = entry;
+    heapSlots[entry.node] = slot;
+}
@@ -0,0 +1,155 @@
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "routegraph.h"
+#include "metadata.h"
+#include "contraction.h"
+#include "carriergraph.h"
+
+#ifndef PATHSEARCH_H
+#define PATHSEARCH_H
+
+// Search strategy, selectable at runtime for benchmarking
+// The goal-directed modes only apply to searches with a single target,
+// so searches with several targets always use DIJKSTRA_INDEXED_HEAP instead,
+// and so do searches restricted to a set of airlines
+enum searchAlgorithms {
+    DIJKSTRA_LAZY_HEAP,    // Binary heap that pushes duplicates and skips stale entries
+    DIJKSTRA_INDEXED_HEAP, // 4-ary heap of (distance, index) entries with decrease-key
+    ASTAR,                 // Indexed heap ordered by distance plus great-circle distance to the target
+    BIDIRECTIONAL,         // Indexed heaps growing from both ends until the frontiers meet
+    CONTRACTION_HIERARCHY  // Bidirectional search that only moves up a ContractionHierarchy
+};
+
+// Graphs and tables a search may read
+// "reverse" is only needed by BIDIRECTIONAL, "airports" only by ASTAR
+// and "hierarchy" only by CONTRACTION_HIERARCHY
+// When "carriers" is set, the collapsed graph replaces "forward" for every search that moves
+// forward over routes, so each airport pair is relaxed once however many airlines fly it
+// A search only uses edges flown by an airline in "carrierMask" (a CarrierGraph bitset) when it is set
+struct searchGraphs {
+    const RouteGraph *forward;
+    const RouteGraph *reverse;
+    const AirportTable *airports;
+    const ContractionHierarchy *hierarchy;
+    const CarrierGraph *carriers;
+    const uint64_t *carrierMask;
+};
+
+// Work done by the last search, counted by every search at the cost of a few additions per settled airport
+struct searchCounters {
+    uint64_t settled;    // Airports popped from a heap and made final
+    uint64_t relaxed;    // Routes (or hierarchy arcs) looked at from settled airports
+    uint64_t heapPushes; // Inserts and decrease-keys, one per shorter distance found
+    uint64_t stalePops;  // Entries of airports settled earlier, popped and skipped by DIJKSTRA_LAZY_HEAP
+};
+
+// Airport a search between groups of airports may start or end at, with the ground distance (miles)
+// travelled to reach it or to leave from it, added to every route through it
+struct searchEndpoint {
+    uint32_t airport;
+    double offset;
+};
+
+// Shortest path searches over a RouteGraph with reusable scratch arrays
+// Scratch arrays are stamped with a generation number, so a new search clears them in O(1),
+// and once they have grown to the size of the graph a search allocates no memory at all
+// One instance can answer many searches in a row, but only one at a time,
+// so parallel callers keep one instance per thread
+class ShortestPathSearch {
+
+public:
+
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    ShortestPathSearch();
+
+    void setAlgorithm(searchAlgorithms algorithm) { this->algorithm = algorithm; }
+    searchAlgorithms getAlgorithm() const { return algorithm; }
+
+    // Settles airports outward from "source" until every target is settled,
+    // or every airport reachable from "source" is settled
+    void run(const searchGraphs &graphs, uint32_t source, const uint32_t *targets, size_t targetCount);
+    void run(const searchGraphs &graphs, uint32_t source, uint32_t target);
+
+    // Settles airports outward from every source at once, each starting at its offset, until the shortest
+    // route from any source to any target, plus that target's offset, is known
+    // Returns that target, or NO_PARENT when none is reachable; its distance() includes the offset
+    // of the source used but not its own, and pathTo() leads back to that source
+    // Always uses the indexed heap over every airline, whatever the algorithm and "carrierMask"
+    uint32_t runBetween(const searchGraphs &graphs, const searchEndpoint *sources, size_t sourceCount,
+                        const searchEndpoint *targets, size_t targetCount);
+
+    // Results of the last search, where the path to a settled target is always a shortest path
+    bool isSettled(uint32_t node) const { return forward.isReached(node, generation) && forward.heapSlots[node] == SETTLED; }
+    double distance(uint32_t node) const;
+    uint32_t parent(uint32_t node) const { return forward.isReached(node, generation) ? forward.parents[node] : NO_PARENT; }
+    std::deque<uint32_t> pathTo(uint32_t target) const;
+    size_t settledCount() const { return counters.settled; }
+    const searchCounters &getCounters() const { return counters; }
+
+
+private:
+
+    static constexpr uint32_t SETTLED = UINT32_MAX;
+    static constexpr uint32_t NOT_IN_HEAP = UINT32_MAX - 1;
+    static constexpr size_t HEAP_ARITY = 4;
+
+    struct heapEntry {
+        double key;
+        uint32_t node;
+    };
+
+    // Scratch arrays of one search direction, only meaningful where reachedIn[node] == generation
+    // The heap is keyed by distance, or by distance plus estimate for ASTAR
+    struct searchSide {
+        std::vector<uint32_t> reachedIn;
+        std::vector<double> distances;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> heapSlots; // Position in "heap", NOT_IN_HEAP or SETTLED
+        std::vector<heapEntry> heap;
+        size_t heapSize;
+
+        bool isReached(uint32_t node, uint32_t generation) const { return node < reachedIn.size() && reachedIn[node] == generation; }
+        void resize(size_t nodeCount);
+        void reach(uint32_t node, uint32_t generation);
+        void pushOrDecrease(uint32_t node, double key);
+        uint32_t popMinimum();
+        double minimumKey() const { return heap[0].key; }
+        void siftUp(size_t slot, heapEntry entry);
+        void siftDown(size_t slot, heapEntry entry);
+    };
+
+    searchAlgorithms algorithm;
+    uint32_t generation;
+    std::vector<uint32_t> targetIn;
+    searchSide forward;
+    searchSide backward;           // Only used by BIDIRECTIONAL and CONTRACTION_HIERARCHY
+    std::vector<double> estimates; // Only used by ASTAR, valid for airports reached this generation
+    std::vector<double> targetOffsets; // Only used by runBetween, valid for targets of this generation
+    std::vector<uint32_t> hierarchyPath;                   // Only used by CONTRACTION_HIERARCHY
+    std::vector<std::pair<uint32_t, double>> unpackedPath; // Only used by CONTRACTION_HIERARCHY
+    searchCounters counters;
+
+    size_t beginSearch(size_t nodeCount, const uint32_t *targets, size_t targetCount);
+
+    // Run over a RouteGraph or a CarrierGraph, which share the edge accessors they use
+    template<typename Graph>
+    void runSearch(const Graph &graph, const searchGraphs &graphs, uint32_t source, const uint32_t *targets, size_t targetsLeft);
+    template<typename Graph>
+    void runLazyHeap(const Graph &graph, uint32_t source, size_t targetsLeft);
+    template<typename Graph>
+    void runIndexedHeap(const Graph &graph, uint32_t source, size_t targetsLeft);
+    template<typename Graph>
+    void runAStar(const Graph &graph, const AirportTable &airports, uint32_t source, uint32_t target);
+    template<typename Graph>
+    void runBidirectional(const Graph &graph, const RouteGraph &reverse, uint32_t source, uint32_t target);
+    template<typename Graph>
+    uint32_t runGroups(const Graph &graph, const searchEndpoint *sources, size_t sourceCount);
+    void runHierarchy(const ContractionHierarchy &hierarchy, uint32_t source, uint32_t target);
+    void runRestricted(const CarrierGraph &graph, const uint64_t *carrierMask, uint32_t source, size_t targetsLeft);
+};
+
+#endif // PATHSEARCH_H
@@ -0,0 +1,574 @@
+#include "queryserver.h"
+#include <charconv>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// How long poll() waits before checking whether stop() was called
+const int POLL_TIMEOUT_MS = 200;
+
+/// RESPONSE FORMATTING
+///
+
+static const char *errorName(CONTROLLER_ERRORS error) {
+    switch(error) {
+    case START_NOT_FOUND:
+        return "START_NOT_FOUND";
+    case END_NOT_FOUND:
+        return "END_NOT_FOUND";
+    case START_END_SAME:
+        return "START_END_SAME";
+    case NO_ROUTE_FOUND:
+        return "NO_ROUTE_FOUND";
+    case INVALID_FILENAME:
+        return "INVALID_FILENAME";
+    case SNAPSHOT_NOT_WRITTEN:
+        return "SNAPSHOT_NOT_WRITTEN";
+    case SERVER_NOT_STARTED:
+        return "SERVER_NOT_STARTED";
+    case DELTA_NOT_READ:
+        return "DELTA_NOT_READ";
+    }
+    return "UNKNOWN_ERROR";
+}
+
+// Shortest digits that read back as the same double
+static void appendNumber(double value, string &out) {
+    char number[32];
+    out.append(number, to_chars(number, number + sizeof(number), value).ptr);
+}
+
+static void appendItinerary(const Itinerary &itinerary, string &out) {
+    out += "\"distance\":";
+    appendNumber(itinerary.distance(), out);
+    out += ",\"legs\":[";
+    for(size_t i = 0; i < itinerary.legCount(); ++i) {
+        const itineraryLeg &leg = itinerary.leg(i);
+        if(i != 0)
+            out += ',';
+        out += "{\"from\":\"";
+        appendJSONEscaped(itinerary.airportCode(leg.from), out);
+        out += "\",\"to\":\"";
+        appendJSONEscaped(itinerary.airportCode(leg.to), out);
+        out += "\",\"distance\":";
+        appendNumber(leg.distance, out);
+        out += ",\"carriers\":[";
+        for(size_t j = 0; j < leg.carrierIds.size(); ++j) {
+            if(j != 0)
+                out += ',';
+            out += '"';
+            appendJSONEscaped(itinerary.carrierName(leg.carrierIds[j]), out);
+            out += '"';
+        }
+        out += "]}";
+    }
+    out += ']';
+}
+
+// Fields of a route between groups of airports, "distance" being the flights alone as in other answers
+static void appendGroupItinerary(const groupItinerary &route, const Controller &controller, string &out) {
+    out += "\"origin\":\"";
+    appendJSONEscaped(controller.getAirportCode(route.origin), out);
+    out += "\",\"originGround\":";
+    appendNumber(route.originGround, out);
+    out += ",\"destination\":\"";
+    appendJSONEscaped(controller.getAirportCode(route.destination), out);
+    out += "\",\"destinationGround\":";
+    appendNumber(route.destinationGround, out);
+    out += ",\"total\":";
+    appendNumber(route.distance, out);
+    out += ',';
+    appendItinerary(route.itinerary, out);
+}
+
+static string errorResponse(const char *error, const string &message) {
+    string out = "{\"ok\":false,\"error\":\"";
+    out += error;
+    if(!message.empty()) {
+        out += "\",\"message\":\"";
+        appendJSONEscaped(message, out);
+    }
+    out += "\"}";
+    return out;
+}
+
+/// REQUEST PARSING
+///
+
+// Reads a whole decimal number in [minimum, maximum], returning false for anything else
+static bool parseLimit(const string &text, long minimum, long maximum, long &value) {
+    const char *end = text.data() + text.size();
+    from_chars_result parsed = from_chars(text.data(), end, value);
+    return parsed.ec == errc() && parsed.ptr == end && value >= minimum && value <= maximum;
+}
+
+// Reads a decimal number in [minimum, maximum], returning false for anything else
+static bool parseNumber(const string &text, double minimum, double maximum, double &value) {
+    const char *end = text.data() + text.size();
+    from_chars_result parsed = from_chars(text.data(), end, value);
+    return parsed.ec == errc() && parsed.ptr == end && value >= minimum && value <= maximum;
+}
+
+// Reads a point such as "51.47,-0.45" (latitude, then longitude, in degrees)
+static bool parsePoint(const string &text, double &latitude, double &longitude) {
+    size_t comma = text.find(',');
+    return comma != string::npos && parseNumber(text.substr(0, comma), -90, 90, latitude)
+        && parseNumber(text.substr(comma + 1), -180, 180, longitude);
+}
+
+// Reads one end of a route request: a point, or airport codes joined by '+' such as "LHR+LGW+STN"
+static bool parseGroup(const string &text, double radius, airportGroup &group) {
+    group.airports.clear();
+    group.hasPoint = parsePoint(text, group.latitude, group.longitude);
+    group.radius = radius;
+    if(group.hasPoint)
+        return true;
+    size_t position = 0;
+    while(position <= text.size()) {
+        size_t split = min(text.find('+', position), text.size());
+        groundLink airport = {text.substr(position, split - position), 0};
+        if(airport.code.empty())
+            return false;
+        for(size_t i = 0; i < airport.code.size(); ++i)
+            airport.code[i] = toupper(static_cast<unsigned char>(airport.code[i]));
+        group.airports.push_back(airport);
+        position = split + 1;
+    }
+    return true;
+}
+
+// Reads comma separated airline ids such as "24,1355"
+static bool parseIds(const string &text, vector<int> &ids) {
+    const char *next = text.data();
+    const char *end = text.data() + text.size();
+    while(next < end) {
+        int id;
+        from_chars_result parsed = from_chars(next, end, id);
+        if(parsed.ec != errc() || (parsed.ptr != end && *parsed.ptr != ','))
+            return false;
+        ids.push_back(id);
+        next = parsed.ptr == end ? end : parsed.ptr + 1;
+    }
+    return !ids.empty();
+}
+
+/// PUBLIC FUNCTIONS
+///
+
+QueryServer::QueryServer(Controller &controller, size_t threadCount)
+    : controller(controller), pool(threadCount), stopping(false) {
+}
+
+// Serves a single client on stdin and stdout until stdin ends
+void QueryServer::serveStdio() {
+    signal(SIGPIPE, SIG_IGN);
+    vector<connection> connections(1);
+    connections[0].inFd = STDIN_FILENO;
+    connections[0].outFd = STDOUT_FILENO;
+    connections[0].isEndOfInput = false;
+    connections[0].isBroken = false;
+    runLoop(-1, connections);
+}
+
+// Listens on a Unix domain socket at "socketPath" (replacing any stale socket file there)
+// and serves every client that connects, until stop() is called
+void QueryServer::serveSocket(const string &socketPath) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+        throw INVALID_FILENAME;
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+
+    signal(SIGPIPE, SIG_IGN);
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenFd < 0)
+        throw SERVER_NOT_STARTED;
+    unlink(socketPath.c_str());
+    if(bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0
+            || fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(listenFd);
+        throw SERVER_NOT_STARTED;
+    }
+
+    vector<connection> connections;
+    runLoop(listenFd, connections);
+
+    for(size_t i = 0; i < connections.size(); ++i)
+        close(connections[i].inFd);
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+// Answers one request line with one JSON object (without the newline)
+// Found routes give {"ok":true,"distance":D,"legs":[...]}, k shortest requests give
+// {"ok":true,"options":[{"distance":D,"legs":[...]},...]}, and failures give
+// {"ok":false,"error":NAME} with NAME a CONTROLLER_ERRORS value or BAD_REQUEST
+string QueryServer::answer(const string &request) {
+    if(request.size() > MAX_LINE_LENGTH)
+        return errorResponse("BAD_REQUEST", "request line too long");
+
+    vector<string> tokens;
+    size_t position = 0;
+    while(true) {
+        position = request.find_first_not_of(" \t\r", position);
+        if(position == string::npos)
+            break;
+        size_t tokenEnd = request.find_first_of(" \t\r", position);
+        tokens.push_back(request.substr(position, tokenEnd - position));
+        position = tokenEnd;
+    }
+
+    if(tokens.size() == 1 && tokens[0] == "PING")
+        return "{\"ok\":true}";
+    if(tokens.size() == 1 && tokens[0] == "STATS") {
+        queryStatsTotals sums = controller.getQueryStats();
+        string out = "{\"ok\":true,\"queries\":" + to_string(sums.queries) + ",\"cached\":" + to_string(sums.cached)
+                   + ",\"notFound\":" + to_string(sums.notFound) + ",\"settled\":" + to_string(sums.search.settled)
+                   + ",\"relaxed\":" + to_string(sums.search.relaxed) + ",\"heapPushes\":" + to_string(sums.search.heapPushes)
+                   + ",\"stalePops\":" + to_string(sums.search.stalePops) + ",\"pathHops\":" + to_string(sums.pathHops)
+                   + ",\"wallMs\":";
+        appendNumber(sums.wallMs, out);
+        out += '}';
+        return out;
+    }
+    if(tokens.size() == 2 && tokens[0] == "APPLY") {
+        try {
+            deltaCounts counts = controller.applyDelta(tokens[1]);
+            string out = "{\"ok\":true,\"version\":" + to_string(counts.version)
+                       + ",\"airportsAdded\":" + to_string(counts.airportsAdded)
+                       + ",\"airportsChanged\":" + to_string(counts.airportsChanged)
+                       + ",\"routesAdded\":" + to_string(counts.routesAdded)
+                       + ",\"routesRemoved\":" + to_string(counts.routesRemoved)
+                       + ",\"skipped\":" + to_string(counts.lines.skipped)
+                       + ",\"malformed\":" + to_string(counts.lines.malformed) + "}";
+            return out;
+        }
+        catch(CONTROLLER_ERRORS e) {
+            return errorResponse(errorName(e), string());
+        }
+    }
+    if(tokens.size() == 3 && tokens[0] == "ROUTABLE") {
+        string start = tokens[1], end = tokens[2];
+        for(size_t i = 0; i < start.size(); ++i)
+            start[i] = toupper(static_cast<unsigned char>(start[i]));
+        for(size_t i = 0; i < end.size(); ++i)
+            end[i] = toupper(static_cast<unsigned char>(end[i]));
+        try {
+            return controller.canReach(start, end) ? "{\"ok\":true,\"routable\":true}" : "{\"ok\":true,\"routable\":false}";
+        }
+        catch(CONTROLLER_ERRORS e) {
+            return errorResponse(errorName(e), string());
+        }
+    }
+    if(tokens.size() < 2)
+        return errorResponse("BAD_REQUEST", "expected START END [option]");
+    if(tokens[0] == "NEAR")
+        return answerNear(tokens);
+    if(tokens[0].find_first_of(",+") != string::npos || tokens[1].find_first_of(",+") != string::npos)
+        return answerGroups(tokens);
+
+    long maxLayovers = -1, pathCount = 0;
+    carrierFilter filter;
+    bool isFiltered = false;
+    for(size_t i = 2; i < tokens.size(); ++i) {
+        size_t split = tokens[i].find('=');
+        string name = tokens[i].substr(0, split);
+        string value = split == string::npos ? string() : tokens[i].substr(split + 1);
+        if(i > 2)
+            return errorResponse("BAD_REQUEST", "options cannot be combined");
+        if(name == "layovers" && parseLimit(value, 0, MAX_LAYOVERS, maxLayovers))
+            continue;
+        if(name == "k" && parseLimit(value, 1, MAX_PATHS, pathCount))
+            continue;
+        if((name == "allow" || name == "deny") && parseIds(value, filter.carrierIds)) {
+            filter.mode = name == "allow" ? ALLOW_CARRIERS : DENY_CARRIERS;
+            isFiltered = true;
+            continue;
+        }
+        return errorResponse("BAD_REQUEST", "invalid option " + tokens[i]);
+    }
+
+    string start = tokens[0], end = tokens[1];
+    for(size_t i = 0; i < start.size(); ++i)
+        start[i] = toupper(static_cast<unsigned char>(start[i]));
+    for(size_t i = 0; i < end.size(); ++i)
+        end[i] = toupper(static_cast<unsigned char>(end[i]));
+
+    string out = "{\"ok\":true,";
+    try {
+        if(pathCount != 0) {
+            vector<Itinerary> options = controller.getKShortestPaths(start, end, pathCount);
+            out += "\"options\":[";
+            for(size_t i = 0; i < options.size(); ++i) {
+                out += i == 0 ? "{" : ",{";
+                appendItinerary(options[i], out);
+                out += '}';
+            }
+            out += "]}";
+            return out;
+        }
+
+        Itinerary route;
+        if(isFiltered)
+            route = controller.getItinerary(start, end, filter);
+        else if(maxLayovers >= 0)
+            route = controller.getItineraryWithLayovers(start, end, maxLayovers);
+        else
+            route = controller.getItinerary(start, end);
+        appendItinerary(route, out);
+        out += '}';
+        return out;
+    }
+    catch(CONTROLLER_ERRORS e) {
+        return errorResponse(errorName(e), string());
+    }
+}
+
+// Answers "NEAR LAT,LON [k=N | radius=MILES]" with the closest airports,
+// {"ok":true,"airports":[{"code":IATA,"icao":ICAO,"distance":D},...]} closest first, at most MAX_NEAREST of them
+string QueryServer::answerNear(const vector<string> &tokens) {
+    double latitude, longitude;
+    if(tokens.size() < 2 || tokens.size() > 3 || !parsePoint(tokens[1], latitude, longitude))
+        return errorResponse("BAD_REQUEST", "expected NEAR LAT,LON [option]");
+
+    long count = DEFAULT_NEAREST;
+    double radius = -1;
+    if(tokens.size() == 3) {
+        size_t split = tokens[2].find('=');
+        string name = tokens[2].substr(0, split);
+        string value = split == string::npos ? string() : tokens[2].substr(split + 1);
+        if(!(name == "k" && parseLimit(value, 1, MAX_NEAREST, count))
+                && !(name == "radius" && parseNumber(value, 0, MAX_RADIUS_MILES, radius)))
+            return errorResponse("BAD_REQUEST", "invalid option " + tokens[2]);
+    }
+
+    vector<nearbyAirport> nearby = radius < 0 ? controller.findNearestAirports(latitude, longitude, count)
+                                              : controller.findAirportsWithin(latitude, longitude, radius);
+    string out = "{\"ok\":true,\"airports\":[";
+    for(size_t i = 0; i < nearby.size() && i < size_t(MAX_NEAREST); ++i) {
+        out += i == 0 ? "{\"code\":\"" : ",{\"code\":\"";
+        appendJSONEscaped(controller.getAirportCode(nearby[i].airport), out);
+        out += "\",\"icao\":\"";
+        appendJSONEscaped(controller.getAirportICAO(nearby[i].airport), out);
+        out += "\",\"distance\":";
+        appendNumber(nearby[i].distance, out);
+        out += '}';
+    }
+    out += "]}";
+    return out;
+}
+
+// Answers a route request with a point or a list of codes at either end, such as "LHR+LGW 40.64,-73.78",
+// where the only option is "radius=MILES" around the points
+// Gives {"ok":true,"origin":CODE,"originGround":D,"destination":CODE,"destinationGround":D,"total":D,
+// "distance":D,"legs":[...]}, "total" adding the ground distances to the flights
+string QueryServer::answerGroups(const vector<string> &tokens) {
+    double radius = DEFAULT_RADIUS_MILES;
+    if(tokens.size() > 3)
+        return errorResponse("BAD_REQUEST", "options cannot be combined");
+    if(tokens.size() == 3 && (tokens[2].compare(0, 7, "radius=") != 0
+            || !parseNumber(tokens[2].substr(7), 0, MAX_RADIUS_MILES, radius)))
+        return errorResponse("BAD_REQUEST", "invalid option " + tokens[2]);
+
+    airportGroup origins, destinations;
+    if(!parseGroup(tokens[0], radius, origins) || !parseGroup(tokens[1], radius, destinations))
+        return errorResponse("BAD_REQUEST", "expected START END [option]");
+
+    try {
+        string out = "{\"ok\":true,";
+        appendGroupItinerary(controller.getItinerary(origins, destinations), controller, out);
+        out += '}';
+        return out;
+    }
+    catch(CONTROLLER_ERRORS e) {
+        return errorResponse(errorName(e), string());
+    }
+}
+
+/// EVENT LOOP
+///
+
+// Polls the listening socket (unless "listenFd" is negative) and every connection, and answers what
+// arrives until stop() is called, or until the last connection closes when there is no listening socket
+// Lines left over when a pass fills its batch are answered on the next pass, before waiting again
+void QueryServer::runLoop(int listenFd, vector<connection> &connections) {
+    vector<pollfd> polled;
+    vector<string> lines;
+    vector<size_t> owners;
+    vector<string> responses;
+    bool hasQueuedLines = false;
+    size_t firstClient = 0;
+
+    while(!stopping && (listenFd >= 0 || !connections.empty())) {
+        polled.clear();
+        if(listenFd >= 0)
+            polled.push_back({listenFd, POLLIN, 0});
+        size_t firstPolled = polled.size();
+        for(size_t i = 0; i < connections.size(); ++i) {
+            connection &client = connections[i];
+            short events = 0;
+            if(!client.isEndOfInput && client.output.size() < MAX_PENDING_OUTPUT)
+                events |= POLLIN;
+            if(!client.output.empty() && client.outFd == client.inFd)
+                events |= POLLOUT;
+            polled.push_back({client.inFd, events, 0});
+        }
+
+        if(poll(polled.data(), polled.size(), hasQueuedLines ? 0 : POLL_TIMEOUT_MS) < 0) {
+            if(errno == EINTR)
+                continue;
+            throw SERVER_NOT_STARTED;
+        }
+
+        size_t polledClients = connections.size();
+        for(size_t i = 0; i < polledClients; ++i) {
+            const pollfd &state = polled[firstPolled + i];
+            if((state.events & POLLIN) && (state.revents & (POLLIN | POLLHUP | POLLERR)))
+                readInput(connections[i]);
+            if(state.revents & POLLOUT)
+                writeOutput(connections[i]);
+            if(state.revents & POLLNVAL)
+                connections[i].isBroken = true;
+        }
+
+        // New clients join after the ones just polled, so they are polled from the next pass on
+        if(listenFd >= 0 && (polled[0].revents & POLLIN)) {
+            int clientFd;
+            while((clientFd = accept(listenFd, nullptr, nullptr)) >= 0) {
+                fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL) | O_NONBLOCK);
+                connection client;
+                client.inFd = clientFd;
+                client.outFd = clientFd;
+                client.isEndOfInput = false;
+                client.isBroken = false;
+                connections.push_back(client);
+            }
+        }
+
+        // Gathers complete lines, starting from a different client each pass so none is starved
+        lines.clear();
+        owners.clear();
+        hasQueuedLines = false;
+        for(size_t n = 0; n < connections.size(); ++n) {
+            size_t i = (firstClient + n) % connections.size();
+            if(connections[i].isBroken || connections[i].output.size() >= MAX_PENDING_OUTPUT)
+                continue;
+            if(takeRequests(connections[i], lines, MAX_BATCH_REQUESTS))
+                hasQueuedLines = true;
+            owners.resize(lines.size(), i);
+        }
+        firstClient = connections.empty() ? 0 : (firstClient + 1) % connections.size();
+
+        answerAll(lines, responses);
+        for(size_t i = 0; i < lines.size(); ++i) {
+            connections[owners[i]].output += responses[i];
+            connections[owners[i]].output += '\n';
+        }
+
+        // Writes straight away, most answers fit in the socket buffer without waiting for POLLOUT
+        for(size_t i = 0; i < connections.size(); ++i) {
+            if(!connections[i].output.empty() && !connections[i].isBroken)
+                writeOutput(connections[i]);
+        }
+
+        // Drops clients that failed, or that stopped sending and have everything answered and written
+        size_t kept = 0;
+        for(size_t i = 0; i < connections.size(); ++i) {
+            connection &client = connections[i];
+            bool isDone = client.isBroken || (client.isEndOfInput && client.input.empty() && client.output.empty());
+            if(!isDone) {
+                if(kept != i)
+                    connections[kept] = move(client);
+                ++kept;
+            }
+            else if(client.inFd != STDIN_FILENO)
+                close(client.inFd);
+        }
+        connections.resize(kept);
+    }
+}
+
+// Appends one read's worth of bytes to the client's input
+// A single read never blocks after poll() reported the descriptor readable, even on stdin
+void QueryServer::readInput(connection &client) {
+    char buffer[READ_SIZE];
+    ssize_t count = read(client.inFd, buffer, sizeof(buffer));
+    if(count > 0)
+        client.input.append(buffer, count);
+    else if(count == 0)
+        client.isEndOfInput = true;
+    else if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        client.isBroken = true;
+}
+
+// Writes as much pending output as the client takes without blocking
+// Sockets are non-blocking, stdout is not, so stdout always takes everything
+void QueryServer::writeOutput(connection &client) {
+    size_t written = 0;
+    while(written < client.output.size()) {
+        ssize_t count = write(client.outFd, client.output.data() + written, client.output.size() - written);
+        if(count > 0)
+            written += count;
+        else if(count < 0 && errno == EINTR)
+            continue;
+        else {
+            if(count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                client.isBroken = true;
+            break;
+        }
+    }
+    client.output.erase(0, written);
+}
+
+// Moves complete request lines out of the client's input until "lines" holds "limit" of them
+// A QUIT line ends the client's input, and a line too long to be a request is passed on
+// (to be answered with an error) before the connection is closed, since its framing is lost
+// Returns true if complete lines were left behind because "lines" was full
+bool QueryServer::takeRequests(connection &client, vector<string> &lines, size_t limit) {
+    size_t lineStart = 0;
+    while(true) {
+        if(lines.size() >= limit) {
+            client.input.erase(0, lineStart);
+            return client.input.find('\n') != string::npos;
+        }
+
+        size_t lineEnd = client.input.find('\n', lineStart);
+        if(lineEnd == string::npos) {
+            size_t remaining = client.input.size() - lineStart;
+            if(remaining > MAX_LINE_LENGTH || (client.isEndOfInput && remaining != 0)) {
+                lines.push_back(client.input.substr(lineStart, min(remaining, MAX_LINE_LENGTH + 1)));
+                client.isEndOfInput = true;
+                lineStart = client.input.size();
+            }
+            client.input.erase(0, lineStart);
+            return false;
+        }
+
+        size_t lineLength = lineEnd - lineStart;
+        if(lineLength != 0 && client.input[lineEnd - 1] == '\r')
+            --lineLength;
+        if(client.input.compare(lineStart, lineLength, "QUIT") == 0) {
+            client.isEndOfInput = true;
+            client.input.clear();
+            return false;
+        }
+        lines.push_back(client.input.substr(lineStart, lineLength));
+        lineStart = lineEnd + 1;
+    }
+}
+
+// Answers a pass's lines on the worker pool, each response at the index of its request
+void QueryServer::answerAll(const vector<string> &lines, vector<string> &responses) {
+    responses.resize(lines.size());
+    pool.run(lines.size(), [&](size_t request, size_t) {
+        responses[request] = answer(lines[request]);
+    });
+}
@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include "controller.h"
+#include "threadpool.h"
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+// Answers newline-delimited queries against one loaded Controller, without any prompts
+// A request is "START END [layovers=K | k=N | allow=IDS | deny=IDS]" (airports by IATA or ICAO code),
+// or "START END [radius=MILES]" with either end a "LAT,LON" point or codes joined by '+', flying from
+// any of those airports (or any within MILES of the point) and counting the ground distance to them,
+// or "NEAR LAT,LON [k=N | radius=MILES]" for the airports closest to a point,
+// or "ROUTABLE START END" to ask whether any route connects two airports, answered without a search,
+// or PING, or QUIT to hang up,
+// or "APPLY FILE" to apply a delta file to the graph, seen by every request sent after its answer arrives,
+// or STATS for the query totals (all zero unless the Controller has statistics enabled)
+// and every request gets exactly one JSON line back, in the order the requests were sent,
+// so clients may pipeline as many requests as they like without waiting for answers
+// One thread runs a poll() loop over every connection; each pass gathers the complete lines
+// of all readable connections and answers them together on the worker pool
+class QueryServer {
+
+public:
+
+    QueryServer(Controller &controller, size_t threadCount);
+
+    void serveStdio();
+    void serveSocket(const std::string &socketPath);
+    void stop() { stopping = true; } // Safe to call from a signal handler
+
+    std::string answer(const std::string &request);
+
+
+private:
+
+    // Longest request line accepted, lines answered per pass, and queued output before a client is no longer read
+    static constexpr size_t MAX_LINE_LENGTH = 4096;
+    static constexpr size_t MAX_BATCH_REQUESTS = 1024;
+    static constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+    static constexpr size_t READ_SIZE = 64 * 1024;
+
+    // Largest limits a request may ask for, so one client cannot tie up a worker for long
+    static constexpr long MAX_LAYOVERS = 16;
+    static constexpr long MAX_PATHS = 50;
+    static constexpr long MAX_NEAREST = 100;
+    static constexpr double MAX_RADIUS_MILES = 500;
+
+    // Airports NEAR lists without a "k", and how far around a point routes look without a "radius"
+    static constexpr long DEFAULT_NEAREST = 5;
+    static constexpr double DEFAULT_RADIUS_MILES = 50;
+
+    // One client: the bytes read but not yet answered, and the answers not yet written
+    struct connection {
+        int inFd;
+        int outFd;
+        std::string input;
+        std::string output;
+        bool isEndOfInput; // Peer finished sending, or sent QUIT
+        bool isBroken;     // Read or write failed, dropped without flushing
+    };
+
+    Controller &controller;
+    ThreadPool pool;
+    std::atomic<bool> stopping;
+
+
+    std::string answerNear(const std::vector<std::string> &tokens);
+    std::string answerGroups(const std::vector<std::string> &tokens);
+    void runLoop(int listenFd, std::vector<connection> &connections);
+    void readInput(connection &client);
+    void writeOutput(connection &client);
+    bool takeRequests(connection &client, std::vector<std::string> &lines, size_t limit);
+    void answerAll(const std::vector<std::string> &lines, std::vector<std::string> &responses);
+
+    QueryServer(const QueryServer &other);
+    QueryServer &operator=(const QueryServer &other);
+};
+
+#endif // QUERYSERVER_H
@@ -0,0 +1,257 @@
+#include "reachability.h"
+#include <algorithm>
+
+using namespace std;
+
+static const uint32_t UNVISITED = UINT32_MAX;
+
+// Airport being visited by Tarjan's algorithm, and the next of its routes to follow
+struct tarjanFrame {
+    uint32_t node;
+    uint32_t edge;
+};
+
+// Helper function : Tarjan's algorithm, without recursion so long chains of airports can not overflow the stack
+// Fills "components" with the component of every airport, numbered in the order they are finished,
+// and returns how many there are
+static uint32_t findComponents(const RouteGraph &graph, vector<uint32_t> &components) {
+    size_t nodeCount = graph.nodeCount();
+    vector<uint32_t> order(nodeCount, UNVISITED);
+    vector<uint32_t> lowest(nodeCount);
+    vector<uint32_t> open;
+    vector<tarjanFrame> frames;
+    components.assign(nodeCount, UNVISITED);
+    uint32_t visited = 0, componentCount = 0;
+
+    for(uint32_t root = 0; root < nodeCount; ++root) {
+        if(order[root] != UNVISITED)
+            continue;
+        order[root] = lowest[root] = visited++;
+        open.push_back(root);
+        frames.push_back(tarjanFrame{root, graph.edgeBegin(root)});
+
+        while(!frames.empty()) {
+            tarjanFrame &frame = frames.back();
+            uint32_t node = frame.node;
+            if(frame.edge != graph.edgeEnd(node)) {
+                uint32_t next = graph.target(frame.edge++);
+                if(order[next] == UNVISITED) {
+                    order[next] = lowest[next] = visited++;
+                    open.push_back(next);
+                    frames.push_back(tarjanFrame{next, graph.edgeBegin(next)});
+                }
+                else if(components[next] == UNVISITED)
+                    lowest[node] = min(lowest[node], order[next]);
+                continue;
+            }
+
+            frames.pop_back();
+            if(!frames.empty())
+                lowest[frames.back().node] = min(lowest[frames.back().node], lowest[node]);
+            if(lowest[node] == order[node]) {
+                uint32_t member;
+                do {
+                    member = open.back();
+                    open.pop_back();
+                    components[member] = componentCount;
+                } while(member != node);
+                ++componentCount;
+            }
+        }
+    }
+    return componentCount;
+}
+
+/// REACHABILITY INDEX
+///
+
+ReachabilityIndex::ReachabilityIndex() : rowWords(0) {}
+
+// Finds the components of "graph", then fills the closure one component at a time in the order they were
+// numbered: every component a route leads to is numbered lower, so its row is already complete and is
+// OR-ed into this one
+void ReachabilityIndex::build(const RouteGraph &graph) {
+    size_t nodeCount = graph.nodeCount();
+    vector<uint32_t> builtComponents;
+    uint32_t componentCount = findComponents(graph, builtComponents);
+
+    vector<uint32_t> builtSizes(componentCount, 0);
+    vector<bool> isRouted(componentCount, false);
+    for(uint32_t node = 0; node < nodeCount; ++node) {
+        ++builtSizes[builtComponents[node]];
+        for(uint32_t edge = graph.edgeBegin(node); edge != graph.edgeEnd(node); ++edge) {
+            isRouted[builtComponents[node]] = true;
+            isRouted[builtComponents[graph.target(edge)]] = true;
+        }
+    }
+    vector<uint32_t> builtRows(componentCount, NOT_INDEXED);
+    uint32_t rowCount = 0;
+    for(uint32_t component = 0; component < componentCount; ++component) {
+        if(isRouted[component])
+            builtRows[component] = rowCount++;
+    }
+
+    // Airports grouped by component, so each component's routes can be followed together
+    vector<uint32_t> memberOffsets(componentCount + 1, 0);
+    for(uint32_t node = 0; node < nodeCount; ++node)
+        ++memberOffsets[builtComponents[node] + 1];
+    for(uint32_t component = 0; component < componentCount; ++component)
+        memberOffsets[component + 1] += memberOffsets[component];
+    vector<uint32_t> members(nodeCount);
+    vector<uint32_t> nextMember(memberOffsets.begin(), memberOffsets.end() - 1);
+    for(uint32_t node = 0; node < nodeCount; ++node)
+        members[nextMember[builtComponents[node]]++] = node;
+
+    size_t words = (rowCount + 63) / 64;
+    vector<uint64_t> builtClosure(size_t(rowCount) * words, 0);
+    for(uint32_t component = 0; component < componentCount; ++component) {
+        uint32_t row = builtRows[component];
+        if(row == NOT_INDEXED)
+            continue;
+        uint64_t *bits = builtClosure.data() + size_t(row) * words;
+        bits[row / 64] |= uint64_t(1) << (row % 64);
+        for(uint32_t m = memberOffsets[component]; m != memberOffsets[component + 1]; ++m) {
+            uint32_t node = members[m];
+            for(uint32_t edge = graph.edgeBegin(node); edge != graph.edgeEnd(node); ++edge) {
+                uint32_t next = builtRows[builtComponents[graph.target(edge)]];
+                if(next == row || (bits[next / 64] >> (next % 64)) & 1)
+                    continue;
+                const uint64_t *nextBits = builtClosure.data() + size_t(next) * words;
+                for(size_t w = 0; w < words; ++w)
+                    bits[w] |= nextBits[w];
+            }
+        }
+    }
+
+    components.assign(move(builtComponents));
+    componentSizes.assign(move(builtSizes));
+    rows.assign(move(builtRows));
+    closure.assign(move(builtClosure));
+    rowWords = words;
+}
+
+// True if this index, built for the graph "graph" was made from, still holds for "graph" (whose reverse is
+// "reverseGraph") after "removedRoutes" were taken out and "addedRoutes" put in, so it can be kept as it is
+// That is when no airport was added, every added route leaves an airport that already had routes and
+// already reached the route's target, and every removed route either leaves another route between its
+// airports or lies inside the one component all such routes share, which stays strongly connected
+bool ReachabilityIndex::isKeptBy(const RouteGraph &graph, const RouteGraph &reverseGraph,
+                                 const vector<routeEntry> &removedRoutes, const vector<routeEntry> &addedRoutes) const {
+    if(graph.nodeCount() != nodeCount())
+        return false;
+    for(size_t i = 0; i < addedRoutes.size(); ++i) {
+        if(!hasRoutes(addedRoutes[i].source) || !reaches(addedRoutes[i].source, addedRoutes[i].target))
+            return false;
+    }
+
+    uint32_t brokenComponent = NOT_INDEXED, start = 0;
+    for(size_t i = 0; i < removedRoutes.size(); ++i) {
+        const routeEntry &route = removedRoutes[i];
+        bool isStillRouted = false;
+        for(uint32_t edge = graph.edgeBegin(route.source); !isStillRouted && edge != graph.edgeEnd(route.source); ++edge)
+            isStillRouted = graph.target(edge) == route.target;
+        if(isStillRouted)
+            continue;
+        uint32_t component = components[route.source];
+        if(component != components[route.target] || componentSizes[component] == 1
+                || (brokenComponent != NOT_INDEXED && brokenComponent != component))
+            return false;
+        brokenComponent = component;
+        start = route.source;
+    }
+    if(brokenComponent == NOT_INDEXED)
+        return true;
+    return countReachedWithin(graph, start) == componentSizes[brokenComponent]
+        && countReachedWithin(reverseGraph, start) == componentSizes[brokenComponent];
+}
+
+void ReachabilityIndex::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_REACHABILITY_COMPONENTS, components);
+    writer.addSection(SECTION_REACHABILITY_SIZES, componentSizes);
+    writer.addSection(SECTION_REACHABILITY_ROWS, rows);
+    writer.addSection(SECTION_REACHABILITY_CLOSURE, closure);
+}
+
+// Attaches the index stored in a snapshot, if it covers exactly "expectedNodeCount" airports
+bool ReachabilityIndex::read(const SnapshotReader &reader, size_t expectedNodeCount) {
+    if(!reader.attachSection(SECTION_REACHABILITY_COMPONENTS, components)
+            || !reader.attachSection(SECTION_REACHABILITY_SIZES, componentSizes)
+            || !reader.attachSection(SECTION_REACHABILITY_ROWS, rows)
+            || !reader.attachSection(SECTION_REACHABILITY_CLOSURE, closure)) {
+        clear();
+        return false;
+    }
+
+    size_t rowCount = 0;
+    bool valid = components.size() == expectedNodeCount && rows.size() == componentSizes.size();
+    for(size_t i = 0; valid && i < rows.size(); ++i) {
+        if(rows[i] != NOT_INDEXED)
+            valid = rows[i] == rowCount++;
+    }
+    rowWords = (rowCount + 63) / 64;
+    valid = valid && closure.size() == rowCount * rowWords;
+    for(size_t i = 0; valid && i < components.size(); ++i)
+        valid = components[i] < componentSizes.size();
+    if(!valid)
+        clear();
+    return valid;
+}
+
+void ReachabilityIndex::clear() {
+    components.clear();
+    componentSizes.clear();
+    rows.clear();
+    closure.clear();
+    rowWords = 0;
+}
+
+// Number of airports "source" can reach, itself included
+size_t ReachabilityIndex::reachableCount(uint32_t source) const {
+    uint32_t row = rows[components[source]];
+    if(row == NOT_INDEXED)
+        return 1;
+    const uint64_t *bits = closure.data() + size_t(row) * rowWords;
+    size_t count = 0;
+    for(size_t component = 0; component < rows.size(); ++component) {
+        uint32_t column = rows[component];
+        if(column != NOT_INDEXED && (bits[column / 64] >> (column % 64)) & 1)
+            count += componentSizes[component];
+    }
+    return count;
+}
+
+reachabilityStats ReachabilityIndex::getStats() const {
+    reachabilityStats stats = {componentSizes.size(), 0, 0, 0, 0};
+    for(size_t component = 0; component < componentSizes.size(); ++component) {
+        stats.largestComponent = max(stats.largestComponent, size_t(componentSizes[component]));
+        if(rows[component] != NOT_INDEXED)
+            ++stats.indexedComponents;
+        else
+            stats.isolatedAirports += componentSizes[component];
+    }
+    stats.indexBytes = components.size() * sizeof(uint32_t) + componentSizes.size() * sizeof(uint32_t)
+                     + rows.size() * sizeof(uint32_t) + closure.size() * sizeof(uint64_t);
+    return stats;
+}
+
+// Number of airports of the component of "start" that routes of "graph" lead to from "start" without leaving it
+size_t ReachabilityIndex::countReachedWithin(const RouteGraph &graph, uint32_t start) const {
+    uint32_t component = components[start];
+    vector<bool> isReached(graph.nodeCount(), false);
+    vector<uint32_t> open(1, start);
+    isReached[start] = true;
+    size_t reached = 1;
+    while(!open.empty()) {
+        uint32_t node = open.back();
+        open.pop_back();
+        for(uint32_t edge = graph.edgeBegin(node); edge != graph.edgeEnd(node); ++edge) {
+            uint32_t next = graph.target(edge);
+            if(isReached[next] || components[next] != component)
+                continue;
+            isReached[next] = true;
+            open.push_back(next);
+            ++reached;
+        }
+    }
+    return reached;
+}
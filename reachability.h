@@ -0,0 +1,77 @@
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+#include "routegraph.h"
+#include "snapshot.h"
+
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+// Shape of the route network, as strongly connected components (sets of airports that can all reach each other)
+struct reachabilityStats {
+    size_t components;        // Every airport is in exactly one, airports without routes in one of their own
+    size_t largestComponent;  // Airports in the largest component
+    size_t isolatedAirports;  // Airports no route leaves or arrives at
+    size_t indexedComponents; // Components with a route, which get a row of the closure
+    size_t indexBytes;        // Memory of the whole index
+};
+
+// Strongly connected components of a RouteGraph, and which components can reach which
+// Two airports of one component always reach each other; otherwise the source's component has to reach
+// the target's in the condensation (the graph of components, which has no cycles), whose transitive
+// closure is kept as one bitset row per component, so reaches() is two lookups and a bit test
+// Components without any route are left out of the closure: they are mostly single airports with no
+// commercial flights, and can not reach or be reached from anywhere else
+class ReachabilityIndex {
+
+public:
+
+    static constexpr uint32_t NOT_INDEXED = UINT32_MAX;
+
+    ReachabilityIndex();
+
+    void build(const RouteGraph &graph);
+    bool isKeptBy(const RouteGraph &graph, const RouteGraph &reverseGraph,
+                  const std::vector<routeEntry> &removedRoutes, const std::vector<routeEntry> &addedRoutes) const;
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader, size_t expectedNodeCount);
+    void clear();
+
+    size_t nodeCount() const { return components.size(); }
+    size_t componentCount() const { return componentSizes.size(); }
+    uint32_t component(uint32_t node) const { return components[node]; }
+    uint32_t componentSize(uint32_t component) const { return componentSizes[component]; }
+    bool hasRoutes(uint32_t node) const { return rows[components[node]] != NOT_INDEXED; }
+
+    // True if some sequence of routes leads from "source" to "target" (always true for the same airport)
+    bool reaches(uint32_t source, uint32_t target) const {
+        uint32_t sourceComponent = components[source];
+        uint32_t targetComponent = components[target];
+        if(sourceComponent == targetComponent)
+            return true;
+        uint32_t row = rows[sourceComponent];
+        uint32_t column = rows[targetComponent];
+        if(row == NOT_INDEXED || column == NOT_INDEXED)
+            return false;
+        return (closure[size_t(row) * rowWords + column / 64] >> (column % 64)) & 1;
+    }
+
+    size_t reachableCount(uint32_t source) const;
+    reachabilityStats getStats() const;
+
+
+private:
+
+    FlatArray<uint32_t> components;     // Component of each airport, numbered in the order Tarjan's algorithm
+                                        // finishes them, so a component only reaches lower numbered ones
+    FlatArray<uint32_t> componentSizes;
+    FlatArray<uint32_t> rows;           // Closure row of each component, or NOT_INDEXED
+    FlatArray<uint64_t> closure;        // One row of rowWords words per indexed component
+    size_t rowWords;
+
+
+    size_t countReachedWithin(const RouteGraph &graph, uint32_t start) const;
+};
+
+#endif // REACHABILITY_H
@@ -0,0 +1,171 @@
+#include "routegraph.h"
+#include <algorithm>
+
+using namespace std;
+
+RouteGraph::RouteGraph() {
+}
+
+// Packs the collected routes into CSR form using a counting sort on the source index
+// Routes keep their file order within each airport, so carrier listings stay stable
+void RouteGraph::build(size_t nodeCount, const vector<routeEntry> &routes) {
+    vector<uint32_t> builtOffsets(nodeCount + 1, 0);
+    vector<uint32_t> builtTargets(routes.size());
+    vector<double> builtWeights(routes.size());
+    vector<int32_t> builtCarriers(routes.size());
+
+    // Counts outgoing routes per airport, then turns the counts into start offsets
+    for(size_t i = 0; i < routes.size(); ++i)
+        ++builtOffsets[routes[i].source + 1];
+    for(size_t i = 0; i < nodeCount; ++i)
+        builtOffsets[i + 1] += builtOffsets[i];
+
+    // Scatters each route into the next free slot of its source airport
+    vector<uint32_t> nextSlot(builtOffsets.begin(), builtOffsets.end() - 1);
+    for(size_t i = 0; i < routes.size(); ++i) {
+        uint32_t slot = nextSlot[routes[i].source]++;
+        builtTargets[slot] = routes[i].target;
+        builtWeights[slot] = routes[i].distance;
+        builtCarriers[slot] = routes[i].carrierId;
+    }
+
+    offsets.assign(move(builtOffsets));
+    targets.assign(move(builtTargets));
+    weights.assign(move(builtWeights));
+    carriers.assign(move(builtCarriers));
+}
+
+// Builds the graph of the same routes flown backwards, where the edges of airport "i"
+// are the routes arriving at "i" (used by searches that run from the destination)
+RouteGraph RouteGraph::reversed() const {
+    vector<routeEntry> routes(edgeCount());
+    for(uint32_t source = 0; source < nodeCount(); ++source) {
+        for(uint32_t e = edgeBegin(source); e < edgeEnd(source); ++e) {
+            routes[e].source = targets[e];
+            routes[e].target = source;
+            routes[e].carrierId = carriers[e];
+            routes[e].distance = weights[e];
+        }
+    }
+    RouteGraph reverse;
+    reverse.build(nodeCount(), routes);
+    return reverse;
+}
+
+// Copies the graph over "nodeCount" airports (no fewer than before) with "removed" routes taken out
+// and "added" routes appended after the remaining routes of their source airport
+// A removed route takes out every slot with the same source, target and carrier, and its distance is ignored
+// Airports without changes keep their slots in the same order: each run of them between two changed
+// airports is copied as one block, with its offsets moved by the slots added or removed before it,
+// so apart from copying the arrays the work follows the number of changed routes
+RouteGraph RouteGraph::withChanges(size_t nodeCount, const vector<routeEntry> &removed, const vector<routeEntry> &added) const {
+    auto bySource = [](const routeEntry &a, const routeEntry &b) { return a.source < b.source; };
+    vector<routeEntry> sortedRemoved(removed);
+    vector<routeEntry> sortedAdded(added);
+    sort(sortedRemoved.begin(), sortedRemoved.end(), bySource);
+    stable_sort(sortedAdded.begin(), sortedAdded.end(), bySource);
+
+    vector<uint32_t> builtOffsets(nodeCount + 1);
+    vector<uint32_t> builtTargets;
+    vector<double> builtWeights;
+    vector<int32_t> builtCarriers;
+    builtTargets.reserve(edgeCount() + added.size());
+    builtWeights.reserve(edgeCount() + added.size());
+    builtCarriers.reserve(edgeCount() + added.size());
+
+    // Copies airports [copiedUpTo, end) unchanged; airports past the old graph have no routes yet
+    uint32_t copiedUpTo = 0;
+    auto copyUnchanged = [&](uint32_t end) {
+        uint32_t oldEnd = min<uint32_t>(end, this->nodeCount());
+        if(copiedUpTo < oldEnd) {
+            uint32_t first = edgeBegin(copiedUpTo), last = edgeBegin(oldEnd);
+            uint32_t base = builtTargets.size();
+            for(uint32_t node = copiedUpTo; node < oldEnd; ++node)
+                builtOffsets[node] = offsets[node] - first + base;
+            builtTargets.insert(builtTargets.end(), targets.begin() + first, targets.begin() + last);
+            builtWeights.insert(builtWeights.end(), weights.begin() + first, weights.begin() + last);
+            builtCarriers.insert(builtCarriers.end(), carriers.begin() + first, carriers.begin() + last);
+        }
+        for(uint32_t node = max(copiedUpTo, oldEnd); node < end; ++node)
+            builtOffsets[node] = builtTargets.size();
+        copiedUpTo = max(copiedUpTo, end);
+    };
+
+    size_t nextRemoved = 0, nextAdded = 0;
+    while(nextRemoved < sortedRemoved.size() || nextAdded < sortedAdded.size()) {
+        uint32_t node = nextAdded == sortedAdded.size() ? sortedRemoved[nextRemoved].source
+                      : nextRemoved == sortedRemoved.size() ? sortedAdded[nextAdded].source
+                      : min(sortedRemoved[nextRemoved].source, sortedAdded[nextAdded].source);
+        copyUnchanged(node);
+        builtOffsets[node] = builtTargets.size();
+
+        size_t firstRemoved = nextRemoved;
+        while(nextRemoved < sortedRemoved.size() && sortedRemoved[nextRemoved].source == node)
+            ++nextRemoved;
+        if(node < this->nodeCount()) {
+            for(uint32_t e = edgeBegin(node); e < edgeEnd(node); ++e) {
+                bool isRemoved = false;
+                for(size_t r = firstRemoved; r < nextRemoved && !isRemoved; ++r)
+                    isRemoved = sortedRemoved[r].target == targets[e] && sortedRemoved[r].carrierId == carriers[e];
+                if(isRemoved)
+                    continue;
+                builtTargets.push_back(targets[e]);
+                builtWeights.push_back(weights[e]);
+                builtCarriers.push_back(carriers[e]);
+            }
+        }
+        for(; nextAdded < sortedAdded.size() && sortedAdded[nextAdded].source == node; ++nextAdded) {
+            builtTargets.push_back(sortedAdded[nextAdded].target);
+            builtWeights.push_back(sortedAdded[nextAdded].distance);
+            builtCarriers.push_back(sortedAdded[nextAdded].carrierId);
+        }
+        copiedUpTo = node + 1;
+    }
+    copyUnchanged(nodeCount);
+    builtOffsets[nodeCount] = builtTargets.size();
+
+    RouteGraph updated;
+    updated.offsets.assign(move(builtOffsets));
+    updated.targets.assign(move(builtTargets));
+    updated.weights.assign(move(builtWeights));
+    updated.carriers.assign(move(builtCarriers));
+    return updated;
+}
+
+// Stores the offsets, targets, weights and carriers as four consecutive sections from "firstSection",
+// so the reversed graph can be stored next to the forward one
+void RouteGraph::write(SnapshotWriter &writer, uint32_t firstSection) const {
+    writer.addSection(firstSection, offsets);
+    writer.addSection(firstSection + 1, targets);
+    writer.addSection(firstSection + 2, weights);
+    writer.addSection(firstSection + 3, carriers);
+}
+
+// Attaches the CSR arrays to the snapshot, rejecting offsets or targets that point outside the graph
+bool RouteGraph::read(const SnapshotReader &reader, uint32_t firstSection) {
+    if(!reader.attachSection(firstSection, offsets)
+            || !reader.attachSection(firstSection + 1, targets)
+            || !reader.attachSection(firstSection + 2, weights)
+            || !reader.attachSection(firstSection + 3, carriers))
+        return false;
+
+    if(offsets.empty() || offsets[0] != 0 || offsets[offsets.size() - 1] != targets.size()
+            || weights.size() != targets.size() || carriers.size() != targets.size())
+        return false;
+    for(size_t i = 0; i + 1 < offsets.size(); ++i) {
+        if(offsets[i] > offsets[i + 1])
+            return false;
+    }
+    for(size_t i = 0; i < targets.size(); ++i) {
+        if(targets[i] >= nodeCount())
+            return false;
+    }
+    return true;
+}
+
+void RouteGraph::clear() {
+    offsets.clear();
+    targets.clear();
+    weights.clear();
+    carriers.clear();
+}
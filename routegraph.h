@@ -0,0 +1,54 @@
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+#include "snapshot.h"
+
+#ifndef ROUTEGRAPH_H
+#define ROUTEGRAPH_H
+
+// Single directed route collected while reading the route file,
+// using dense airport indices rather than OpenFlights ids
+struct routeEntry {
+    uint32_t source;
+    uint32_t target;
+    int carrierId;
+    double distance;
+};
+
+// Read-only compressed sparse row graph over dense airport indices (0..N-1)
+// The outgoing routes of airport "i" are the edge slots [edgeBegin(i), edgeEnd(i)),
+// and each slot stores its target, weight and carrier in packed parallel arrays
+class RouteGraph {
+
+public:
+
+    RouteGraph();
+
+    void build(size_t nodeCount, const std::vector<routeEntry> &routes);
+    RouteGraph reversed() const;
+    RouteGraph withChanges(size_t nodeCount, const std::vector<routeEntry> &removed,
+                           const std::vector<routeEntry> &added) const;
+    void write(SnapshotWriter &writer, uint32_t firstSection = SECTION_GRAPH_OFFSETS) const;
+    bool read(const SnapshotReader &reader, uint32_t firstSection = SECTION_GRAPH_OFFSETS);
+    void clear();
+
+    size_t nodeCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t edgeCount() const { return targets.size(); }
+
+    uint32_t edgeBegin(uint32_t node) const { return offsets[node]; }
+    uint32_t edgeEnd(uint32_t node) const { return offsets[node + 1]; }
+    uint32_t target(uint32_t edge) const { return targets[edge]; }
+    double weight(uint32_t edge) const { return weights[edge]; }
+    int carrier(uint32_t edge) const { return carriers[edge]; }
+
+
+private:
+
+    FlatArray<uint32_t> offsets;
+    FlatArray<uint32_t> targets;
+    FlatArray<double> weights;
+    FlatArray<int32_t> carriers;
+};
+
+#endif // ROUTEGRAPH_H
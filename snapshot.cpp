@@ -0,0 +1,219 @@
+#include "snapshot.h"
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Bumped whenever the layout of a section or the header changes
+const uint32_t SNAPSHOT_VERSION = 9;
+const char SNAPSHOT_MAGIC[8] = {'S', 'F', 'P', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct snapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t sourceCount;
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct sectionEntry {
+    uint32_t tag;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Rounds "size" up to the next multiple of 8 so every section stays aligned
+static uint64_t alignedSize(uint64_t size) {
+    return (size + 7) & ~uint64_t(7);
+}
+
+/// MAPPED FILE
+///
+
+MappedFile::MappedFile(const string &filename) : address(nullptr), length(0) {
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if(descriptor < 0)
+        return;
+
+    struct stat info;
+    if(fstat(descriptor, &info) == 0 && info.st_size > 0) {
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(mapped != MAP_FAILED) {
+            address = static_cast<const unsigned char *>(mapped);
+            length = info.st_size;
+        }
+    }
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if(address != nullptr)
+        munmap(const_cast<unsigned char *>(address), length);
+}
+
+/// SNAPSHOT WRITER
+///
+
+void SnapshotWriter::addSection(uint32_t tag, uint32_t elementSize, const void *values, size_t count) {
+    pendingSection section;
+    section.tag = tag;
+    section.elementSize = elementSize;
+    section.values = values;
+    section.count = count;
+    sections.push_back(section);
+}
+
+// Lays out the whole file in memory, checksums everything after the header, then writes it
+// Stamps of "sourceFiles" are stored so a later load can tell if the CSV files changed
+bool SnapshotWriter::save(const string &filename, const vector<string> &sourceFiles) const {
+    uint64_t tableOffset = sizeof(snapshotHeader) + sourceFiles.size() * sizeof(sourceStamp);
+    uint64_t payloadOffset = alignedSize(tableOffset + sections.size() * sizeof(sectionEntry));
+
+    vector<sectionEntry> table(sections.size());
+    uint64_t fileSize = payloadOffset;
+    for(size_t i = 0; i < sections.size(); ++i) {
+        table[i].tag = sections[i].tag;
+        table[i].elementSize = sections[i].elementSize;
+        table[i].offset = fileSize;
+        table[i].count = sections[i].count;
+        fileSize = alignedSize(fileSize + sections[i].count * sections[i].elementSize);
+    }
+
+    vector<unsigned char> image(fileSize, 0);
+    for(size_t i = 0; i < sourceFiles.size(); ++i) {
+        sourceStamp stamp;
+        if(!readSourceStamp(sourceFiles[i], stamp))
+            return false;
+        memcpy(&image[sizeof(snapshotHeader) + i * sizeof(sourceStamp)], &stamp, sizeof(sourceStamp));
+    }
+    if(!table.empty())
+        memcpy(&image[tableOffset], table.data(), table.size() * sizeof(sectionEntry));
+    for(size_t i = 0; i < sections.size(); ++i) {
+        if(sections[i].count != 0)
+            memcpy(&image[table[i].offset], sections[i].values, sections[i].count * sections[i].elementSize);
+    }
+
+    snapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.sourceCount = sourceFiles.size();
+    header.sectionCount = sections.size();
+    header.fileSize = fileSize;
+    header.checksum = snapshotChecksum(&image[sizeof(snapshotHeader)], fileSize - sizeof(snapshotHeader));
+    memcpy(&image[0], &header, sizeof(header));
+
+    // Writes to a temporary name first so a crash never leaves a half written snapshot
+    string temporaryFile = filename + ".tmp";
+    ofstream fout(temporaryFile.c_str(), ios::binary | ios::trunc);
+    fout.write(reinterpret_cast<const char *>(image.data()), image.size());
+    fout.close();
+    if(!fout || rename(temporaryFile.c_str(), filename.c_str()) != 0) {
+        remove(temporaryFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// SNAPSHOT READER
+///
+
+// Checks magic, version, byte order, size and checksum before any section is handed out
+SnapshotReader::SnapshotReader(const unsigned char *data, size_t size) : base(data), length(size), valid(false) {
+    if(data == nullptr || size < sizeof(snapshotHeader))
+        return;
+
+    const snapshotHeader *header = reinterpret_cast<const snapshotHeader *>(base);
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+            || header->version != SNAPSHOT_VERSION
+            || header->byteOrder != SNAPSHOT_BYTE_ORDER
+            || header->fileSize != size)
+        return;
+
+    uint64_t tableEnd = sizeof(snapshotHeader) + uint64_t(header->sourceCount) * sizeof(sourceStamp)
+                      + uint64_t(header->sectionCount) * sizeof(sectionEntry);
+    if(tableEnd > size)
+        return;
+
+    valid = header->checksum == snapshotChecksum(base + sizeof(snapshotHeader), size - sizeof(snapshotHeader));
+}
+
+// A snapshot is stale when any source file it was compiled from changed size or modification time
+// Missing source files are not treated as stale, since the snapshot is then the only copy of the data
+bool SnapshotReader::isStale(const vector<string> &sourceFiles) const {
+    const snapshotHeader *header = reinterpret_cast<const snapshotHeader *>(base);
+    if(!valid || header->sourceCount != sourceFiles.size())
+        return true;
+
+    const sourceStamp *stamps = reinterpret_cast<const sourceStamp *>(base + sizeof(snapshotHeader));
+    for(size_t i = 0; i < sourceFiles.size(); ++i) {
+        sourceStamp current;
+        if(!readSourceStamp(sourceFiles[i], current))
+            continue;
+        if(current.size != stamps[i].size
+                || current.modifiedSeconds != stamps[i].modifiedSeconds
+                || current.modifiedNanoseconds != stamps[i].modifiedNanoseconds)
+            return true;
+    }
+    return false;
+}
+
+bool SnapshotReader::findSection(uint32_t tag, uint32_t elementSize, const void *&sectionData, size_t &count) const {
+    if(!valid)
+        return false;
+
+    const snapshotHeader *header = reinterpret_cast<const snapshotHeader *>(base);
+    const sectionEntry *table = reinterpret_cast<const sectionEntry *>(
+                base + sizeof(snapshotHeader) + header->sourceCount * sizeof(sourceStamp));
+
+    for(uint32_t i = 0; i < header->sectionCount; ++i) {
+        if(table[i].tag != tag)
+            continue;
+        if(table[i].elementSize != elementSize || table[i].offset % 8 != 0
+                || table[i].offset > length || table[i].count > (length - table[i].offset) / elementSize)
+            return false;
+        sectionData = base + table[i].offset;
+        count = table[i].count;
+        return true;
+    }
+    return false;
+}
+
+/// HELPER FUNCTIONS
+///
+
+bool readSourceStamp(const string &filename, sourceStamp &stamp) {
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0)
+        return false;
+    stamp.size = info.st_size;
+    stamp.modifiedSeconds = info.st_mtim.tv_sec;
+    stamp.modifiedNanoseconds = info.st_mtim.tv_nsec;
+    return true;
+}
+
+// 64-bit FNV-1a style hash that consumes eight bytes per step
+// Only meant to catch truncated or corrupted files, not tampering
+uint64_t snapshotChecksum(const unsigned char *data, size_t size) {
+    const uint64_t PRIME = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * PRIME;
+        hash ^= hash >> 29;
+    }
+    for(; i < size; ++i)
+        hash = (hash ^ data[i]) * PRIME;
+    return hash;
+}
@@ -0,0 +1,151 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Identifies each array stored in a snapshot file
+enum snapshotSections {
+    SECTION_AIRPORT_IDS = 1,
+    SECTION_AIRPORT_LATITUDES,
+    SECTION_AIRPORT_LONGITUDES,
+    SECTION_AIRPORT_STRINGS,
+    SECTION_AIRPORT_POOL,
+    SECTION_AIRPORT_LETTER_CODES,
+    SECTION_AIRPORT_ID_ORDER,
+    SECTION_CARRIER_IDS,
+    SECTION_CARRIER_NAMES,
+    SECTION_CARRIER_POOL,
+    SECTION_GRAPH_OFFSETS,
+    SECTION_GRAPH_TARGETS,
+    SECTION_GRAPH_WEIGHTS,
+    SECTION_GRAPH_CARRIERS,
+    SECTION_HIERARCHY_RANKS,
+    SECTION_HIERARCHY_UP_OFFSETS,
+    SECTION_HIERARCHY_UP_TARGETS,
+    SECTION_HIERARCHY_UP_WEIGHTS,
+    SECTION_HIERARCHY_UP_MIDDLES,
+    SECTION_HIERARCHY_DOWN_OFFSETS,
+    SECTION_HIERARCHY_DOWN_TARGETS,
+    SECTION_HIERARCHY_DOWN_WEIGHTS,
+    SECTION_HIERARCHY_DOWN_MIDDLES,
+    SECTION_REVERSE_OFFSETS,  // Reversed route graph, in the same order as SECTION_GRAPH_*
+    SECTION_REVERSE_TARGETS,
+    SECTION_REVERSE_WEIGHTS,
+    SECTION_REVERSE_CARRIERS,
+    SECTION_CARRIER_GRAPH_IDS,
+    SECTION_CARRIER_GRAPH_OFFSETS,
+    SECTION_CARRIER_GRAPH_TARGETS,
+    SECTION_CARRIER_GRAPH_WEIGHTS,
+    SECTION_CARRIER_GRAPH_SETS,
+    SECTION_CARRIER_GRAPH_LIST_OFFSETS,
+    SECTION_CARRIER_GRAPH_LISTS,
+    SECTION_AIRPORT_OTHER_CODES,
+    SECTION_AIRPORT_ICAO_CODES,
+    SECTION_GEO_SIN_HALF_LATITUDES,
+    SECTION_GEO_COS_HALF_LATITUDES,
+    SECTION_GEO_SIN_HALF_LONGITUDES,
+    SECTION_GEO_COS_HALF_LONGITUDES,
+    SECTION_GEO_COS_LATITUDES,
+    SECTION_SPATIAL_POINTS,
+    SECTION_REACHABILITY_COMPONENTS,
+    SECTION_REACHABILITY_SIZES,
+    SECTION_REACHABILITY_ROWS,
+    SECTION_REACHABILITY_CLOSURE
+};
+
+// Size and modification time of a source file when a snapshot was compiled
+// Used to detect snapshots that are older than the CSV files they came from
+struct sourceStamp {
+    uint64_t size;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+};
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+
+public:
+
+    MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    bool isOpen() const { return address != nullptr; }
+    const unsigned char *data() const { return address; }
+    size_t size() const { return length; }
+
+
+private:
+
+    const unsigned char *address;
+    size_t length;
+
+    MappedFile(const MappedFile &other);
+    MappedFile &operator=(const MappedFile &other);
+};
+
+// Collects typed arrays and writes them as one versioned, checksummed snapshot file
+// Layout: header, source stamps, section table, then the 8-byte aligned section payloads
+class SnapshotWriter {
+
+public:
+
+    template<typename T>
+    void addSection(uint32_t tag, const FlatArray<T> &values) {
+        addSection(tag, sizeof(T), values.data(), values.size());
+    }
+
+    void addSection(uint32_t tag, uint32_t elementSize, const void *values, size_t count);
+    bool save(const std::string &filename, const std::vector<std::string> &sourceFiles) const;
+
+
+private:
+
+    struct pendingSection {
+        uint32_t tag;
+        uint32_t elementSize;
+        const void *values;
+        uint64_t count;
+    };
+
+    std::vector<pendingSection> sections;
+};
+
+// Validates a mapped snapshot and hands out typed views of its sections
+class SnapshotReader {
+
+public:
+
+    SnapshotReader(const unsigned char *data, size_t size);
+
+    bool isValid() const { return valid; }
+    bool isStale(const std::vector<std::string> &sourceFiles) const;
+
+    // Points "values" at the section "tag" if it exists with elements of type T
+    template<typename T>
+    bool attachSection(uint32_t tag, FlatArray<T> &values) const {
+        const void *sectionData;
+        size_t count;
+        if(!findSection(tag, sizeof(T), sectionData, count))
+            return false;
+        values.attach(static_cast<const T *>(sectionData), count);
+        return true;
+    }
+
+
+private:
+
+    const unsigned char *base;
+    size_t length;
+    bool valid;
+
+    bool findSection(uint32_t tag, uint32_t elementSize, const void *&sectionData, size_t &count) const;
+};
+
+bool readSourceStamp(const std::string &filename, sourceStamp &stamp);
+uint64_t snapshotChecksum(const unsigned char *data, size_t size);
+
+#endif // SNAPSHOT_H
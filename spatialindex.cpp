@@ -0,0 +1,186 @@
+#include "spatialindex.h"
+#include "geo.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// Squared chord and airport index of a found airport, which order results closest first
+typedef pair<double, uint32_t> chordMatch;
+
+// Helper function : Position of a latitude/longitude (degrees) on the unit sphere
+static void toUnitSphere(double latitude, double longitude, double position[3]) {
+    double lat = toRadian(latitude);
+    double lon = toRadian(longitude);
+    position[0] = cos(lat) * cos(lon);
+    position[1] = cos(lat) * sin(lon);
+    position[2] = sin(lat);
+}
+
+static double coordinate(const spatialPoint &point, uint32_t axis) {
+    return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+}
+
+static double squaredChord(const spatialPoint &point, const double position[3]) {
+    double dx = point.x - position[0];
+    double dy = point.y - position[1];
+    double dz = point.z - position[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Helper function : Great-circle distance (miles) spanned by a chord of the unit sphere
+static double chordToMiles(double squared) {
+    return 2 * EARTH_RADIUS_MILES * asin(min(sqrt(squared) / 2, 1.0));
+}
+
+// Splits points[begin, end) on the axis they spread furthest along, with the median in the middle
+// as the subtree's root, then does the same for both halves
+static void buildSubtree(vector<spatialPoint> &points, size_t begin, size_t end) {
+    if(end - begin <= 1) {
+        if(begin != end)
+            points[begin].axis = 0;
+        return;
+    }
+
+    double lowest[3] = {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+    double highest[3] = {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+    for(size_t i = begin; i < end; ++i) {
+        for(uint32_t axis = 0; axis < 3; ++axis) {
+            lowest[axis] = min(lowest[axis], coordinate(points[i], axis));
+            highest[axis] = max(highest[axis], coordinate(points[i], axis));
+        }
+    }
+    uint32_t splitAxis = 0;
+    for(uint32_t axis = 1; axis < 3; ++axis) {
+        if(highest[axis] - lowest[axis] > highest[splitAxis] - lowest[splitAxis])
+            splitAxis = axis;
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    nth_element(points.begin() + begin, points.begin() + middle, points.begin() + end,
+                [splitAxis](const spatialPoint &a, const spatialPoint &b) {
+        return coordinate(a, splitAxis) < coordinate(b, splitAxis);
+    });
+    points[middle].axis = splitAxis;
+    buildSubtree(points, begin, middle);
+    buildSubtree(points, middle + 1, end);
+}
+
+// Keeps the "count" closest airports of the subtree in "found", a max heap on (squared chord, airport)
+// A subtree is only visited while the plane it lies behind is closer than the farthest airport kept
+static void findNearest(const spatialPoint *points, size_t begin, size_t end, const double position[3],
+                        size_t count, vector<chordMatch> &found) {
+    if(begin == end)
+        return;
+    size_t middle = begin + (end - begin) / 2;
+    const spatialPoint &root = points[middle];
+
+    chordMatch match(squaredChord(root, position), root.airport);
+    if(found.size() < count) {
+        found.push_back(match);
+        push_heap(found.begin(), found.end());
+    }
+    else if(match < found.front()) {
+        pop_heap(found.begin(), found.end());
+        found.back() = match;
+        push_heap(found.begin(), found.end());
+    }
+
+    double offset = position[root.axis] - coordinate(root, root.axis);
+    bool isLeftFirst = offset < 0;
+    if(isLeftFirst)
+        findNearest(points, begin, middle, position, count, found);
+    else
+        findNearest(points, middle + 1, end, position, count, found);
+    if(found.size() < count || offset * offset <= found.front().first) {
+        if(isLeftFirst)
+            findNearest(points, middle + 1, end, position, count, found);
+        else
+            findNearest(points, begin, middle, position, count, found);
+    }
+}
+
+// Adds every airport of the subtree whose squared chord to "position" is at most "limit"
+static void findWithin(const spatialPoint *points, size_t begin, size_t end, const double position[3],
+                       double limit, vector<chordMatch> &found) {
+    if(begin == end)
+        return;
+    size_t middle = begin + (end - begin) / 2;
+    const spatialPoint &root = points[middle];
+
+    double squared = squaredChord(root, position);
+    if(squared <= limit)
+        found.push_back(chordMatch(squared, root.airport));
+
+    double offset = position[root.axis] - coordinate(root, root.axis);
+    if(offset <= 0 || offset * offset <= limit)
+        findWithin(points, begin, middle, position, limit, found);
+    if(offset >= 0 || offset * offset <= limit)
+        findWithin(points, middle + 1, end, position, limit, found);
+}
+
+// Sorts "found" and converts it into airports and miles
+static void toResults(vector<chordMatch> &found, vector<nearbyAirport> &results) {
+    sort(found.begin(), found.end());
+    results.resize(found.size());
+    for(size_t i = 0; i < found.size(); ++i) {
+        results[i].airport = found[i].second;
+        results[i].distance = chordToMiles(found[i].first);
+    }
+}
+
+/// SPATIAL INDEX
+///
+
+// Places "count" airports given in degrees on the unit sphere and arranges them into the tree
+void SpatialIndex::build(const double *latitudes, const double *longitudes, size_t count) {
+    vector<spatialPoint> builtPoints(count);
+    for(size_t i = 0; i < count; ++i) {
+        double position[3];
+        toUnitSphere(latitudes[i], longitudes[i], position);
+        builtPoints[i] = spatialPoint{position[0], position[1], position[2], uint32_t(i), 0};
+    }
+    buildSubtree(builtPoints, 0, count);
+    points.assign(move(builtPoints));
+}
+
+void SpatialIndex::write(SnapshotWriter &writer) const {
+    writer.addSection(SECTION_SPATIAL_POINTS, points);
+}
+
+// Attaches the tree stored in a snapshot, if it holds exactly "expectedCount" airports
+bool SpatialIndex::read(const SnapshotReader &reader, size_t expectedCount) {
+    bool valid = reader.attachSection(SECTION_SPATIAL_POINTS, points) && points.size() == expectedCount;
+    for(size_t i = 0; valid && i < points.size(); ++i)
+        valid = points[i].airport < expectedCount && points[i].axis < 3;
+    if(!valid)
+        clear();
+    return valid;
+}
+
+void SpatialIndex::clear() {
+    points.clear();
+}
+
+// Finds the "count" airports closest to a latitude/longitude (degrees), or every airport if there are fewer
+void SpatialIndex::nearest(double latitude, double longitude, size_t count, vector<nearbyAirport> &results) const {
+    double position[3];
+    toUnitSphere(latitude, longitude, position);
+    vector<chordMatch> found;
+    found.reserve(min(count, points.size()));
+    if(count != 0)
+        findNearest(points.data(), 0, points.size(), position, count, found);
+    toResults(found, results);
+}
+
+// Finds every airport at most "radiusMiles" from a latitude/longitude (degrees)
+void SpatialIndex::within(double latitude, double longitude, double radiusMiles, vector<nearbyAirport> &results) const {
+    vector<chordMatch> found;
+    if(radiusMiles >= 0) {
+        double position[3];
+        toUnitSphere(latitude, longitude, position);
+        double chord = 2 * sin(min(radiusMiles / EARTH_RADIUS_MILES, M_PI) / 2);
+        findWithin(points.data(), 0, points.size(), position, chord * chord, found);
+    }
+    toResults(found, results);
+}
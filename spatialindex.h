@@ -0,0 +1,53 @@
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "flatarray.h"
+#include "snapshot.h"
+
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+// Airport found by a SpatialIndex query, with its great-circle distance (miles) from the query point
+struct nearbyAirport {
+    uint32_t airport;
+    double distance;
+};
+
+// One airport in the k-d tree: its position on the unit sphere, and the axis (0 to 2 for x to z)
+// its subtree is split on
+struct spatialPoint {
+    double x;
+    double y;
+    double z;
+    uint32_t airport;
+    uint32_t axis;
+};
+
+// Balanced k-d tree over the airports' positions on the unit sphere, for nearest airport and radius queries
+// The straight line (chord) between two points on the sphere grows with the great-circle distance
+// between them, so the closest airports in 3D are the closest on the ground, with no seam at the
+// antimeridian or the poles
+// The tree is implicit: the point in the middle of a range is that subtree's root, the points
+// before it its left subtree and the points after it its right one, so it is one flat array
+class SpatialIndex {
+
+public:
+
+    void build(const double *latitudes, const double *longitudes, size_t count);
+    void write(SnapshotWriter &writer) const;
+    bool read(const SnapshotReader &reader, size_t expectedCount);
+    void clear();
+
+    size_t size() const { return points.size(); }
+
+    // Both fill "results" closest first, ties by airport index
+    void nearest(double latitude, double longitude, size_t count, std::vector<nearbyAirport> &results) const;
+    void within(double latitude, double longitude, double radiusMiles, std::vector<nearbyAirport> &results) const;
+
+
+private:
+
+    FlatArray<spatialPoint> points;
+};
+
+#endif // SPATIALINDEX_H
@@ -0,0 +1,225 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "controller.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Kinds of query the threads take turns asking, one per query number modulo QUERY_KINDS
+enum queryKinds {
+    QUERY_PLAIN,
+    QUERY_FILTERED,
+    QUERY_LAYOVERS,
+    QUERY_K_SHORTEST,
+    QUERY_NEAREST,
+    QUERY_GROUPS,
+    QUERY_KINDS
+};
+
+// Search algorithm of the handle of each even thread, by half the thread number modulo its length
+// Odd threads query the shared Controller instead, with its default algorithm
+const searchAlgorithms THREAD_ALGORITHMS[] = {
+    DIJKSTRA_INDEXED_HEAP, ASTAR, BIDIRECTIONAL, DIJKSTRA_LAZY_HEAP, CONTRACTION_HIERARCHY
+};
+
+// Airlines left out by filtered queries: American, Delta, Southwest and United
+const int DENIED_CARRIERS[] = {24, 2009, 4547, 5209};
+
+const unsigned MAX_LAYOVERS = 2;
+const size_t K_PATHS = 3;
+const size_t NEAREST_COUNT = 8;
+const double GROUP_RADIUS_MILES = 60;
+
+// Answers may come from different searches, which can sum the legs of equally short paths in another order
+const double DISTANCE_TOLERANCE = 1e-9;
+
+// What one query should answer: the distances found (several for k shortest paths), or the error thrown
+// Nearest-airport queries list airport indices as distances
+struct expectedAnswer {
+    bool isError;
+    CONTROLLER_ERRORS error;
+    vector<double> values;
+};
+
+// Random query, with everything needed to ask it of any kind
+struct stressQuery {
+    string start;
+    string end;
+    double latitude;
+    double longitude;
+    double endLatitude;
+    double endLongitude;
+};
+
+/// Prototypes - - - - - - - - -
+///
+vector<stressQuery> sampleQueries(const Controller &c, size_t queryCount, unsigned seed);
+expectedAnswer ask(const Controller &c, const stressQuery &query, queryKinds kind);
+bool isSameAnswer(const expectedAnswer &a, const expectedAnswer &b);
+
+/// Functions - - - - - - - - - -
+///
+// Usage: flightpath_stress [--data DIR] [--threads N] [--queries N] [--pairs N] [--seed S]
+//   Loads the .dat files in DIR (the current directory by default) once, and works out the answer to
+//   every kind of query for N random pairs of airports and points (500 by default) on one thread
+//   Then N threads (8 by default) each ask --queries queries (20000 by default) at the same time:
+//   odd threads through the one shared Controller, even threads through their own copy of it, each
+//   copy with its own search algorithm, while one more thread keeps reloading the graph and clearing
+//   the caches underneath them. Reloads read the same files, so every answer must stay the same
+//   Prints a summary, and exits with 1 if any answer differed from the single threaded one
+int main(int argc, char *argv[]) {
+    string dataDirectory = ".";
+    size_t threadCount = 8, queriesPerThread = 20000, pairCount = 500;
+    unsigned seed = 1;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if(option == "--data")
+            dataDirectory = argv[i + 1];
+        else if(option == "--threads")
+            threadCount = max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        else if(option == "--queries")
+            queriesPerThread = strtoul(argv[i + 1], nullptr, 10);
+        else if(option == "--pairs")
+            pairCount = max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        else if(option == "--seed")
+            seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    Controller shared(dataDirectory + "/airports.dat", dataDirectory + "/airlines.dat", dataDirectory + "/routes.dat");
+    if(shared.getAirportCount() == 0) {
+        cerr << "No airports loaded from " << dataDirectory << endl;
+        return 1;
+    }
+    vector<stressQuery> queries = sampleQueries(shared, pairCount, seed);
+    vector<expectedAnswer> expected;
+    for(size_t i = 0; i < queries.size() * QUERY_KINDS; ++i)
+        expected.push_back(ask(shared, queries[i / QUERY_KINDS], queryKinds(i % QUERY_KINDS)));
+
+    // Copies are made up front, and any hierarchy they need is built before the clock starts
+    vector<Controller> handles;
+    for(size_t t = 0; t < threadCount; t += 2) {
+        handles.push_back(shared);
+        handles.back().setSearchAlgorithm(THREAD_ALGORITHMS[t / 2 % (sizeof(THREAD_ALGORITHMS) / sizeof(THREAD_ALGORITHMS[0]))]);
+    }
+
+    atomic<size_t> mismatches(0);
+    atomic<size_t> threadsLeft(threadCount);
+    atomic<size_t> reloads(0);
+    steady_clock::time_point begin = steady_clock::now();
+
+    vector<thread> threads;
+    for(size_t t = 0; t < threadCount; ++t) {
+        threads.push_back(thread([&, t]() {
+            const Controller &c = t % 2 == 1 ? shared : handles[t / 2];
+            mt19937 random(seed + t);
+            uniform_int_distribution<size_t> pickQuery(0, expected.size() - 1);
+            for(size_t q = 0; q < queriesPerThread; ++q) {
+                size_t index = pickQuery(random);
+                expectedAnswer answer = ask(c, queries[index / QUERY_KINDS], queryKinds(index % QUERY_KINDS));
+                if(!isSameAnswer(answer, expected[index]) && mismatches.fetch_add(1) < 10) {
+                    const stressQuery &query = queries[index / QUERY_KINDS];
+                    cerr << "Thread " << t << " got another answer for " << query.start << " " << query.end
+                         << " (query kind " << index % QUERY_KINDS << ")" << endl;
+                }
+            }
+            --threadsLeft;
+        }));
+    }
+
+    // Every reload publishes a new version, with empty caches, while queries hold on to the old one
+    Controller updater = shared;
+    while(threadsLeft != 0) {
+        updater.reload();
+        updater.clearCaches();
+        ++reloads;
+    }
+    for(size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    double seconds = duration<double>(steady_clock::now() - begin).count();
+    size_t queryCount = threadCount * queriesPerThread;
+    cout << "stress: " << threadCount << " threads, " << queryCount << " queries in " << seconds << " s ("
+         << queryCount / seconds << " per second), " << reloads << " reloads, graph version "
+         << shared.getGraphVersion() << ", " << mismatches << " mismatches" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Draws pairs of distinct airports with an IATA code, each with a pair of random points
+vector<stressQuery> sampleQueries(const Controller &c, size_t queryCount, unsigned seed) {
+    mt19937 random(seed);
+    uniform_int_distribution<uint32_t> pickAirport(0, c.getAirportCount() - 1);
+    uniform_real_distribution<double> pickLatitude(-60, 70);
+    uniform_real_distribution<double> pickLongitude(-180, 180);
+    vector<stressQuery> queries;
+    while(queries.size() < queryCount) {
+        stressQuery query;
+        query.start = c.getAirportCode(pickAirport(random));
+        query.end = c.getAirportCode(pickAirport(random));
+        query.latitude = pickLatitude(random);
+        query.longitude = pickLongitude(random);
+        query.endLatitude = pickLatitude(random);
+        query.endLongitude = pickLongitude(random);
+        if(!query.start.empty() && !query.end.empty() && query.start != query.end)
+            queries.push_back(query);
+    }
+    return queries;
+}
+
+// Asks "c" one query of the given kind, and keeps what it answered
+expectedAnswer ask(const Controller &c, const stressQuery &query, queryKinds kind) {
+    expectedAnswer answer;
+    answer.isError = false;
+    try {
+        if(kind == QUERY_PLAIN)
+            answer.values.push_back(c.getItinerary(query.start, query.end).distance());
+        else if(kind == QUERY_FILTERED) {
+            carrierFilter filter;
+            filter.mode = DENY_CARRIERS;
+            filter.carrierIds.assign(begin(DENIED_CARRIERS), end(DENIED_CARRIERS));
+            answer.values.push_back(c.getItinerary(query.start, query.end, filter).distance());
+        }
+        else if(kind == QUERY_LAYOVERS) {
+            vector<pathResult> results = c.getShortestPathsByLayovers(query.start, query.end, MAX_LAYOVERS);
+            for(size_t i = 0; i < results.size(); ++i)
+                answer.values.push_back(results[i].found ? results[i].itinerary.distance() : -1);
+        }
+        else if(kind == QUERY_K_SHORTEST) {
+            vector<Itinerary> options = c.getKShortestPaths(query.start, query.end, K_PATHS);
+            for(size_t i = 0; i < options.size(); ++i)
+                answer.values.push_back(options[i].distance());
+        }
+        else if(kind == QUERY_NEAREST) {
+            vector<nearbyAirport> nearby = c.findNearestAirports(query.latitude, query.longitude, NEAREST_COUNT);
+            for(size_t i = 0; i < nearby.size(); ++i)
+                answer.values.push_back(nearby[i].airport);
+        }
+        else {
+            airportGroup origins = {{groundLink{query.start, 0}}, true, query.latitude, query.longitude, GROUP_RADIUS_MILES};
+            airportGroup destinations = {{groundLink{query.end, 0}}, true, query.endLatitude, query.endLongitude, GROUP_RADIUS_MILES};
+            answer.values.push_back(c.getItinerary(origins, destinations).distance);
+        }
+    }
+    catch(CONTROLLER_ERRORS e) {
+        answer.isError = true;
+        answer.error = e;
+    }
+    return answer;
+}
+
+bool isSameAnswer(const expectedAnswer &a, const expectedAnswer &b) {
+    if(a.isError != b.isError || (a.isError && a.error != b.error) || a.values.size() != b.values.size())
+        return false;
+    for(size_t i = 0; i < a.values.size(); ++i) {
+        if(fabs(a.values[i] - b.values[i]) > DISTANCE_TOLERANCE * max(1.0, fabs(b.values[i])))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+#include "threadpool.h"
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : currentTask(nullptr), taskCount(0), nextTask(0), activeWorkers(0), batchNumber(0), stopping(false) {
+    threadCount = max<size_t>(1, threadCount);
+    for(size_t i = 0; i < threadCount; ++i)
+        workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+void ThreadPool::run(size_t count, const function<void(size_t, size_t)> &task) {
+    if(count == 0)
+        return;
+
+    lock_guard<mutex> runLock(runMutex);
+    unique_lock<mutex> lock(stateMutex);
+    currentTask = &task;
+    taskCount = count;
+    nextTask = 0;
+    activeWorkers = workers.size();
+    firstError = nullptr;
+    ++batchNumber;
+    wakeWorkers.notify_all();
+
+    batchFinished.wait(lock, [&] { return activeWorkers == 0; });
+    currentTask = nullptr;
+    if(firstError)
+        rethrow_exception(firstError);
+}
+
+// Waits for a new batch, then keeps claiming the next unclaimed task until none are left
+void ThreadPool::workerLoop(size_t workerIndex) {
+    uint64_t seenBatch = 0;
+    while(true) {
+        const function<void(size_t, size_t)> *task;
+        size_t count;
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wakeWorkers.wait(lock, [&] { return stopping || batchNumber != seenBatch; });
+            if(stopping)
+                return;
+            seenBatch = batchNumber;
+            task = currentTask;
+            count = taskCount;
+        }
+
+        for(size_t i = nextTask++; i < count; i = nextTask++) {
+            try {
+                (*task)(i, workerIndex);
+            }
+            catch(...) {
+                lock_guard<mutex> lock(stateMutex);
+                if(!firstError)
+                    firstError = current_exception();
+            }
+        }
+
+        lock_guard<mutex> lock(stateMutex);
+        if(--activeWorkers == 0)
+            batchFinished.notify_one();
+    }
+}
@@ -0,0 +1,53 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Fixed set of worker threads that run indexed tasks in parallel
+// Each task also receives the index of the worker running it (0..size()-1),
+// so callers can keep one reusable scratch object per worker
+class ThreadPool {
+
+public:
+
+    ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    size_t size() const { return workers.size(); }
+
+    // Runs "task(taskIndex, workerIndex)" for every taskIndex in [0, taskCount)
+    // Blocks until all tasks finished, and rethrows the first exception a task threw
+    void run(size_t taskCount, const std::function<void(size_t, size_t)> &task);
+
+
+private:
+
+    std::vector<std::thread> workers;
+    std::mutex runMutex;   // Lets only one caller use the workers at a time
+    std::mutex stateMutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable batchFinished;
+
+    const std::function<void(size_t, size_t)> *currentTask;
+    size_t taskCount;
+    std::atomic<size_t> nextTask;
+    size_t activeWorkers;
+    uint64_t batchNumber;
+    bool stopping;
+    std::exception_ptr firstError;
+
+    void workerLoop(size_t workerIndex);
+
+    ThreadPool(const ThreadPool &other);
+    ThreadPool &operator=(const ThreadPool &other);
+};
+
+#endif // THREADPOOL_H